@@ -0,0 +1,217 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#include "AudioFile.h"
+#include "wavpack.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+static uint32_t readLE(const unsigned char *p, int bytes)
+{
+    uint32_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static void writeLE(FILE *file, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) fputc(int((value >> (8 * i)) & 0xff), file);
+}
+
+static bool hasSuffix(const std::string &s, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    if (s.size() < n) return false;
+    for (size_t i = 0; i < n; i++)
+        if (tolower(s[s.size() - n + i]) != suffix[i]) return false;
+    return true;
+}
+
+// same conversion as akSamplerLoadCompressedFile, de-interleaved into planar channels
+static bool readWavPackFile(const std::string &path, AudioFileData &audio, std::string &error)
+{
+    char errMsg[100];
+    WavpackContext *wpc = WavpackOpenFileInput(path.c_str(), errMsg, OPEN_2CH_MAX, 0);
+    if (wpc == 0)
+    {
+        error = errMsg;
+        return false;
+    }
+
+    audio.sampleRate = (float)WavpackGetSampleRate(wpc);
+    audio.channelCount = WavpackGetReducedChannels(wpc);
+    audio.frameCount = (int)WavpackGetNumSamples(wpc);
+    int mode = WavpackGetMode(wpc);
+    int bps = WavpackGetBitsPerSample(wpc);
+
+    std::vector<int32_t> interleaved(size_t(audio.channelCount) * audio.frameCount);
+    uint32_t unpacked = WavpackUnpackSamples(wpc, interleaved.data(), audio.frameCount);
+    WavpackCloseFile(wpc);
+    if ((int)unpacked < audio.frameCount) audio.frameCount = (int)unpacked;
+
+    float scale = 1.0f / (1 << (bps - 1));
+    audio.samples.resize(size_t(audio.channelCount) * audio.frameCount);
+    for (int c = 0; c < audio.channelCount; c++)
+    {
+        float *out = &audio.samples[size_t(c) * audio.frameCount];
+        for (int i = 0; i < audio.frameCount; i++)
+        {
+            int32_t value = interleaved[size_t(i) * audio.channelCount + c];
+            if (mode & MODE_FLOAT) memcpy(&out[i], &value, sizeof(float));
+            else out[i] = scale * value;
+        }
+    }
+    return true;
+}
+
+static bool readWavFile(const std::string &path, AudioFileData &audio, std::string &error)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        error = "cannot open file";
+        return false;
+    }
+    std::vector<unsigned char> bytes;
+    unsigned char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) bytes.insert(bytes.end(), buffer, buffer + n);
+    fclose(file);
+
+    if (bytes.size() < 12 || memcmp(&bytes[0], "RIFF", 4) != 0 || memcmp(&bytes[8], "WAVE", 4) != 0)
+    {
+        error = "not a RIFF WAVE file";
+        return false;
+    }
+
+    int format = 0, channels = 0, bits = 0;
+    const unsigned char *data = nullptr;
+    size_t dataSize = 0;
+    for (size_t pos = 12; pos + 8 <= bytes.size();)
+    {
+        uint32_t chunkSize = readLE(&bytes[pos + 4], 4);
+        const unsigned char *chunk = &bytes[pos + 8];
+        size_t available = std::min<size_t>(chunkSize, bytes.size() - pos - 8);
+        if (memcmp(&bytes[pos], "fmt ", 4) == 0 && available >= 16)
+        {
+            format = (int)readLE(chunk, 2);
+            channels = (int)readLE(chunk + 2, 2);
+            audio.sampleRate = (float)readLE(chunk + 4, 4);
+            bits = (int)readLE(chunk + 14, 2);
+            // WAVE_FORMAT_EXTENSIBLE: the real format tag starts the subformat GUID
+            if (format == 0xfffe && available >= 26) format = (int)readLE(chunk + 24, 2);
+        }
+        else if (memcmp(&bytes[pos], "data", 4) == 0)
+        {
+            data = chunk;
+            dataSize = available;
+        }
+        pos += 8 + size_t(chunkSize) + (chunkSize & 1);
+    }
+
+    bool isFloat = format == 3 && bits == 32;
+    bool isPCM = format == 1 && (bits == 8 || bits == 16 || bits == 24 || bits == 32);
+    if (!data || channels < 1 || !(isFloat || isPCM))
+    {
+        error = "unsupported WAV format";
+        return false;
+    }
+
+    int bytesPerSample = bits / 8;
+    int frameBytes = bytesPerSample * channels;
+    audio.channelCount = std::min(channels, 2);
+    audio.frameCount = int(dataSize / frameBytes);
+    audio.samples.resize(size_t(audio.channelCount) * audio.frameCount);
+    float scale = 1.0f / float(1u << (bits - 1));
+    for (int c = 0; c < audio.channelCount; c++)
+    {
+        float *out = &audio.samples[size_t(c) * audio.frameCount];
+        const unsigned char *in = data + c * bytesPerSample;
+        for (int i = 0; i < audio.frameCount; i++, in += frameBytes)
+        {
+            uint32_t raw = readLE(in, bytesPerSample);
+            if (isFloat) memcpy(&out[i], &raw, sizeof(float));
+            else if (bits == 8) out[i] = scale * (int(raw) - 128);
+            else out[i] = scale * int32_t(raw << (32 - bits)) / float(1u << (32 - bits));
+        }
+    }
+    return true;
+}
+
+bool readAudioFile(const std::string &path, AudioFileData &audio, std::string &error)
+{
+    audio = AudioFileData();
+    bool ok = hasSuffix(path, ".wv") ? readWavPackFile(path, audio, error) : readWavFile(path, audio, error);
+    if (ok && audio.frameCount == 0)
+    {
+        error = "no audio data";
+        return false;
+    }
+    return ok;
+}
+
+bool writeWavFile(const std::string &path, float sampleRate, const float *left, const float *right, size_t frameCount)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    uint32_t dataSize = uint32_t(frameCount * 2 * sizeof(float));
+    fwrite("RIFF", 1, 4, file);
+    writeLE(file, 36 + dataSize, 4);
+    fwrite("WAVEfmt ", 1, 8, file);
+    writeLE(file, 16, 4);
+    writeLE(file, 3, 2);                            // IEEE float
+    writeLE(file, 2, 2);
+    writeLE(file, uint32_t(sampleRate), 4);
+    writeLE(file, uint32_t(sampleRate) * 8, 4);     // bytes per second
+    writeLE(file, 8, 2);                            // bytes per frame
+    writeLE(file, 32, 2);
+    fwrite("data", 1, 4, file);
+    writeLE(file, dataSize, 4);
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        uint32_t l, r;
+        memcpy(&l, &left[i], sizeof(float));
+        memcpy(&r, &right[i], sizeof(float));
+        writeLE(file, l, 4);
+        writeLE(file, r, 4);
+    }
+    return fclose(file) == 0;
+}
+
+static int writeWavPackBlock(void *id, void *data, int32_t byteCount)
+{
+    return fwrite(data, 1, byteCount, (FILE *)id) == size_t(byteCount);
+}
+
+bool writeWavPackFile(const std::string &path, float sampleRate, const float *left, const float *right, size_t frameCount,
+                      int bitsPerSample)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    WavpackContext *wpc = WavpackOpenFileOutput(writeWavPackBlock, file, 0);
+    WavpackConfig config = {};
+    config.bits_per_sample = bitsPerSample;
+    config.bytes_per_sample = (bitsPerSample + 7) / 8;
+    config.num_channels = 2;
+    config.channel_mask = 3;
+    config.sample_rate = int32_t(sampleRate);
+
+    float fullScale = float((1 << (bitsPerSample - 1)) - 1);
+    std::vector<int32_t> interleaved(2 * frameCount);
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        interleaved[2 * i] = int32_t(lrintf(std::max(-1.0f, std::min(left[i], 1.0f)) * fullScale));
+        interleaved[2 * i + 1] = int32_t(lrintf(std::max(-1.0f, std::min(right[i], 1.0f)) * fullScale));
+    }
+
+    bool ok = WavpackSetConfiguration64(wpc, &config, int64_t(frameCount), 0) && WavpackPackInit(wpc) &&
+              WavpackPackSamples(wpc, interleaved.data(), uint32_t(frameCount)) && WavpackFlushSamples(wpc);
+    WavpackCloseFile(wpc);
+    return (fclose(file) == 0) && ok;
+}
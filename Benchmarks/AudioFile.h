@@ -0,0 +1,29 @@
+// Copyright AudioKit. All Rights Reserved.
+
+// Minimal WAV and WavPack file I/O for the offline harnesses.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct AudioFileData
+{
+    float sampleRate = 0.0f;
+    int channelCount = 0;
+    int frameCount = 0;
+
+    // planar: channel c starts at samples[c * frameCount]
+    std::vector<float> samples;
+};
+
+// Reads a .wv file with WavPack, anything else as a RIFF WAV file (PCM 8/16/24/32-bit or 32-bit
+// float). Keeps at most two channels. Returns false and sets error on failure.
+bool readAudioFile(const std::string &path, AudioFileData &audio, std::string &error);
+
+// Writes a 32-bit float stereo WAV file.
+bool writeWavFile(const std::string &path, float sampleRate, const float *left, const float *right, size_t frameCount);
+
+// Writes a 16- or 24-bit stereo WavPack file.
+bool writeWavPackFile(const std::string &path, float sampleRate, const float *left, const float *right, size_t frameCount,
+                      int bitsPerSample = 16);
@@ -0,0 +1,121 @@
+// Copyright AudioKit. All Rights Reserved.
+
+// Compares the FFT backends compiled into RubberBand at the sizes the time-stretcher uses,
+// timing the double-precision polar round trip it runs per channel per hop, and plain float
+// forward/inverse transforms.
+//
+//   FFTBenchmark [--check]
+//
+// --check only verifies that every backend agrees with the built-in one (exit status 1 if
+// not), for use as a quick test.
+
+#include "../Sources/CDunneAudioKit/DunneCore/RubberBand/dsp/FFT.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace RubberBand;
+
+static const int sizes[] = { 256, 512, 1024, 2048, 4096, 8192 };
+
+static void fill(std::vector<double> &v, unsigned seed)
+{
+    for (auto &x : v)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        x = double(seed >> 8) / double(1 << 24) - 0.5;
+    }
+}
+
+// largest difference from the built-in FFT's forward transform, relative to its peak magnitude
+static double forwardError(const std::string &impl, int size)
+{
+    std::vector<double> input(size), re[2], im[2];
+    fill(input, unsigned(size));
+    const std::string names[2] = { "cross", impl };
+    for (int i = 0; i < 2; i++)
+    {
+        re[i].resize(size / 2 + 1);
+        im[i].resize(size / 2 + 1);
+        FFT::setDefaultImplementation(names[i]);
+        FFT fft(size);
+        fft.forward(input.data(), re[i].data(), im[i].data());
+    }
+
+    double peak = 0.0, error = 0.0;
+    for (int k = 0; k <= size / 2; k++)
+    {
+        peak = std::max(peak, std::hypot(re[0][k], im[0][k]));
+        error = std::max(error, std::hypot(re[1][k] - re[0][k], im[1][k] - im[0][k]));
+    }
+    return error / peak;
+}
+
+template <typename Op>
+static double microsecondsPerCall(int size, Op op)
+{
+    // at least a few milliseconds per measurement, whatever the size
+    const long calls = std::max(64L, (1L << 23) / size);
+    op();
+    auto start = std::chrono::steady_clock::now();
+    for (long c = 0; c < calls; c++) op();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return 1.0e6 * elapsed / double(calls);
+}
+
+int main(int argc, char **argv)
+{
+    bool checkOnly = argc > 1 && strcmp(argv[1], "--check") == 0;
+    auto impls = FFT::getImplementations();
+
+    bool ok = true;
+    for (auto &impl : impls)
+    {
+        for (int size : sizes)
+        {
+            // single-precision backends are expected to differ by float rounding
+            double error = forwardError(impl, size);
+            if (!(error < 1.0e-5))
+            {
+                fprintf(stderr, "FFT %s differs from built-in at size %d (relative error %g)\n", impl.c_str(), size, error);
+                ok = false;
+            }
+        }
+    }
+    if (!ok) return 1;
+    printf("FFT backends agree:");
+    for (auto &impl : impls) printf(" %s", impl.c_str());
+    printf("\n");
+    if (checkOnly) return 0;
+
+    printf("%10s %6s %16s %16s   (microseconds per transform pair)\n", "backend", "size", "polar (double)", "fwd+inv (float)");
+    for (auto &impl : impls)
+    {
+        FFT::setDefaultImplementation(impl);
+        for (int size : sizes)
+        {
+            FFT fft(size);
+            fft.initDouble();
+            fft.initFloat();
+
+            std::vector<double> input(size), output(size), mag(size / 2 + 1), phase(size / 2 + 1);
+            fill(input, 1);
+            std::vector<float> finput(input.begin(), input.end()), foutput(size), fre(size / 2 + 1), fim(size / 2 + 1);
+
+            double polar = microsecondsPerCall(size, [&] {
+                fft.forwardPolar(input.data(), mag.data(), phase.data());
+                fft.inversePolar(mag.data(), phase.data(), output.data());
+            });
+            double plain = microsecondsPerCall(size, [&] {
+                fft.forward(finput.data(), fre.data(), fim.data());
+                fft.inverse(fre.data(), fim.data(), foutput.data());
+            });
+            printf("%10s %6d %16.2f %16.2f\n", impl.c_str(), size, polar, plain);
+        }
+    }
+    return 0;
+}
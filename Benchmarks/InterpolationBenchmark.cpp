@@ -0,0 +1,359 @@
+// Copyright AudioKit. All Rights Reserved.
+
+// Compares the sampler's interpolation kernels: for each, the error resampling test tones of
+// increasing frequency (as signal-to-error ratio against the exact tone, at the worse of a pitch
+// 4 semitones down and 4 up), and the time it takes per stereo frame, resampling a block at a time
+// as voices do. Then renders a note through CoreSampler with each kernel.
+//
+//   InterpolationBenchmark [--check] [frames]
+//
+// --check times fewer frames and also checks (exit status 1 on failure) that every kernel passes
+// input through unchanged at whole-frame positions, that the vectorized and scalar cubic code
+// agree, that each kernel's worst error is less than the one before's, and that a note played at the sample's
+// pitch renders the same with any kernel as without one, while a note an octave up plays twice as fast.
+//
+// Last, plays notes two octaves and more above a sample's pitch with and without octave pyramids
+// (see CoreSampler::setSamplePyramids()), timing both; --check also checks that the pyramids take
+// out the aliases of a tone too high to play that far up, leave a low one playing as it should,
+// and take no more memory than the sample itself.
+
+#include "CoreSampler.h"
+#include "SampleInterpolator.h"
+#include "VectorOps.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const SampleInterpolation kernels[] = {
+    SampleInterpolationNone, SampleInterpolationLinear, SampleInterpolationCubic,
+    SampleInterpolationSinc4, SampleInterpolationSinc8
+};
+static const int kernelCount = sizeof(kernels) / sizeof(kernels[0]);
+
+// test tones, in cycles per frame
+static const double tones[] = { 0.01, 0.05, 0.15, 0.3 };
+static const int toneCount = sizeof(tones) / sizeof(tones[0]);
+
+static const int guard = SAMPLEINTERPOLATION_MAX_TAPS;
+
+// stereo input with guard frames either side, so kernels can read it anywhere in [0, frameCount)
+struct Input
+{
+    std::vector<float> left, right;
+    const float *channels[2];
+
+    Input(size_t frameCount, double cyclesPerFrame)
+    : left(frameCount + 2 * guard), right(frameCount + 2 * guard)
+    {
+        for (size_t i = 0; i < left.size(); i++)
+        {
+            double phase = 2.0 * M_PI * cyclesPerFrame * (double(i) - guard);
+            left[i] = float(0.5 * sin(phase));
+            right[i] = float(0.5 * cos(phase));
+        }
+        channels[0] = left.data() + guard;
+        channels[1] = right.data() + guard;
+    }
+};
+
+// resample count frames from position at rate, a voice's block at a time
+static void resample(SampleInterpolation kernel, const Input &input, double position, double rate, float *left, float *right, size_t count)
+{
+    for (size_t done = 0; done < count; done += SAMPLEBUFFER_RESAMPLE_BLOCKSIZE)
+    {
+        size_t n = std::min<size_t>(count - done, SAMPLEBUFFER_RESAMPLE_BLOCKSIZE);
+        float *output[2] = { left + done, right + done };
+        DunneCore::interpolateSamples(kernel, input.channels, position + done * rate, rate, output, n);
+    }
+}
+
+// signal-to-error ratio in dB of resampling the tone at rate
+static double accuracy(SampleInterpolation kernel, double cyclesPerFrame, double rate)
+{
+    const size_t frameCount = 8192;
+    Input input(frameCount, cyclesPerFrame);
+    size_t count = size_t((frameCount - guard) / rate);
+    std::vector<float> left(count), right(count);
+    resample(kernel, input, 0.0, rate, left.data(), right.data(), count);
+
+    double signal = 0.0, error = 0.0;
+    for (size_t k = 0; k < count; k++)
+    {
+        double phase = 2.0 * M_PI * cyclesPerFrame * (k * rate);
+        double exactLeft = 0.5 * sin(phase), exactRight = 0.5 * cos(phase);
+        signal += exactLeft * exactLeft + exactRight * exactRight;
+        error += (left[k] - exactLeft) * (left[k] - exactLeft) + (right[k] - exactRight) * (right[k] - exactRight);
+    }
+    return 10.0 * log10(signal / std::max(error, 1e-30));
+}
+
+// nanoseconds per stereo frame
+static double timing(SampleInterpolation kernel, size_t frameCount)
+{
+    const double rate = 1.2599;
+    Input input(size_t(frameCount * rate) + 1, 0.05);
+    std::vector<float> left(frameCount), right(frameCount);
+    resample(kernel, input, 0.0, rate, left.data(), right.data(), frameCount);     // warm up
+
+    const int rounds = 5;
+    auto start = std::chrono::steady_clock::now();
+    double checksum = 0.0;
+    for (int round = 0; round < rounds; round++)
+    {
+        resample(kernel, input, 0.0, rate, left.data(), right.data(), frameCount);
+        checksum += left[round] + right[frameCount - 1 - round];
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (checksum != checksum) fprintf(stderr, "%s: output is not a number\n", DunneCore::sampleInterpolationName(kernel));
+    return seconds * 1e9 / (rounds * frameCount);
+}
+
+static bool checkPassThrough()
+{
+    Input input(1024, 0.137);
+    float left[64], right[64];
+    float *output[2] = { left, right };
+    for (SampleInterpolation kernel : kernels)
+    {
+        DunneCore::interpolateSamples(kernel, input.channels, 100.0, 1.0, output, 64);
+        for (int k = 0; k < 64; k++)
+            if (left[k] != input.channels[0][100 + k] || right[k] != input.channels[1][100 + k])
+            {
+                fprintf(stderr, "%s: frame %d changed at a whole-frame position\n", DunneCore::sampleInterpolationName(kernel), k);
+                return false;
+            }
+    }
+    return true;
+}
+
+// the cubic kernel does whole groups of four frames in vectors and the rest one at a time
+static bool checkCubicVectors()
+{
+    Input input(1024, 0.21);
+    float left[37], right[37], oneLeft, oneRight;
+    float *output[2] = { left, right }, *one[2] = { &oneLeft, &oneRight };
+    const double position = 3.3, rate = 1.77;
+    DunneCore::interpolateSamples(SampleInterpolationCubic, input.channels, position, rate, output, 37);
+    for (int k = 0; k < 37; k++)
+    {
+        DunneCore::interpolateSamples(SampleInterpolationCubic, input.channels, position + k * rate, rate, one, 1);
+        if (oneLeft != left[k] || oneRight != right[k])
+        {
+            fprintf(stderr, "cubic: frame %d differs between the vector and scalar code\n", k);
+            return false;
+        }
+    }
+    return true;
+}
+
+struct SamplerRender
+{
+    std::vector<float> output;      // left then right for every chunk
+    double elapsed;                 // seconds it took
+    SampleMemoryStatistics stats;
+};
+
+// a stereo loop, at the pitch of note 60, played as each of the notes for one second
+static SamplerRender renderNotes(SampleInterpolation kernel, const std::vector<unsigned> &notes,
+                                 const std::vector<float> &samples, bool pyramids = false)
+{
+    const float sampleRate = 48000.0f;
+    CoreSampler sampler;
+    sampler.init(sampleRate);
+    sampler.setSampleInterpolation(kernel);
+    sampler.setSamplePyramids(pyramids);
+    for (unsigned note : notes) sampler.setNoteFrequency(note, 261.6f * powf(2.0f, (int(note) - 60) / 12.0f));
+
+    const int frameCount = int(samples.size() / 2);
+    SampleDataDescriptor sdd = {};
+    sdd.sampleDescriptor = { 60, 261.6f, 0, 127, 0, 127, 0.0f, (float)frameCount };
+    sdd.sampleRate = sampleRate;
+    sdd.channelCount = 2;
+    sdd.sampleCount = frameCount;
+    sdd.data = const_cast<float *>(samples.data());
+    sampler.loadSampleData(sdd);
+    sampler.buildKeyMap();
+
+    unsigned track = 0;
+    LoopDescriptor loop = {};
+    loop.isLooping = true;
+    loop.endPoint = frameCount;
+    loop.enabledTracksCount = 1;
+    loop.enabledTracks = &track;
+    for (unsigned note : notes) sampler.prepareNote(note, 100, loop);
+    sampler.play(0);
+
+    SamplerRender render;
+    render.output.reserve(2 * size_t(sampleRate));
+    float left[CORESAMPLER_CHUNKSIZE], right[CORESAMPLER_CHUNKSIZE];
+    float *outBuffers[2] = { left, right };
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t now = 0; now < int64_t(sampleRate); now += CORESAMPLER_CHUNKSIZE)
+    {
+        memset(left, 0, sizeof(left));
+        memset(right, 0, sizeof(right));
+        sampler.render(2, CORESAMPLER_CHUNKSIZE, outBuffers, now);
+        render.output.insert(render.output.end(), left, left + CORESAMPLER_CHUNKSIZE);
+        render.output.insert(render.output.end(), right, right + CORESAMPLER_CHUNKSIZE);
+    }
+    render.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    render.stats = sampler.getMemoryStatistics();
+    return render;
+}
+
+// frames of one channel the tests measure: a stretch every note plays before its loop comes round
+static std::vector<float> measured(const std::vector<float> &output, int channel)
+{
+    std::vector<float> frames;
+    for (size_t chunk = 8000 / CORESAMPLER_CHUNKSIZE; chunk < 20000 / CORESAMPLER_CHUNKSIZE; chunk++)
+    {
+        const float *first = &output[(2 * chunk + channel) * CORESAMPLER_CHUNKSIZE];
+        frames.insert(frames.end(), first, first + CORESAMPLER_CHUNKSIZE);
+    }
+    return frames;
+}
+
+static int zeroCrossings(const std::vector<float> &output, int channel = 0)
+{
+    std::vector<float> frames = measured(output, channel);
+    int crossings = 0;
+    for (size_t i = 1; i < frames.size(); i++)
+        crossings += (frames[i - 1] < 0.0f) != (frames[i] < 0.0f);
+    return crossings;
+}
+
+static double rms(const std::vector<float> &output, int channel)
+{
+    std::vector<float> frames = measured(output, channel);
+    double sum = 0.0;
+    for (float frame : frames) sum += double(frame) * frame;
+    return sqrt(sum / frames.size());
+}
+
+static bool checkSampler()
+{
+    const int frameCount = 48000;
+    std::vector<float> samples(2 * frameCount);
+    for (int i = 0; i < frameCount; i++)
+    {
+        samples[i] = 0.5f * sinf(i * 0.05f);
+        samples[frameCount + i] = 0.5f * sinf(i * 0.031f);
+    }
+
+    std::vector<float> plain = renderNotes(SampleInterpolationNone, { 60 }, samples).output;
+    int plainCrossings = zeroCrossings(plain);
+    bool ok = plainCrossings > 0;
+    if (!ok) fprintf(stderr, "no sound from the sampler\n");
+    for (SampleInterpolation kernel : kernels)
+    {
+        if (kernel == SampleInterpolationNone) continue;
+        const char *name = DunneCore::sampleInterpolationName(kernel);
+        std::vector<float> root = renderNotes(kernel, { 60 }, samples).output;
+        if (root != plain)
+        {
+            fprintf(stderr, "%s: a note at the sample's pitch renders differently from no interpolation\n", name);
+            ok = false;
+        }
+        std::vector<float> octave = renderNotes(kernel, { 72 }, samples).output;
+        double ratio = double(zeroCrossings(octave)) / plainCrossings;
+        if (fabs(ratio - 2.0) > 0.1)
+        {
+            fprintf(stderr, "%s: a note an octave up crosses zero %.2f times as often, not twice\n", name, ratio);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static bool comparePyramids(bool check)
+{
+    const int frameCount = 4 * 48000;
+    std::vector<float> samples(2 * frameCount);
+    for (int i = 0; i < frameCount; i++)
+    {
+        samples[i] = 0.5f * sinf(float(2.0 * M_PI * 0.35 * (i % 20)));  // above Nyquist two octaves up
+        samples[frameCount + i] = 0.5f * sinf(i * 0.02f);
+    }
+
+    std::vector<unsigned> notes;
+    for (unsigned note = 84; note < 92; note++) notes.push_back(note);
+    SamplerRender direct = renderNotes(SampleInterpolationSinc8, notes, samples);
+    SamplerRender mipmapped = renderNotes(SampleInterpolationSinc8, notes, samples, true);
+    printf("%d sinc8 voices two octaves and more up: %.2f ms per second without pyramids, %.2f with (%llu bytes)\n",
+           int(notes.size()), 1000.0 * direct.elapsed, 1000.0 * mipmapped.elapsed, mipmapped.stats.pyramidBytes);
+    if (!check) return true;
+
+    bool ok = true;
+    if (mipmapped.stats.pyramidBytes == 0 || mipmapped.stats.pyramidBytes > mipmapped.stats.externalBytes)
+    {
+        fprintf(stderr, "pyramids take %llu bytes for a %llu-byte sample\n", mipmapped.stats.pyramidBytes,
+                mipmapped.stats.externalBytes);
+        ok = false;
+    }
+
+    direct = renderNotes(SampleInterpolationSinc8, { 84 }, samples);
+    mipmapped = renderNotes(SampleInterpolationSinc8, { 84 }, samples, true);
+    double aliasing = 20.0 * log10(rms(direct.output, 0) / std::max(rms(mipmapped.output, 0), 1e-9));
+    if (aliasing < 40.0)
+    {
+        fprintf(stderr, "pyramids take only %.1f dB off aliases of a tone above Nyquist\n", aliasing);
+        ok = false;
+    }
+    double ratio = double(zeroCrossings(mipmapped.output, 1)) / zeroCrossings(direct.output, 1);
+    if (fabs(ratio - 1.0) > 0.02)
+    {
+        fprintf(stderr, "a low tone crosses zero %.2f times as often from a pyramid\n", ratio);
+        ok = false;
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bool check = argc > 1 && strcmp(argv[1], "--check") == 0;
+    long frameCount = argc > 1 + check ? atol(argv[1 + check]) : check ? 1 << 16 : 1 << 22;
+    if (argc > 2 + check || frameCount < SAMPLEBUFFER_RESAMPLE_BLOCKSIZE)
+    {
+        fprintf(stderr, "usage: InterpolationBenchmark [--check] [frames]\n");
+        return 1;
+    }
+
+    printf("kernel  taps");
+    for (double tone : tones) printf("  %5.2f c/f", tone);
+    printf("   ns/frame (%s)\n", DunneCore::vectorOpsBackend());
+
+    double snr[kernelCount][toneCount];
+    for (int n = 0; n < kernelCount; n++)
+    {
+        SampleInterpolation kernel = kernels[n];
+        printf("%-6s  %4d", DunneCore::sampleInterpolationName(kernel), DunneCore::sampleInterpolationTaps(kernel));
+        for (int t = 0; t < toneCount; t++)
+        {
+            snr[n][t] = std::min(accuracy(kernel, tones[t], 0.7937), accuracy(kernel, tones[t], 1.2599));
+            printf("  %7.1f dB", snr[n][t]);
+        }
+        printf("   %8.2f\n", timing(kernel, size_t(frameCount)));
+    }
+
+    bool ok = comparePyramids(check);
+    if (!check) return 0;
+
+    ok = ok && checkPassThrough() && checkCubicVectors();
+    // each kernel's worst error, over all the tones, less than the one before it: the sinc kernels
+    // give up some of cubic's accuracy on low tones for much less error on high ones
+    for (int n = 1; n < kernelCount && ok; n++)
+        if (*std::min_element(snr[n], snr[n] + toneCount) <= *std::min_element(snr[n - 1], snr[n - 1] + toneCount))
+        {
+            fprintf(stderr, "%s's worst error is no less than %s's\n", DunneCore::sampleInterpolationName(kernels[n]),
+                    DunneCore::sampleInterpolationName(kernels[n - 1]));
+            ok = false;
+        }
+    ok = ok && checkSampler();
+    printf("%s\n", ok ? "kernels and sampler playback as expected" : "FAILED");
+    return ok ? 0 : 1;
+}
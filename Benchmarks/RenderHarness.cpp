@@ -0,0 +1,462 @@
+// Copyright AudioKit. All Rights Reserved.
+
+// Plays a scripted list of note events through CoreSampler (or CoreSynth) offline, as fast as
+// possible, and reports the realtime factor, the worst-case time per host block against its
+// deadline, and peak memory. The rendered audio stays in memory, or is written with --out.
+//
+//   RenderHarness [options] [script]
+//
+//   --engine sampler|synth   core to drive (synth needs a build with KissFFT)
+//   --rate <Hz>              render sample rate, default 48000
+//   --block <frames>         host block size used for the timing statistics, default 512
+//   --duration <seconds>     length to render, default one second past the last event
+//   --sample <path> <root>   map a WAV/WavPack file across the keyboard, replacing the script's samples
+//   --sfz <path>             load an SFZ instrument instead; its regions' loops override the script's
+//   --out <file.wav>         write the rendered audio as 32-bit float stereo
+//
+// Without a script a short built-in arpeggio over a generated tone is played. Script lines:
+//
+//   sample <path> <root> [<minNote> <maxNote> [<minVelocity> <maxVelocity>]]
+//   tone <root> <seconds> [<minNote> <maxNote>]      generated stereo test tone
+//   loop off|on|reversed                             applies to the note-ons that follow
+//   <time> on <note> <velocity>
+//   <time> off <note>
+//   <time> pedal down|up
+//
+// Times are in seconds; '#' starts a comment. Events are applied at the start of the
+// CORESAMPLER_CHUNKSIZE chunk containing them, as SamplerDSP does.
+
+#include "AudioFile.h"
+#include "CoreSampler.h"
+#ifdef DUNNECORE_HAVE_KISSFFT
+#include "../Sources/CDunneAudioKit/DunneCore/Synth/CoreSynth.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+static const char *demoScript =
+    "tone 60 2\n"
+    "loop on\n"
+    "0.00 on 48 100\n"
+    "0.25 on 55 90\n"
+    "0.50 on 60 80\n"
+    "0.75 on 64 70\n"
+    "1.00 pedal down\n"
+    "1.00 off 48\n"
+    "1.00 off 55\n"
+    "1.25 on 67 100\n"
+    "1.50 off 60\n"
+    "1.50 off 64\n"
+    "1.75 off 67\n"
+    "2.00 pedal up\n";
+
+struct SampleMapping
+{
+    std::string path;       // empty for a generated tone
+    int rootNote;
+    float toneSeconds;
+    int minNote, maxNote, minVelocity, maxVelocity;
+};
+
+struct NoteEvent
+{
+    enum Type { noteOn, noteOff, pedalDown, pedalUp } type;
+    double time;
+    int note, velocity;
+    bool looping, reversed;
+};
+
+struct Script
+{
+    std::vector<SampleMapping> samples;
+    std::vector<NoteEvent> events;
+};
+
+static float noteFrequency(int note)
+{
+    return 440.0f * powf(2.0f, (note - 69) / 12.0f);
+}
+
+static bool parseScript(std::istream &in, Script &script, std::string &error)
+{
+    bool looping = false, reversed = false;
+    std::string line;
+    for (int lineNumber = 1; std::getline(in, line); lineNumber++)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string first;
+        if (!(words >> first)) continue;
+
+        bool ok = true;
+        if (first == "sample" || first == "tone")
+        {
+            SampleMapping s = { "", 60, 0.0f, 0, 127, 0, 127 };
+            if (first == "sample") ok = bool(words >> s.path >> s.rootNote);
+            else ok = bool(words >> s.rootNote >> s.toneSeconds) && s.toneSeconds > 0.0f;
+            if (ok && words >> s.minNote) ok = bool(words >> s.maxNote);
+            if (ok && first == "sample" && words >> s.minVelocity) ok = bool(words >> s.maxVelocity);
+            script.samples.push_back(s);
+        }
+        else if (first == "loop")
+        {
+            std::string mode;
+            ok = bool(words >> mode) && (mode == "off" || mode == "on" || mode == "reversed");
+            looping = mode != "off";
+            reversed = mode == "reversed";
+        }
+        else
+        {
+            NoteEvent e = { NoteEvent::noteOn, atof(first.c_str()), 0, 0, looping, reversed };
+            std::string type, pedal;
+            ok = bool(words >> type) && e.time >= 0.0;
+            if (ok && type == "on") ok = bool(words >> e.note >> e.velocity);
+            else if (ok && type == "off") { e.type = NoteEvent::noteOff; ok = bool(words >> e.note); }
+            else if (ok && type == "pedal")
+            {
+                ok = bool(words >> pedal) && (pedal == "down" || pedal == "up");
+                e.type = pedal == "down" ? NoteEvent::pedalDown : NoteEvent::pedalUp;
+            }
+            else ok = false;
+            ok = ok && e.note >= 0 && e.note < 128 && e.velocity >= 0 && e.velocity < 128;
+            if (ok) script.events.push_back(e);
+        }
+        if (!ok)
+        {
+            error = "line " + std::to_string(lineNumber) + ": cannot parse '" + line + "'";
+            return false;
+        }
+    }
+    std::stable_sort(script.events.begin(), script.events.end(),
+                     [](const NoteEvent &a, const NoteEvent &b) { return a.time < b.time; });
+    return true;
+}
+
+// the interface the harness drives; one implementation per core
+struct Engine
+{
+    virtual ~Engine() {}
+    // false if the event has to wait for the next chunk
+    virtual bool apply(const NoteEvent &e, int64_t now) = 0;
+    virtual void render(float *outBuffers[], unsigned frameCount, int64_t now) = 0;
+};
+
+struct SamplerEngine : Engine
+{
+    CoreSampler sampler;
+    std::vector<unsigned> tracks;   // every sample mapped to a note is a track; play them all
+    bool startedNote = false;
+    bool useSampleLoops = false;    // loops from an SFZ file, where its regions have them
+
+    bool apply(const NoteEvent &e, int64_t now) override
+    {
+        switch (e.type)
+        {
+            case NoteEvent::noteOn:
+            {
+                // a voice is only marked busy once rendered, so start one note per chunk
+                if (startedNote) return false;
+                LoopDescriptor loop = {};
+                loop.isLooping = e.looping;
+                loop.reversed = e.reversed;
+                loop.enabledTracksCount = unsigned(tracks.size());
+                loop.enabledTracks = tracks.data();
+                if (useSampleLoops) sampler.getSampleLoop(e.note, e.velocity, loop);
+                sampler.prepareNote(e.note, e.velocity, loop);
+                sampler.play(now);
+                startedNote = true;
+                break;
+            }
+            case NoteEvent::noteOff: sampler.stopNote(e.note, false); break;
+            case NoteEvent::pedalDown: sampler.sustainPedal(true); break;
+            case NoteEvent::pedalUp: sampler.sustainPedal(false); break;
+        }
+        return true;
+    }
+
+    void render(float *outBuffers[], unsigned frameCount, int64_t now) override
+    {
+        sampler.render(2, frameCount, outBuffers, now);
+        startedNote = false;
+    }
+};
+
+#ifdef DUNNECORE_HAVE_KISSFFT
+struct SynthEngine : Engine
+{
+    CoreSynth synth;
+
+    bool apply(const NoteEvent &e, int64_t) override
+    {
+        switch (e.type)
+        {
+            case NoteEvent::noteOn: synth.playNote(e.note, e.velocity, noteFrequency(e.note)); break;
+            case NoteEvent::noteOff: synth.stopNote(e.note, false); break;
+            case NoteEvent::pedalDown: synth.sustainPedal(true); break;
+            case NoteEvent::pedalUp: synth.sustainPedal(false); break;
+        }
+        return true;
+    }
+
+    void render(float *outBuffers[], unsigned frameCount, int64_t) override
+    {
+        synth.render(2, frameCount, outBuffers);
+    }
+};
+#endif
+
+// loads the script's samples into the sampler; the returned data must outlive it
+static bool loadSamples(CoreSampler &sampler, const Script &script, float sampleRate,
+                        std::vector<AudioFileData> &audio)
+{
+    audio.resize(script.samples.size());
+    for (size_t i = 0; i < script.samples.size(); i++)
+    {
+        const SampleMapping &s = script.samples[i];
+        AudioFileData &a = audio[i];
+        if (s.path.empty())
+        {
+            a.sampleRate = sampleRate;
+            a.channelCount = 2;
+            a.frameCount = int(s.toneSeconds * sampleRate);
+            a.samples.resize(2 * size_t(a.frameCount));
+            float w = 2.0f * float(M_PI) * noteFrequency(s.rootNote) / sampleRate;
+            for (int f = 0; f < a.frameCount; f++)
+            {
+                a.samples[f] = 0.5f * sinf(f * w);
+                a.samples[a.frameCount + f] = 0.5f * sinf(f * w * 1.001f);
+            }
+        }
+        else
+        {
+            std::string error;
+            if (!readAudioFile(s.path, a, error))
+            {
+                fprintf(stderr, "%s: %s\n", s.path.c_str(), error.c_str());
+                return false;
+            }
+        }
+
+        SampleDataDescriptor sdd = {};
+        sdd.sampleDescriptor = { s.rootNote, noteFrequency(s.rootNote), s.minNote, s.maxNote,
+                                 s.minVelocity, s.maxVelocity, 0.0f, (float)a.frameCount };
+        sdd.sampleRate = a.sampleRate;
+        sdd.channelCount = a.channelCount;
+        sdd.sampleCount = a.frameCount;
+        sdd.isInterleaved = false;
+        sdd.data = a.samples.data();
+        sampler.loadSampleData(sdd);
+    }
+    sampler.buildKeyMap();
+    return true;
+}
+
+// where loadSFZSample() puts what it reads; the data must outlive the sampler
+struct SFZSamples
+{
+    CoreSampler *sampler;
+    std::vector<AudioFileData> *audio;
+};
+
+// loads an SFZ region's WAV sample, for CoreSampler::loadSFZ(); its WavPack samples it loads itself
+static void loadSFZSample(void *context, const SampleDescriptor *sampleDescriptor, const char *path)
+{
+    SFZSamples &samples = *(SFZSamples *)context;
+    AudioFileData a;
+    std::string error;
+    if (!readAudioFile(path, a, error))
+    {
+        fprintf(stderr, "%s: %s\n", path, error.c_str());
+        return;
+    }
+    samples.audio->push_back(std::move(a));     // moving keeps the earlier samples where they are
+    const AudioFileData &loaded = samples.audio->back();
+
+    SampleDataDescriptor sdd = {};
+    sdd.sampleDescriptor = *sampleDescriptor;
+    sdd.sampleRate = loaded.sampleRate;
+    sdd.channelCount = loaded.channelCount;
+    sdd.sampleCount = loaded.frameCount;
+    sdd.isInterleaved = false;
+    sdd.data = const_cast<float *>(loaded.samples.data());
+    samples.sampler->loadSampleData(sdd);
+}
+
+// peak resident set size in bytes, 0 if unknown
+static double peakMemory()
+{
+#ifdef _WIN32
+    return 0.0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+#ifdef __APPLE__
+    return double(usage.ru_maxrss);
+#else
+    return 1024.0 * double(usage.ru_maxrss);
+#endif
+#endif
+}
+
+static int usage()
+{
+    fprintf(stderr, "usage: RenderHarness [--engine sampler|synth] [--rate Hz] [--block frames] [--duration seconds]\n"
+                    "                     [--sample path rootNote | --sfz path] [--out file.wav] [script]\n");
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    std::string engineName = "sampler", outPath, scriptPath, sfzPath;
+    float sampleRate = 48000.0f;
+    int blockSize = 512;
+    double duration = 0.0;
+    std::vector<SampleMapping> overrideSamples;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--engine" && hasValue) engineName = argv[++i];
+        else if (arg == "--rate" && hasValue) sampleRate = (float)atof(argv[++i]);
+        else if (arg == "--block" && hasValue) blockSize = atoi(argv[++i]);
+        else if (arg == "--duration" && hasValue) duration = atof(argv[++i]);
+        else if (arg == "--out" && hasValue) outPath = argv[++i];
+        else if (arg == "--sfz" && hasValue) sfzPath = argv[++i];
+        else if (arg == "--sample" && i + 2 < argc)
+        {
+            overrideSamples.push_back({ argv[i + 1], atoi(argv[i + 2]), 0.0f, 0, 127, 0, 127 });
+            i += 2;
+        }
+        else if (arg[0] != '-' && scriptPath.empty()) scriptPath = arg;
+        else return usage();
+    }
+    if (sampleRate < 8000.0f || blockSize < 1 || duration < 0.0) return usage();
+
+    Script script;
+    std::string error;
+    bool parsed;
+    if (scriptPath.empty())
+    {
+        std::istringstream in(demoScript);
+        parsed = parseScript(in, script, error);
+    }
+    else
+    {
+        std::ifstream in(scriptPath);
+        if (!in)
+        {
+            fprintf(stderr, "cannot open %s\n", scriptPath.c_str());
+            return 1;
+        }
+        parsed = parseScript(in, script, error);
+    }
+    if (!parsed)
+    {
+        fprintf(stderr, "%s: %s\n", scriptPath.empty() ? "demo script" : scriptPath.c_str(), error.c_str());
+        return 1;
+    }
+    if (!overrideSamples.empty()) script.samples = overrideSamples;
+
+    std::unique_ptr<Engine> engine;
+    std::vector<AudioFileData> sampleData;
+    if (engineName == "sampler")
+    {
+        auto sampler = new SamplerEngine;
+        engine.reset(sampler);
+        sampler->sampler.init(sampleRate);
+        if (!sfzPath.empty())
+        {
+            SFZSamples samples = { &sampler->sampler, &sampleData };
+            if (!sampler->sampler.loadSFZ(sfzPath.c_str(), 0, loadSFZSample, &samples)) return 1;
+            unsigned sampleCount = sampler->sampler.getMemoryStatistics().sampleCount;
+            for (unsigned t = 0; t < sampleCount; t++) sampler->tracks.push_back(t);
+            sampler->useSampleLoops = true;
+        }
+        else if (script.samples.empty())
+        {
+            fprintf(stderr, "the sampler needs at least one sample or tone\n");
+            return 1;
+        }
+        else
+        {
+            if (!loadSamples(sampler->sampler, script, sampleRate, sampleData)) return 1;
+            for (unsigned t = 0; t < script.samples.size(); t++) sampler->tracks.push_back(t);
+        }
+    }
+#ifdef DUNNECORE_HAVE_KISSFFT
+    else if (engineName == "synth")
+    {
+        auto synth = new SynthEngine;
+        engine.reset(synth);
+        synth->synth.init(sampleRate);
+    }
+#endif
+    else
+    {
+        fprintf(stderr, "engine '%s' is not available in this build\n", engineName.c_str());
+        return 1;
+    }
+
+    if (duration == 0.0) duration = (script.events.empty() ? 0.0 : script.events.back().time) + 1.0;
+    const size_t frameCount = size_t(duration * sampleRate);
+    std::vector<float> left(frameCount), right(frameCount);
+
+    size_t nextEvent = 0, blockCount = 0;
+    double worstBlock = 0.0, totalTime = 0.0;
+    for (size_t blockStart = 0; blockStart < frameCount; blockStart += blockSize, blockCount++)
+    {
+        size_t blockEnd = std::min(frameCount, blockStart + blockSize);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t chunk = blockStart; chunk < blockEnd; chunk += CORESAMPLER_CHUNKSIZE)
+        {
+            unsigned chunkSize = unsigned(std::min<size_t>(CORESAMPLER_CHUNKSIZE, blockEnd - chunk));
+            int64_t now = int64_t(chunk);
+            double chunkEnd = double(chunk + chunkSize) / sampleRate;
+            while (nextEvent < script.events.size() && script.events[nextEvent].time < chunkEnd &&
+                   engine->apply(script.events[nextEvent], now))
+                nextEvent++;
+
+            float *outBuffers[2] = { &left[chunk], &right[chunk] };
+            engine->render(outBuffers, chunkSize, now);
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        worstBlock = std::max(worstBlock, elapsed);
+        totalTime += elapsed;
+    }
+
+    double checksum = 0.0, peak = 0.0;
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        checksum += fabsf(left[i]) + fabsf(right[i]);
+        peak = std::max(peak, (double)std::max(fabsf(left[i]), fabsf(right[i])));
+    }
+
+    double deadline = blockSize / sampleRate;
+    printf("%s: %.2fs of audio at %.0f Hz in %.3fs, realtime factor %.1f\n", engineName.c_str(),
+           frameCount / sampleRate, sampleRate, totalTime, totalTime > 0.0 ? frameCount / sampleRate / totalTime : 0.0);
+    printf("%zu blocks of %d frames (deadline %.3f ms): worst %.3f ms (%.1f%% of deadline), mean %.3f ms\n",
+           blockCount, blockSize, 1000.0 * deadline, 1000.0 * worstBlock, 100.0 * worstBlock / deadline,
+           blockCount ? 1000.0 * totalTime / blockCount : 0.0);
+    printf("peak memory %.1f MB, output peak %.3f, checksum %.6g\n", peakMemory() / (1024.0 * 1024.0), peak, checksum);
+
+    if (!outPath.empty() && !writeWavFile(outPath, sampleRate, left.data(), right.data(), frameCount))
+    {
+        fprintf(stderr, "cannot write %s\n", outPath.c_str());
+        return 1;
+    }
+    return checksum > 0.0 ? 0 : 1;
+}
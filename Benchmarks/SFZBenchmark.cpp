@@ -0,0 +1,370 @@
+// Copyright AudioKit. All Rights Reserved.
+
+// Reads a small hand-written SFZ file covering the opcodes SFZFile supports (header inheritance,
+// note names, #define and #include, sample paths with spaces, loops, velocity layers, and regions
+// which must be skipped) and checks every region against what it should be. Then loads it into
+// CoreSampler, WavPack samples decoded as a batch and the rest through the callback, and checks the
+// loops the sampler reports. Then checks the key map's note and velocity lookup table against a
+// plain scan of each note's samples. Last, times parsing and loading a generated instrument of many
+// regions, and looking up its notes.
+//
+//   SFZBenchmark [--check] [regions]
+//
+// The files are written to the working directory and removed afterwards. --check uses a smaller
+// instrument (exit status 1 on any mismatch), for use as a quick test.
+
+#include "AudioFile.h"
+#include "CoreSampler.h"
+#include "SFZFile.h"
+#include "SampleBuffer.h"
+#include "SampleKeyMap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char *sfzText =
+    "// an instrument using every opcode the reader knows\n"
+    "/* a block comment, over\n"
+    "   two lines */\n"
+    "#define $ROOT 60\n"
+    "#define $LOUD 100\n"
+    "<control> default_path=SFZBenchmark-\n"
+    "<global> loop_mode=loop_continuous lovel=1\n"
+    "<group> lokey=c4 hikey=b4 pitch_keycenter=$ROOT   // note names\n"
+    "<region> sample=tone 1.wv loop_start=100 loop_end=4899 hivel=$LOUD\n"
+    "<region> sample=tone 1.wv lovel=101 hivel=127 loop_mode=no_loop tune=-50\n"
+    "<group> key=48 transpose=12\n"
+    "offset=10 end=999\n"
+    "<region> sample=tone 2.wav\n"
+    "<region> trigger=release sample=tone 2.wv\n"
+    "<master> loop_mode=one_shot\n"
+    "<group> lovel=0\n"
+    "<region> sample=other.wav key=f#5\n"
+    "<region> sample=tone 1.wv key=70 end=-1\n"
+    "<curve> sample=ignored.wv\n"
+    "#include \"SFZBenchmark-include.sfz\"\n";
+
+static const char *includeText =
+    "<region>sample=tone 2.wv key=72 loopstart=5 loopend=50 loopmode=loop_sustain\n";
+
+static float noteFrequency(float note)
+{
+    return 440.0f * powf(2.0f, (note - 69.0f) / 12.0f);
+}
+
+static bool writeText(const char *path, const char *text)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == 0) return false;
+    bool ok = fputs(text, file) >= 0;
+    return fclose(file) == 0 && ok;
+}
+
+static bool writeTone(const char *path, float frequency, size_t frameCount)
+{
+    std::vector<float> left(frameCount), right(frameCount);
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        left[i] = 0.5f * sinf(2.0f * float(M_PI) * frequency * i / 48000.0f);
+        right[i] = 0.5f * left[i];
+    }
+    return writeWavPackFile(path, 48000.0f, left.data(), right.data(), frameCount);
+}
+
+struct ExpectedRegion
+{
+    const char *sample;
+    int noteNumber;
+    float pitch;                // the note the sample sounds at pitch_keycenter
+    int minNote, maxNote, minVelocity, maxVelocity;
+    float startPoint, endPoint;
+    DunneCore::SFZLoopMode loopMode;
+    unsigned loopStart, loopEnd;
+};
+
+static const ExpectedRegion expected[] = {
+    { "SFZBenchmark-tone 1.wv", 60, 60.0f, 60, 71, 1, 100, 0.0f, 0.0f, DunneCore::SFZLoopContinuous, 100, 4900 },
+    { "SFZBenchmark-tone 1.wv", 60, 60.5f, 60, 71, 101, 127, 0.0f, 0.0f, DunneCore::SFZNoLoop, 0, 0 },
+    { "SFZBenchmark-tone 2.wav", 48, 36.0f, 48, 48, 1, 127, 10.0f, 1000.0f, DunneCore::SFZLoopContinuous, 0, 0 },
+    { "SFZBenchmark-other.wav", 78, 78.0f, 78, 78, 0, 127, 0.0f, 0.0f, DunneCore::SFZOneShot, 0, 0 },
+    { "SFZBenchmark-tone 2.wv", 72, 72.0f, 72, 72, 0, 127, 0.0f, 0.0f, DunneCore::SFZLoopSustain, 5, 51 },
+};
+
+static bool checkRegions(const DunneCore::SFZFile &sfz)
+{
+    size_t count = sizeof(expected) / sizeof(expected[0]);
+    if (sfz.regions.size() != count)
+    {
+        fprintf(stderr, "read %d regions, expected %d\n", int(sfz.regions.size()), int(count));
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        const DunneCore::SFZRegion &r = sfz.regions[i];
+        const SampleDescriptor &sd = r.sampleDescriptor;
+        const ExpectedRegion &e = expected[i];
+        bool match = r.sample == e.sample && sd.noteNumber == e.noteNumber &&
+                     fabsf(sd.noteFrequency / noteFrequency(e.pitch) - 1.0f) < 1e-5f &&
+                     sd.minimumNoteNumber == e.minNote && sd.maximumNoteNumber == e.maxNote &&
+                     sd.minimumVelocity == e.minVelocity && sd.maximumVelocity == e.maxVelocity &&
+                     sd.startPoint == e.startPoint && sd.endPoint == e.endPoint &&
+                     r.loopMode == e.loopMode && r.loopStart == e.loopStart && r.loopEnd == e.loopEnd;
+        if (!match)
+        {
+            fprintf(stderr, "region %d (line %d, %s) is not as expected\n", int(i), r.lineNumber, r.sample.c_str());
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static bool checkErrors()
+{
+    static const char *malformed[] = {
+        "<region sample=a.wv\n",
+        "<region> sample=a.wv /* never closed\n",
+        "#include \"SFZBenchmark-missing.sfz\"\n",
+        "#include \"SFZBenchmark-self.sfz\"\n",
+    };
+    if (!writeText("SFZBenchmark-self.sfz", malformed[3])) return false;
+    bool ok = true;
+    for (const char *text : malformed)
+    {
+        DunneCore::SFZFile sfz;
+        char errorMessage[100] = "";
+        if (sfz.parse(text, strlen(text), "", errorMessage) || errorMessage[0] == 0)
+        {
+            fprintf(stderr, "malformed SFZ read without an error: %s", text);
+            ok = false;
+        }
+    }
+    remove("SFZBenchmark-self.sfz");
+    return ok;
+}
+
+// what the callback was asked to load, and the tone it loads for each
+struct OtherSamples
+{
+    CoreSampler *sampler;
+    std::vector<std::string> paths;
+    std::vector<float> tone;
+};
+
+static void loadOther(void *context, const SampleDescriptor *sampleDescriptor, const char *path)
+{
+    OtherSamples *others = (OtherSamples *)context;
+    others->paths.push_back(path);
+    SampleDataDescriptor sdd = {};
+    sdd.sampleDescriptor = *sampleDescriptor;
+    sdd.sampleRate = 48000.0f;
+    sdd.channelCount = 1;
+    sdd.sampleCount = int(others->tone.size());
+    sdd.data = others->tone.data();
+    others->sampler->loadSampleData(sdd);
+}
+
+static bool checkLoop(CoreSampler &sampler, unsigned note, unsigned velocity, bool looping, unsigned start, unsigned end)
+{
+    LoopDescriptor loop = {};
+    bool found = sampler.getSampleLoop(note, velocity, loop);
+    if (found == looping && (!looping || (loop.isLooping && loop.startPoint == start && loop.endPoint == end)))
+        return true;
+    fprintf(stderr, "note %u velocity %u: wrong loop\n", note, velocity);
+    return false;
+}
+
+static bool checkLoad()
+{
+    OtherSamples others;
+    CoreSampler sampler;
+    sampler.init(48000.0);
+    others.sampler = &sampler;
+    others.tone.assign(4800, 0.25f);
+    if (!sampler.loadSFZ("SFZBenchmark.sfz", 0, loadOther, &others))
+    {
+        fprintf(stderr, "loadSFZ failed\n");
+        return false;
+    }
+    bool ok = sampler.getMemoryStatistics().sampleCount == 5 &&
+              others.paths.size() == 1 && others.paths[0] == "SFZBenchmark-other.wav";
+    if (!ok) fprintf(stderr, "loadSFZ loaded the wrong samples\n");
+    ok = checkLoop(sampler, 64, 50, true, 100, 4900) && ok;
+    ok = checkLoop(sampler, 64, 110, false, 0, 0) && ok;
+    ok = checkLoop(sampler, 48, 64, true, 0, 0) && ok;
+    ok = checkLoop(sampler, 72, 10, true, 5, 51) && ok;
+    ok = checkLoop(sampler, 78, 10, false, 0, 0) && ok;
+
+    // a WavPack sample which isn't there fails the lot
+    writeText("SFZBenchmark-bad.sfz", "<region> sample=SFZBenchmark-missing.wv\n<region> sample=SFZBenchmark-tone 1.wv\n");
+    CoreSampler bad;
+    bad.init(48000.0);
+    if (bad.loadSFZ("SFZBenchmark-bad.sfz") || bad.getMemoryStatistics().sampleCount != 0)
+    {
+        fprintf(stderr, "an SFZ with a missing sample loaded\n");
+        ok = false;
+    }
+    remove("SFZBenchmark-bad.sfz");
+    return ok;
+}
+
+// what lookup() should give: the note's samples which play at the velocity, as CoreSampler used to
+// find them by walking its list of them
+static std::vector<DunneCore::SampleKeyMap::Entry> scan(const std::vector<DunneCore::KeyMappedSampleBuffer *> &buffers,
+                                                        int velocity)
+{
+    std::vector<DunneCore::SampleKeyMap::Entry> result;
+    for (unsigned i = 0; i < buffers.size(); i++)
+    {
+        const DunneCore::KeyMappedSampleBuffer *b = buffers[i];
+        if (buffers.size() == 1 || b->minimumVelocity < 0 || b->maximumVelocity < 0 ||
+            (velocity >= b->minimumVelocity && velocity <= b->maximumVelocity))
+            result.push_back({ buffers[i], i });
+    }
+    return result;
+}
+
+// random velocity ranges, some overlapping, some unset, on notes with from none to many samples
+static bool checkKeyMap()
+{
+    std::vector<DunneCore::KeyMappedSampleBuffer> buffers(2000);
+    std::vector<DunneCore::KeyMappedSampleBuffer *> noteBuffers[128];
+    DunneCore::SampleKeyMap keyMap;
+    unsigned seed = 1;
+    for (int round = 0; round < 2; round++)
+    {
+        keyMap.clear();
+        for (auto &list : noteBuffers) list.clear();
+        for (DunneCore::KeyMappedSampleBuffer &b : buffers)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            int low = (seed >> 8) % 128, high = (seed >> 16) % 128, note = (seed >> 24) % 128;
+            b.minimumVelocity = seed % 13 == 0 ? -1 : std::min(low, high);
+            b.maximumVelocity = std::max(low, high);
+            note = note * note / 128;       // crowd the low notes, and leave some high ones empty
+            noteBuffers[note].push_back(&b);
+            keyMap.add(note, &b);
+        }
+        keyMap.build();
+    }
+
+    size_t maxCount = 0;
+    for (int nn = 0; nn < 128; nn++)
+    {
+        maxCount = std::max(maxCount, noteBuffers[nn].size());
+        for (int v = 0; v < 128; v++)
+        {
+            std::vector<DunneCore::SampleKeyMap::Entry> expected = scan(noteBuffers[nn], v);
+            DunneCore::SampleKeyMap::Span span = keyMap.lookup(nn, v);
+            bool same = span.size() == expected.size();
+            for (size_t i = 0; same && i < expected.size(); i++)
+                same = span.first[i].buffer == expected[i].buffer && span.first[i].track == expected[i].track;
+            if (!same)
+            {
+                fprintf(stderr, "key map: note %d velocity %d looks up the wrong samples\n", nn, v);
+                return false;
+            }
+        }
+    }
+    if (keyMap.getMaxBufferCount() != maxCount || keyMap.lookup(128, 0).size() != 0 ||
+        keyMap.lookup(0, 200).size() != scan(noteBuffers[0], 127).size())
+    {
+        fprintf(stderr, "key map: wrong sample count, or out of range notes and velocities\n");
+        return false;
+    }
+    return true;
+}
+
+// an instrument of regionCount regions over the two tones: every key, in velocity layers, with loops
+static std::string makeInstrument(int regionCount)
+{
+    std::string text = "<control> default_path=SFZBenchmark-\n<global> loop_mode=loop_continuous\n";
+    int layers = std::max(1, regionCount / 128);
+    char line[200];
+    for (int i = 0; i < regionCount; i++)
+    {
+        int key = i / layers % 128, layer = i % layers;
+        if (layer == 0)
+        {
+            snprintf(line, sizeof(line), "<group> key=%d // key %d\n", key, key);
+            text += line;
+        }
+        snprintf(line, sizeof(line), "<region> sample=tone %d.wv lovel=%d hivel=%d loop_start=%d loop_end=%d tune=%d\n",
+                 1 + i % 2, layer * 128 / layers, (layer + 1) * 128 / layers - 1, i % 100, 4000 + i % 100, i % 7 - 3);
+        text += line;
+    }
+    return text;
+}
+
+int main(int argc, char **argv)
+{
+    bool check = argc > 1 && strcmp(argv[1], "--check") == 0;
+    int regionCount = argc > 1 + check ? atoi(argv[1 + check]) : check ? 2048 : 16384;
+    if (argc > 2 + check || regionCount < 1)
+    {
+        fprintf(stderr, "usage: SFZBenchmark [--check] [regions]\n");
+        return 1;
+    }
+
+    bool ok = writeTone("SFZBenchmark-tone 1.wv", noteFrequency(60.0f), 48000) &&
+              writeTone("SFZBenchmark-tone 2.wv", noteFrequency(72.0f), 24000) &&
+              writeText("SFZBenchmark.sfz", sfzText) && writeText("SFZBenchmark-include.sfz", includeText);
+    if (!ok) fprintf(stderr, "can't write the test files\n");
+
+    DunneCore::SFZFile sfz;
+    char errorMessage[100];
+    if (ok && !sfz.load("SFZBenchmark.sfz", errorMessage))
+    {
+        fprintf(stderr, "SFZBenchmark.sfz: %s\n", errorMessage);
+        ok = false;
+    }
+    ok = ok && checkRegions(sfz) && checkErrors() && checkLoad();
+    printf("test instrument: %s\n", ok ? "every region and loop as expected" : "FAILED");
+    ok = ok && checkKeyMap();
+
+    if (ok)
+    {
+        std::string text = makeInstrument(regionCount);
+        auto start = std::chrono::steady_clock::now();
+        ok = sfz.parse(text.data(), text.size(), "", errorMessage) && int(sfz.regions.size()) == regionCount;
+        double parseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        ok = ok && writeText("SFZBenchmark-large.sfz", text.c_str());
+        CoreSampler sampler;
+        sampler.init(48000.0);
+        start = std::chrono::steady_clock::now();
+        ok = ok && sampler.loadSFZ("SFZBenchmark-large.sfz") && int(sampler.getMemoryStatistics().sampleCount) == regionCount;
+        double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%d regions (%.0f KB): parsed in %.2f ms (%.0f regions/ms), loaded in %.1f ms\n", regionCount,
+               text.size() / 1024.0, parseSeconds * 1000.0, regionCount / (parseSeconds * 1000.0), loadSeconds * 1000.0);
+
+        // every note at every velocity, through the key map's lookup table
+        const int rounds = 20;
+        int looping = 0;
+        start = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++)
+            for (unsigned note = 0; note < 128; note++)
+                for (unsigned velocity = 0; velocity < 128; velocity++)
+                {
+                    LoopDescriptor loop = {};
+                    looping += sampler.getSampleLoop(note, velocity, loop);
+                }
+        double lookupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("note and velocity lookups: %.1f ns each\n", lookupSeconds * 1e9 / (rounds * 128 * 128));
+        ok = ok && looping == rounds * 128 * 128;
+        if (!ok) fprintf(stderr, "the generated instrument didn't load\n");
+        remove("SFZBenchmark-large.sfz");
+    }
+
+    remove("SFZBenchmark.sfz");
+    remove("SFZBenchmark-include.sfz");
+    remove("SFZBenchmark-tone 1.wv");
+    remove("SFZBenchmark-tone 2.wv");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,428 @@
+// Copyright AudioKit. All Rights Reserved.
+
+// Loads a WavPack sample file into CoreSampler, once fully decoded into memory and once streamed
+// from disk with only its head resident, renders the same looping notes from each, and reports
+// memory use, load time and streaming underruns. Then renders it held in memory as 24-bit and as
+// 16-bit integers, and checks that two samplers loading the file share one decoded copy, which is
+// freed once both unload it. Then decodes the file through its block index, serially and split
+// across threads, and from points in the middle, checking each against WavPack's own sequential
+// decode, and streams and decodes it from a mapped pack file holding it. Last, loads a kit of small
+// files one by one and as a parallel batch.
+//
+//   SampleFileBenchmark [--quick] [voices] [seconds] [headFrames]
+//
+// The test file, 24-bit stereo tones written to the working directory with the WavPack encoder, is made
+// first and removed afterwards. The streamed render is paced at twice real time, so the streaming
+// thread gets a realistic share of the machine. --quick uses a short file and a small head, and
+// renders past the loop point, for use as a smoke test; it checks that the streamed render had no
+// underruns and is bit-identical to the resident one, as is the 24-bit render.
+
+#include "CoreSampler.h"
+#include "AudioFile.h"
+#include "WavPackDecoder.h"
+#include "wavpack.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// CoreSampler's voice count (MAX_POLYPHONY in CoreSampler.cpp)
+static const int maxVoices = 64;
+
+struct RenderResult
+{
+    std::vector<float> output;          // left then right for every chunk
+    double loadSeconds;
+    SampleStreamingStatistics stats;
+};
+
+// loads the file at path, or if data is given, the byteCount bytes there
+static RenderResult run(const char *path, int voiceCount, double seconds, bool streaming, size_t headFrames,
+                        SampleStorageFormat format = SampleStorageFloat32, const void *data = 0, size_t byteCount = 0)
+{
+    const float sampleRate = 48000.0f;
+    CoreSampler sampler;
+    sampler.init(sampleRate);
+    sampler.setSampleStreaming(streaming, headFrames);
+    sampler.setSampleStorageFormat(format);
+
+    RenderResult result;
+    SampleFileDescriptor sfd = {};
+    sfd.sampleDescriptor = { 60, 261.6f, 0, 127, 0, 127, 0.0f, 0.0f };
+    sfd.path = path;
+    SampleMemoryDescriptor smd = { sfd.sampleDescriptor, data, byteCount };
+    auto start = std::chrono::steady_clock::now();
+    bool loaded = data ? sampler.loadCompressedSampleMemory(smd) : sampler.loadCompressedSampleFile(sfd);
+    result.loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!loaded) return result;
+    sampler.buildKeyMap();
+
+    unsigned track = 0;
+    LoopDescriptor loop = {};
+    loop.isLooping = true;
+    loop.enabledTracksCount = 1;
+    loop.enabledTracks = &track;
+
+    float left[CORESAMPLER_CHUNKSIZE], right[CORESAMPLER_CHUNKSIZE];
+    float *outBuffers[2] = { left, right };
+    long chunks = long(seconds * sampleRate) / CORESAMPLER_CHUNKSIZE;
+    result.output.reserve(chunks * 2 * CORESAMPLER_CHUNKSIZE);
+
+    // notes start a tenth of a second apart, and streamed renders never get more than twice as far
+    // ahead of the clock as real time would
+    const long chunksPerNote = long(0.1 * sampleRate) / CORESAMPLER_CHUNKSIZE;
+    start = std::chrono::steady_clock::now();
+    for (long c = 0; c < chunks; c++)
+    {
+        int64_t now = c * CORESAMPLER_CHUNKSIZE;
+        if (c % chunksPerNote == 0 && c / chunksPerNote < voiceCount)
+        {
+            sampler.prepareNote(60 + int(c / chunksPerNote), 100, loop);
+            sampler.play(now);
+        }
+
+        if (streaming)
+        {
+            double due = now / sampleRate / 2.0;
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (elapsed < due) std::this_thread::sleep_for(std::chrono::duration<double>(due - elapsed));
+        }
+
+        memset(left, 0, sizeof(left));
+        memset(right, 0, sizeof(right));
+        sampler.render(2, CORESAMPLER_CHUNKSIZE, outBuffers, now);
+        result.output.insert(result.output.end(), left, left + CORESAMPLER_CHUNKSIZE);
+        result.output.insert(result.output.end(), right, right + CORESAMPLER_CHUNKSIZE);
+    }
+    result.stats = sampler.getStreamingStatistics();
+    return result;
+}
+
+// two samplers, one file: the second load must reuse the first one's samples
+static bool checkSharing(const char *path)
+{
+    CoreSampler first, second;
+    first.init(48000.0);
+    second.init(48000.0);
+    SampleFileDescriptor sfd = {};
+    sfd.sampleDescriptor = { 60, 261.6f, 0, 127, 0, 127, 0.0f, 0.0f };
+    sfd.path = path;
+    if (!first.loadCompressedSampleFile(sfd)) return false;
+    SampleMemoryStatistics alone = first.getMemoryStatistics();
+    if (!second.loadCompressedSampleFile(sfd)) return false;
+    SampleMemoryStatistics shared = second.getMemoryStatistics();
+
+    printf("two samplers: %.1f MB decoded in total, each plays %.1f MB and is charged %.1f MB\n",
+           shared.storeBytes / 1048576.0, shared.sampleBytes / 1048576.0, shared.proportionalBytes / 1048576.0);
+    bool ok = shared.storeBytes == alone.storeBytes && shared.sharedBytes == shared.sampleBytes &&
+              shared.proportionalBytes == shared.sampleBytes / 2;
+
+    first.unloadAllSamples();
+    ok = ok && second.getMemoryStatistics().storeBytes == alone.storeBytes;
+    second.unloadAllSamples();
+    return ok && second.getMemoryStatistics().storeBytes == 0;
+}
+
+// a kit's pack file: the file twice over, after a header, as an archive would hold it; false if it
+// can't be written. Sets where each copy starts.
+static bool writePack(const char *path, const char *packPath, size_t offsets[2], size_t &fileBytes)
+{
+    FILE *in = fopen(path, "rb");
+    if (in == 0) return false;
+    std::vector<char> bytes;
+    char buffer[65536];
+    for (size_t n; (n = fread(buffer, 1, sizeof(buffer), in)) > 0; ) bytes.insert(bytes.end(), buffer, buffer + n);
+    fclose(in);
+
+    FILE *out = fopen(packPath, "wb");
+    if (out == 0) return false;
+    const char header[100] = "SampleFileBenchmark pack";
+    offsets[0] = sizeof(header);
+    offsets[1] = sizeof(header) + bytes.size();
+    fileBytes = bytes.size();
+    bool ok = fwrite(header, 1, sizeof(header), out) == sizeof(header) &&
+              fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size() &&
+              fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+    return fclose(out) == 0 && ok;
+}
+
+// WavPack's own decode, start to finish, as the reference
+static bool referenceDecode(const char *path, std::vector<float> &left, std::vector<float> &right)
+{
+    char errorMessage[100];
+    WavpackContext *wpc = WavpackOpenFileInput(path, errorMessage, OPEN_2CH_MAX, 0);
+    if (wpc == 0 || WavpackGetReducedChannels(wpc) != 2) return false;
+    size_t frameCount = (size_t)WavpackGetNumSamples64(wpc);
+    float scale = 1.0f / float(1 << (WavpackGetBitsPerSample(wpc) - 1));
+    std::vector<int32_t> interleaved(2 * frameCount);
+    bool ok = WavpackUnpackSamples(wpc, interleaved.data(), uint32_t(frameCount)) == frameCount;
+    WavpackCloseFile(wpc);
+    left.resize(frameCount);
+    right.resize(frameCount);
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        left[i] = scale * interleaved[2 * i];
+        right[i] = scale * interleaved[2 * i + 1];
+    }
+    return ok;
+}
+
+// the block-indexed decoder, whole and in pieces, must match the reference exactly
+static bool checkBlockDecode(const char *path, int threadCount)
+{
+    std::vector<float> left, right;
+    DunneCore::WavPackDecoder decoder;
+    char errorMessage[100];
+    if (!referenceDecode(path, left, right) || !decoder.open(path, errorMessage)) return false;
+    size_t frameCount = decoder.getFrameCount();
+
+    std::vector<float> l(frameCount), r(frameCount);
+    auto start = std::chrono::steady_clock::now();
+    bool ok = decoder.decode(0, frameCount, l.data(), r.data()) && l == left && r == right;
+    double serialSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // ranges of a block or more, so even a short file is split up
+    std::fill(l.begin(), l.end(), 0.0f);
+    std::fill(r.begin(), r.end(), 0.0f);
+    start = std::chrono::steady_clock::now();
+    ok = ok && decoder.decodeParallel(0, frameCount, l.data(), r.data(), threadCount, 1) && l == left && r == right;
+    double parallelSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // odd ranges from the middle, as a streaming seek would ask for
+    unsigned seed = 1;
+    for (int i = 0; ok && i < 16; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        size_t first = (seed >> 8) % frameCount;
+        size_t count = std::min<size_t>(frameCount - first, 1 + (seed >> 4) % 30000);
+        ok = decoder.decode(first, count, l.data(), r.data()) &&
+             std::equal(l.begin(), l.begin() + count, left.begin() + first) &&
+             std::equal(r.begin(), r.begin() + count, right.begin() + first);
+    }
+
+    double megabytes = frameCount * 2 * sizeof(float) / 1048576.0;
+    printf("%zu blocks: decoded in %.1f ms (%.0f MB/s), on %d threads in %.1f ms (%.0f MB/s)\n",
+           decoder.getBlocks().size(), serialSeconds * 1000.0, megabytes / serialSeconds,
+           threadCount, parallelSeconds * 1000.0, megabytes / parallelSeconds);
+    return ok && decoder.getBlocks().size() > 1;
+}
+
+static void countProgress(void *context, int loadedCount, int totalCount)
+{
+    int *calls = (int *)context;
+    if (loadedCount == totalCount) calls[1]++;
+    calls[0]++;
+}
+
+// a kit of short files, one per note: the batch must load what one-by-one loading does, report
+// progress as it goes, and load nothing at all if any file is missing
+static bool checkBatchLoad(int fileCount, int threadCount)
+{
+    const float sampleRate = 48000.0f;
+    const int frameCount = int(sampleRate) / 2;
+    std::vector<float> left(frameCount), right(frameCount);
+    std::vector<std::string> paths;
+    std::vector<SampleFileDescriptor> sfds;
+    for (int f = 0; f < fileCount; f++)
+    {
+        for (int i = 0; i < frameCount; i++)
+        {
+            left[i] = 0.4f * sinf(i * 0.01f * (f + 1));
+            right[i] = 0.4f * sinf(i * 0.013f * (f + 1));
+        }
+        paths.push_back("SampleFileBenchmark" + std::to_string(f) + ".wv");
+        if (!writeWavPackFile(paths.back(), sampleRate, left.data(), right.data(), frameCount)) return false;
+    }
+    for (int f = 0; f < fileCount; f++)
+    {
+        SampleFileDescriptor sfd = {};
+        sfd.sampleDescriptor = { 36 + f, 0.0f, 36 + f, 36 + f, 0, 127, 0.0f, 0.0f };
+        sfd.sampleDescriptor.noteFrequency = 440.0f * powf(2.0f, (sfd.sampleDescriptor.noteNumber - 69) / 12.0f);
+        sfd.path = paths[f].c_str();
+        sfds.push_back(sfd);
+    }
+
+    CoreSampler serial, batch;
+    serial.init(sampleRate);
+    batch.init(sampleRate);
+    auto start = std::chrono::steady_clock::now();
+    bool ok = true;
+    for (SampleFileDescriptor &sfd : sfds) ok = ok && serial.loadCompressedSampleFile(sfd);
+    serial.buildKeyMap();
+    double serialSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    SampleMemoryStatistics serialStats = serial.getMemoryStatistics();
+    serial.unloadAllSamples();      // so the batch has to decode everything again
+
+    int calls[2] = { 0, 0 };
+    start = std::chrono::steady_clock::now();
+    ok = ok && batch.loadCompressedSampleFiles(sfds.data(), fileCount, threadCount, countProgress, calls);
+    double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    SampleMemoryStatistics batchStats = batch.getMemoryStatistics();
+    printf("%d files: loaded one by one in %.1f ms, as a batch on %d threads in %.1f ms (%d progress reports)\n",
+           fileCount, serialSeconds * 1000.0, threadCount, batchSeconds * 1000.0, calls[0]);
+    ok = ok && batchStats.sampleCount == serialStats.sampleCount && batchStats.sampleBytes == serialStats.sampleBytes &&
+         calls[0] >= 1 && calls[0] <= fileCount && calls[1] == 1;
+    batch.unloadAllSamples();
+
+    // one missing file, halfway through
+    std::vector<SampleFileDescriptor> broken = sfds;
+    broken[fileCount / 2].path = "SampleFileBenchmarkMissing.wv";
+    ok = ok && !batch.loadCompressedSampleFiles(broken.data(), fileCount, threadCount);
+    SampleMemoryStatistics brokenStats = batch.getMemoryStatistics();
+    ok = ok && brokenStats.sampleCount == 0 && brokenStats.storeBytes == 0;
+
+    for (const std::string &path : paths) remove(path.c_str());
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = false, badOption = false;
+    for (; argc > 1 && strncmp(argv[1], "--", 2) == 0; argc--, argv++)
+    {
+        if (strcmp(argv[1], "--quick") == 0) quick = true;
+        else badOption = true;
+    }
+
+    int voiceCount = argc > 1 ? atoi(argv[1]) : 16;
+    double seconds = argc > 2 ? atof(argv[2]) : (quick ? 2.5 : 10.0);
+    long headFrames = argc > 3 ? atol(argv[3]) : (quick ? 8190 : SAMPLESTREAM_DEFAULT_HEAD_FRAMES);
+    if (badOption || voiceCount < 1 || voiceCount > maxVoices || seconds <= 0.0 || headFrames < 1)
+    {
+        fprintf(stderr, "usage: SampleFileBenchmark [--quick] [voices 1-%d] [seconds] [headFrames]\n", maxVoices);
+        return 1;
+    }
+
+    // stereo tones with a slow sweep, so every stretch of the file differs
+    const float sampleRate = 48000.0f;
+    const int fileSeconds = quick ? 2 : 20;
+    const int frameCount = fileSeconds * int(sampleRate) + 3;      // an odd length, so channels need padding
+    std::vector<float> left(frameCount), right(frameCount);
+    for (int i = 0; i < frameCount; i++)
+    {
+        float sweep = 0.02f + 0.03f * i / frameCount;
+        left[i] = 0.4f * sinf(i * sweep) + 0.1f * sinf(i * 0.0007f);
+        right[i] = 0.4f * sinf(i * sweep * 1.01f) + 0.1f * sinf(i * 0.0011f);
+    }
+    const char *path = "SampleFileBenchmark.wv";
+    if (!writeWavPackFile(path, sampleRate, left.data(), right.data(), frameCount, 24))
+    {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 1;
+    }
+
+    RenderResult resident = run(path, voiceCount, seconds, false, 0);
+    RenderResult streamed = run(path, voiceCount, seconds, true, size_t(headFrames));
+    RenderResult int24 = run(path, voiceCount, seconds, false, 0, SampleStorageInt24);
+    RenderResult int16 = run(path, voiceCount, seconds, false, 0, SampleStorageInt16);
+    if (resident.output.empty() || streamed.output.empty() || int24.output.empty() || int16.output.empty())
+    {
+        fprintf(stderr, "cannot load %s\n", path);
+        remove(path);
+        return 1;
+    }
+
+    printf("resident: %.1f MB in memory, loaded in %.1f ms (%.0f MB/s decoded)\n",
+           resident.stats.residentBytes / 1048576.0, resident.loadSeconds * 1000.0,
+           resident.stats.residentBytes / 1048576.0 / resident.loadSeconds);
+    printf("streamed: %.2f MB in memory (%.1f MB left on disk) plus %.1f MB of read-ahead, loaded in %.1f ms\n",
+           streamed.stats.residentBytes / 1048576.0, streamed.stats.streamedBytes / 1048576.0,
+           streamed.stats.ringBytes / 1048576.0, streamed.loadSeconds * 1000.0);
+    printf("%d voices, %.2fs of audio: %llu frames read ahead, %llu underruns (%llu frames)\n",
+           voiceCount, seconds, streamed.stats.framesRead, streamed.stats.underruns, streamed.stats.underrunFrames);
+
+
+    // the loudest difference from the float render, in dB below full scale
+    auto errorDb = [&](const RenderResult &r) {
+        float worst = 0.0f;
+        for (size_t i = 0; i < resident.output.size(); i++)
+            worst = std::max(worst, fabsf(r.output[i] - resident.output[i]));
+        return worst > 0.0f ? 20.0 * log10(worst) : -INFINITY;
+    };
+    printf("int24: %.1f MB in memory, loaded in %.1f ms, worst error %.1f dB\n",
+           int24.stats.residentBytes / 1048576.0, int24.loadSeconds * 1000.0, errorDb(int24));
+    printf("int16: %.1f MB in memory, loaded in %.1f ms, worst error %.1f dB\n",
+           int16.stats.residentBytes / 1048576.0, int16.loadSeconds * 1000.0, errorDb(int16));
+    bool compact = int24.stats.residentBytes * 4 == resident.stats.residentBytes * 3 &&
+                   int16.stats.residentBytes * 2 == resident.stats.residentBytes &&
+                   memcmp(resident.output.data(), int24.output.data(), resident.output.size() * sizeof(float)) == 0;
+
+    // the same file streamed from a mapped pack, from the second copy so nothing is read from its
+    // start by mistake; and both copies decoded straight from memory
+    const char *packPath = "SampleFileBenchmark.pack";
+    size_t offsets[2] = { 0, 0 }, fileBytes = 0, packBytes = 0;
+    const uint8_t *pack = 0;
+    if (writePack(path, packPath, offsets, fileBytes))
+        pack = (const uint8_t *)DunneCore::mapFile(packPath, packBytes);
+    RenderResult mapped = pack ? run(path, voiceCount, seconds, true, size_t(headFrames), SampleStorageFloat32,
+                                     pack + offsets[1], fileBytes) : RenderResult();
+    bool fromMemory = !mapped.output.empty() && mapped.stats.underruns == 0 &&
+                      memcmp(resident.output.data(), mapped.output.data(), resident.output.size() * sizeof(float)) == 0;
+    for (int copy = 0; fromMemory && copy < 2; copy++)
+    {
+        std::vector<float> left, right, l, r;
+        DunneCore::WavPackDecoder decoder;
+        char errorMessage[100];
+        fromMemory = referenceDecode(path, left, right) &&
+                     decoder.open(DunneCore::WavPackSource::memory(pack + offsets[copy], fileBytes), errorMessage);
+        l.resize(decoder.getFrameCount());
+        r.resize(decoder.getFrameCount());
+        fromMemory = fromMemory && decoder.decodeParallel(0, l.size(), l.data(), r.data(), 4, 1) && l == left && r == right;
+    }
+    printf("mapped pack: streamed from memory, loaded in %.1f ms, output %s the resident output\n",
+           mapped.loadSeconds * 1000.0, fromMemory ? "bit-identical to" : "different from");
+    DunneCore::unmapFile(pack, packBytes);
+    remove(packPath);
+
+    bool shared = checkSharing(path);
+    bool blocksMatch = checkBlockDecode(path, 4);
+    remove(path);
+    bool batched = checkBatchLoad(quick ? 8 : 64, 4);
+
+    double checksum = 0.0;
+    for (float value : streamed.output) checksum += fabsf(value);
+    bool identical = memcmp(resident.output.data(), streamed.output.data(), resident.output.size() * sizeof(float)) == 0;
+    printf("streamed output is %s the resident output (checksum %.6g)\n", identical ? "bit-identical to" : "different from", checksum);
+    if (!compact)
+    {
+        fprintf(stderr, "24-bit storage did not match the float render, or compact storage did not save memory\n");
+        return 1;
+    }
+    if (!fromMemory)
+    {
+        fprintf(stderr, "loading from memory did not match loading the file\n");
+        return 1;
+    }
+    if (!blocksMatch)
+    {
+        fprintf(stderr, "decoding by blocks did not match decoding the whole file\n");
+        return 1;
+    }
+    if (!batched)
+    {
+        fprintf(stderr, "loading a batch of files did not match loading them one by one\n");
+        return 1;
+    }
+    if (!shared)
+    {
+        fprintf(stderr, "samplers loading the same file did not share it\n");
+        return 1;
+    }
+    if (checksum == 0.0)
+    {
+        fprintf(stderr, "no output\n");
+        return 1;
+    }
+    if (quick && (streamed.stats.underruns > 0 || !identical || streamed.stats.streamedSampleCount != 1))
+    {
+        fprintf(stderr, "streaming did not keep up with, or did not match, the resident render\n");
+        return 1;
+    }
+    return 0;
+}
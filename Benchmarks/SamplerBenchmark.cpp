@@ -0,0 +1,415 @@
+// Copyright AudioKit. All Rights Reserved.
+
+// Renders many looping, time-stretched CoreSampler voices offline and reports how many voices
+// one core can sustain in real time, and so how many frames per second one voice renders.
+//
+//   SamplerBenchmark [--quick] [--queued] [--timed] [--baked] [voices] [seconds] [tracks] [reversed] [threads]
+//
+// tracks > 1 mixes several copies of the sample per voice; a nonzero 'reversed' plays the loop
+// backwards; threads > 1 renders voices in parallel (setRenderThreadCount), and with --quick
+// another thread keeps resizing the pool meanwhile. --queued starts notes
+// from another thread through the command queue (postPrepareNote/postPlay); --timed posts them all
+// up front instead, each due a few frames into the chunk it would start with. --quick renders a
+// short burst, for use as a smoke test, and with threads > 1 or --queued also checks the output
+// is bit-identical to a serial render of directly started (or equally timed) notes; with --timed,
+// that the first note sounds from its frame and not before. --timed also gives notes an attack
+// and vibrato, and posts calls which change nothing (sustain pedal up): some timed to split
+// chunks further, and more, from another thread throughout, due at once, so some land while
+// render() is between pieces; --quick checks the output is bit-identical to a serial render
+// without them, so envelopes and LFOs step once per chunk however it is split. --baked turns on the stretch
+// cache and plays a one-second loop with every note tuned to the sample's pitch, and renders until
+// every voice plays the baked loop before timing; --quick then checks each one did. Every run
+// ends by queueing a note for ten seconds later, then stopping all voices from another thread
+// and checking that completes with the next render chunk, then unloading the samples from another
+// thread while a voice plays and rendering carries on. Also times CoreSampler::init(), first
+// and again at the same rate. --quick also checks that the thread calling render() makes no
+// allocations at all while it starts notes and renders: every call is counted, through malloc
+// and its kin with glibc, else operator new.
+
+#include "CoreSampler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <vector>
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#define SAMPLERBENCHMARK_SANITIZED
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define SAMPLERBENCHMARK_SANITIZED
+#endif
+
+// allocation calls made while this thread has countAllocations set; sanitizers bring their own
+// malloc, so then only operator new is counted
+static thread_local bool countAllocations = false;
+static std::atomic<long> allocationCount { 0 };
+
+static void countAllocation()
+{
+    if (countAllocations) allocationCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+#if defined(__GLIBC__) && !defined(SAMPLERBENCHMARK_SANITIZED)
+#include <errno.h>
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *p, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+
+    void *malloc(size_t size) { countAllocation(); return __libc_malloc(size); }
+    void *calloc(size_t count, size_t size) { countAllocation(); return __libc_calloc(count, size); }
+    void *realloc(void *p, size_t size) { countAllocation(); return __libc_realloc(p, size); }
+    void *memalign(size_t alignment, size_t size) { countAllocation(); return __libc_memalign(alignment, size); }
+    void *aligned_alloc(size_t alignment, size_t size) { countAllocation(); return __libc_memalign(alignment, size); }
+
+    int posix_memalign(void **p, size_t alignment, size_t size)
+    {
+        countAllocation();
+        void *q = __libc_memalign(alignment, size);
+        if (!q) return ENOMEM;
+        *p = q;
+        return 0;
+    }
+}
+#else
+// the standard library's other forms of new and delete come to these
+void *operator new(size_t size)
+{
+    countAllocation();
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+#endif
+
+// CoreSampler's voice count (MAX_POLYPHONY in CoreSampler.cpp)
+static const int maxVoices = 64;
+
+struct BenchmarkResult
+{
+    std::vector<float> output;  // left then right for every chunk, kept only if asked for
+    double rendered, elapsed, checksum;
+    bool stoppedCleanly;        // see the end of run()
+    bool unloadedCleanly;
+    SampleStretchCacheStatistics stretchStats;
+    int onset;                  // frame of the first sound, or -1 if the first chunk is silent
+    long allocations;           // made by this thread in prepareNote(), play() and render()
+};
+
+// a sampler whose vibrato can be turned up, as SamplerDSP's parameters do
+struct BenchmarkSampler : CoreSampler
+{
+    void setVibrato(float depthSemitones, float voiceFrequency)
+    {
+        vibratoDepth = voiceVibratoDepth = depthSemitones;
+        voiceVibratoFrequency = voiceFrequency;
+    }
+};
+
+// --timed notes are due this many frames into their chunks
+static const int timedOffset = 7;
+
+// chunks the no-ops --timed queues up front split; with the notes, they must fit the queue
+static const int noOpChunks = 48;
+
+static BenchmarkResult run(int voiceCount, double seconds, unsigned trackCount, bool reversed, int threadCount,
+                           bool queued, bool timed, bool noOps, bool baked, const std::vector<float> &samples,
+                           bool keepOutput)
+{
+    const float sampleRate = 48000.0f;
+    BenchmarkSampler sampler;
+    sampler.init(sampleRate);
+    sampler.setRenderThreadCount(threadCount);
+    if (timed)
+    {
+        sampler.setADSRAttackDurationSeconds(0.1f);
+        sampler.setVibrato(0.5f, 7.0f);
+    }
+    if (baked)
+    {
+        sampler.setStretchCacheBudget(256 * 1024 * 1024);
+        for (int note = 0; note < 128; note++) sampler.setNoteFrequency(note, 261.6f);
+    }
+
+    const int frameCount = int(samples.size() / 2);
+    SampleDataDescriptor sdd = {};
+    sdd.sampleDescriptor = { 60, 261.6f, 0, 127, 0, 127, 0.0f, (float)frameCount };
+    sdd.sampleRate = sampleRate;
+    sdd.channelCount = 2;
+    sdd.sampleCount = frameCount;
+    sdd.isInterleaved = false;
+    sdd.data = const_cast<float *>(samples.data());
+    for (unsigned t = 0; t < trackCount; t++) sampler.loadSampleData(sdd);
+    sampler.buildKeyMap();
+
+    std::vector<unsigned> tracks(trackCount);
+    for (unsigned t = 0; t < trackCount; t++) tracks[t] = t;
+
+    LoopDescriptor loop = {};
+    loop.isLooping = true;
+    loop.reversed = reversed;
+    loop.endPoint = baked ? int(sampleRate) : frameCount;
+    loop.enabledTracksCount = trackCount;
+    loop.enabledTracks = tracks.data();
+
+    float left[CORESAMPLER_CHUNKSIZE], right[CORESAMPLER_CHUNKSIZE];
+    float *outBuffers[2] = { left, right };
+    int64_t now = 0;
+    allocationCount.store(0);
+    auto renderChunk = [&] {
+        memset(left, 0, sizeof(left));
+        memset(right, 0, sizeof(right));
+        countAllocations = true;
+        sampler.render(2, CORESAMPLER_CHUNKSIZE, outBuffers, now);
+        countAllocations = false;
+        now += CORESAMPLER_CHUNKSIZE;
+    };
+
+    // timed notes are queued ahead, each prepared and started on its own frame; no-ops split the
+    // chunks after them too, in time order as the queue needs, as far as it has room
+    if (timed)
+    {
+        std::thread control([&] {
+            for (int c = 0; c < noOpChunks; c++)
+            {
+                int64_t due = int64_t(c) * CORESAMPLER_CHUNKSIZE + timedOffset;
+                if (noOps) sampler.postSustainPedal(false, due - 4);
+                if (c < voiceCount)
+                {
+                    sampler.postPrepareNote(30 + c, 100, loop, due);
+                    sampler.postPlay(due);
+                }
+                if (noOps) sampler.postSustainPedal(false, due + 4);
+            }
+        });
+        control.join();
+    }
+    std::atomic<bool> resizing { keepOutput && threadCount > 1 };
+    std::thread resizer([&] {
+        for (int n = 1; resizing.load(); n++)
+        {
+            sampler.setRenderThreadCount(n % 2 ? 1 : threadCount);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    });
+    std::atomic<bool> hammering { noOps };
+    std::thread hammer([&] {
+        while (hammering.load())
+        {
+            sampler.postSustainPedal(false);
+            std::this_thread::yield();
+        }
+    });
+
+    // a voice becomes busy once rendered, so start them one chunk apart
+    BenchmarkResult result;
+    result.onset = -1;
+    for (int v = 0; v < voiceCount; v++)
+    {
+        if (queued && !timed)
+        {
+            // posted from a control thread, so carried out at the start of the next chunk
+            std::thread control([&] {
+                sampler.postPrepareNote(30 + v, 100, loop);
+                sampler.postPlay(now);
+            });
+            control.join();
+        }
+        else if (!timed)
+        {
+            countAllocations = true;
+            sampler.prepareNote(30 + v, 100, loop);
+            sampler.play(now);
+            countAllocations = false;
+        }
+        renderChunk();
+        for (int i = 0; v == 0 && i < CORESAMPLER_CHUNKSIZE && result.onset < 0; i++)
+            if (left[i] != 0.0f || right[i] != 0.0f) result.onset = i;
+    }
+
+    // the loop is baked once the speed and pitch have settled, and voices switch as it comes round
+    for (long c = 0; baked && c < long(10 * sampleRate) / CORESAMPLER_CHUNKSIZE; c++)
+    {
+        if (sampler.getStretchCacheStatistics().plays >= (unsigned)voiceCount) break;
+        renderChunk();
+        if (sampler.getStretchCacheStatistics().bakes == 0) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    long chunks = long(seconds * sampleRate) / CORESAMPLER_CHUNKSIZE;
+    if (keepOutput) result.output.reserve(chunks * 2 * CORESAMPLER_CHUNKSIZE);
+    result.checksum = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (long c = 0; c < chunks; c++)
+    {
+        renderChunk();
+        for (int i = 0; i < CORESAMPLER_CHUNKSIZE; i++) result.checksum += fabsf(left[i]) + fabsf(right[i]);
+        if (keepOutput)
+        {
+            result.output.insert(result.output.end(), left, left + CORESAMPLER_CHUNKSIZE);
+            result.output.insert(result.output.end(), right, right + CORESAMPLER_CHUNKSIZE);
+        }
+    }
+    result.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.rendered = double(chunks * CORESAMPLER_CHUNKSIZE) / sampleRate;
+    result.stretchStats = sampler.getStretchCacheStatistics();
+    hammering.store(false);
+    hammer.join();
+    resizing.store(false);
+    resizer.join();
+
+    // stop everything from a control thread: that must time out while render() isn't called, then
+    // complete, leaving silence, with the next chunk, even behind a note queued for much later
+    uint64_t ticket = 0;
+    bool timedOut = false;
+    std::thread control([&] {
+        int64_t later = now + int64_t(10 * sampleRate);
+        sampler.postPrepareNote(30, 100, loop, later);
+        sampler.postPlay(later);
+        ticket = sampler.postStopAllVoices();
+        timedOut = !sampler.waitForVoicesStopped(ticket, 0.01);
+    });
+    control.join();
+    renderChunk();
+    bool silent = true;
+    for (int i = 0; i < CORESAMPLER_CHUNKSIZE; i++) silent = silent && left[i] == 0.0f && right[i] == 0.0f;
+    result.stoppedCleanly = ticket != 0 && timedOut && sampler.voicesStopped(ticket) && silent;
+
+    // unload from a control thread while voices play and render() carries on: that must leave it
+    // silent, not reading freed samples
+    sampler.restartVoices();
+    sampler.prepareNote(30, 100, loop);
+    sampler.play(now);
+    renderChunk();
+    std::atomic<bool> unloaded { false };
+    std::thread unloader([&] {
+        sampler.unloadAllSamples();
+        unloaded.store(true);
+    });
+    while (!unloaded.load()) renderChunk();
+    unloader.join();
+    renderChunk();
+    silent = true;
+    for (int i = 0; i < CORESAMPLER_CHUNKSIZE; i++) silent = silent && left[i] == 0.0f && right[i] == 0.0f;
+    result.unloadedCleanly = silent;
+    result.allocations = allocationCount.load();
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = false, queued = false, timed = false, baked = false, badOption = false;
+    for (; argc > 1 && strncmp(argv[1], "--", 2) == 0; argc--, argv++)
+    {
+        if (strcmp(argv[1], "--quick") == 0) quick = true;
+        else if (strcmp(argv[1], "--queued") == 0) queued = true;
+        else if (strcmp(argv[1], "--timed") == 0) timed = true;
+        else if (strcmp(argv[1], "--baked") == 0) baked = true;
+        else badOption = true;
+    }
+
+    int voiceCount = argc > 1 ? atoi(argv[1]) : 32;
+    double seconds = argc > 2 ? atof(argv[2]) : (quick ? 0.25 : 10.0);
+    unsigned trackCount = argc > 3 ? (unsigned)atoi(argv[3]) : 1;
+    bool reversed = argc > 4 && atoi(argv[4]) != 0;
+    int threadCount = argc > 5 ? atoi(argv[5]) : 1;
+    if (badOption || voiceCount < 1 || voiceCount > maxVoices || trackCount < 1 || trackCount > 8 || threadCount < 1 || threadCount > maxVoices)
+    {
+        fprintf(stderr, "usage: SamplerBenchmark [--quick] [--queued] [--timed] [--baked] [voices 1-%d] [seconds] [tracks 1-8] [reversed 0/1] [threads]\n", maxVoices);
+        return 1;
+    }
+
+    // four seconds of stereo test tones, loaded once per track
+    const int frameCount = 4 * 48000;
+    std::vector<float> samples(2 * frameCount);
+    for (int i = 0; i < frameCount; i++)
+    {
+        samples[i] = 0.5f * sinf(i * 0.05f);
+        samples[frameCount + i] = 0.5f * sinf(i * 0.031f);
+    }
+
+    // init() makes every voice's stretcher; doing it again at the same rate only resets them
+    {
+        CoreSampler sampler;
+        auto start = std::chrono::steady_clock::now();
+        sampler.init(48000.0);
+        auto made = std::chrono::steady_clock::now();
+        sampler.init(48000.0);
+        auto reset = std::chrono::steady_clock::now();
+        printf("init: %.2f ms, again at the same rate: %.2f ms\n",
+               std::chrono::duration<double, std::milli>(made - start).count(),
+               std::chrono::duration<double, std::milli>(reset - made).count());
+    }
+
+    bool compare = quick && (threadCount > 1 || queued || timed);
+    BenchmarkResult result = run(voiceCount, seconds, trackCount, reversed, threadCount, queued, timed, timed, baked,
+                                 samples, compare);
+    double voicesPerCore = voiceCount * result.rendered / result.elapsed / threadCount;
+    printf("%d voices, %u track(s)%s, %d thread(s): %.2fs of audio in %.3fs, realtime factor %.2f, %.1f voices/core, "
+           "%.0f frames/s per voice (checksum %.6g)\n",
+           voiceCount, trackCount, reversed ? " reversed" : "", threadCount, result.rendered, result.elapsed,
+           result.rendered / result.elapsed, voicesPerCore, voicesPerCore * 48000.0, result.checksum);
+
+    if (compare)
+    {
+        BenchmarkResult serial = run(voiceCount, seconds, trackCount, reversed, 1, false, timed, false, baked, samples, true);
+        if (memcmp(serial.output.data(), result.output.data(), serial.output.size() * sizeof(float)) != 0)
+        {
+            fprintf(stderr, "output differs from a serial render of directly started notes\n");
+            return 1;
+        }
+        printf("output is bit-identical to a serial render of directly started notes\n");
+    }
+    if (timed)
+    {
+        printf("first note due on frame %d, first sound on frame %d\n", timedOffset, result.onset);
+        // the attack's first frame has no gain, and the test tone starts at 0
+        if (quick && (result.onset < timedOffset || result.onset > timedOffset + 2))
+        {
+            fprintf(stderr, "the first note does not start on its frame\n");
+            return 1;
+        }
+    }
+    if (baked)
+    {
+        const SampleStretchCacheStatistics &stats = result.stretchStats;
+        printf("stretch cache: %llu loop(s) baked, %llu failed, %llu voice(s) switched to them, %llu bytes\n",
+               stats.bakes, stats.failures, stats.plays, stats.bytesUsed);
+        if (quick && stats.plays < (unsigned)voiceCount)
+        {
+            fprintf(stderr, "only %llu of %d voices play the baked loop\n", stats.plays, voiceCount);
+            return 1;
+        }
+    }
+    printf("%ld allocation(s) while starting notes and rendering\n", result.allocations);
+    if (quick && result.allocations > 0)
+    {
+        fprintf(stderr, "starting notes or rendering allocated\n");
+        return 1;
+    }
+    if (!result.stoppedCleanly)
+    {
+        fprintf(stderr, "stopAllVoices did not complete as expected\n");
+        return 1;
+    }
+    if (!result.unloadedCleanly)
+    {
+        fprintf(stderr, "unloading the samples did not leave silence\n");
+        return 1;
+    }
+    return result.checksum > 0.0 ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+// Copyright AudioKit. All Rights Reserved.
+
+// Times the DunneCore vector ops, including the integer sample conversions, against plain reference
+// loops, and checks they agree.
+//
+//   VectorOpsBenchmark [--check]
+//
+// --check only verifies results (exit status 1 on mismatch), for use as a quick test.
+
+#include "VectorOps.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace DunneCore;
+
+static void referenceAdd(float *dst, const float *src, size_t count)
+{
+    for (size_t i = 0; i < count; i++) dst[i] += src[i];
+}
+
+static void referenceAddReversed(float *dst, const float *src, size_t count)
+{
+    for (size_t i = 0; i < count; i++) dst[i] += src[count - 1 - i];
+}
+
+static void referenceScale(float *dst, float gain, size_t count)
+{
+    for (size_t i = 0; i < count; i++) dst[i] *= gain;
+}
+
+static void referenceConvertInt16(float *dst, const int16_t *src, float scale, size_t count)
+{
+    for (size_t i = 0; i < count; i++) dst[i] = scale * src[i];
+}
+
+static void referenceConvertInt24(float *dst, const uint8_t *src, float scale, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint8_t *p = src + 3 * i;
+        int32_t value = p[0] | p[1] << 8 | p[2] << 16;
+        if (value & 0x800000) value -= 0x1000000;
+        dst[i] = scale * value;
+    }
+}
+
+static void referenceDeinterleaveInt32(float *left, float *right, const int32_t *src, float scale, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        left[i] = scale * src[2 * i];
+        right[i] = scale * src[2 * i + 1];
+    }
+}
+
+// random 16-bit and packed 24-bit samples, extremes included
+static void fillIntegers(std::vector<int16_t> &v16, std::vector<uint8_t> &v24, unsigned seed)
+{
+    for (size_t i = 0; i < v16.size(); i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t value = i == 0 ? 0x800000 : i == 1 ? 0x7fffff : seed >> 8;
+        v16[i] = int16_t(value >> 8);
+        v24[3 * i] = uint8_t(value);
+        v24[3 * i + 1] = uint8_t(value >> 8);
+        v24[3 * i + 2] = uint8_t(value >> 16);
+    }
+}
+
+static void fill(std::vector<float> &v, unsigned seed)
+{
+    for (auto &x : v)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        x = float(seed >> 8) / float(1 << 24) - 0.5f;
+    }
+}
+
+static bool check()
+{
+    bool ok = true;
+    // odd sizes and offsets exercise the unaligned heads and scalar tails
+    for (size_t count : { 0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 31, 1023, 1024, 1025 })
+    {
+        for (size_t offset : { 0, 1, 3 })
+        {
+            std::vector<float> src(count + offset), a(count + offset), b(count + offset);
+            fill(src, unsigned(count) + 1);
+            fill(a, unsigned(count) + 2);
+            b = a;
+
+            vectorAdd(&a[offset], &src[offset], count);
+            referenceAdd(&b[offset], &src[offset], count);
+            ok = ok && a == b;
+
+            vectorAddReversed(&a[offset], &src[offset], count);
+            referenceAddReversed(&b[offset], &src[offset], count);
+            ok = ok && a == b;
+
+            vectorScale(&a[offset], 0.25f, count);
+            referenceScale(&b[offset], 0.25f, count);
+            ok = ok && a == b;
+
+            std::vector<float> r(src);
+            vectorReverse(&r[offset], count);
+            for (size_t i = 0; i < count; i++) ok = ok && r[offset + i] == src[offset + count - 1 - i];
+
+            vectorClear(&a[offset], count);
+            for (size_t i = 0; i < count; i++) ok = ok && a[offset + i] == 0.0f;
+
+            std::vector<int16_t> i16(count + offset);
+            std::vector<uint8_t> i24(3 * (count + offset));
+            fillIntegers(i16, i24, unsigned(count) + 3);
+            vectorConvertInt16(&a[offset], &i16[offset], 1.0f / 32768, count);
+            referenceConvertInt16(&b[offset], &i16[offset], 1.0f / 32768, count);
+            ok = ok && a == b;
+
+            vectorConvertInt24(&a[offset], &i24[3 * offset], 1.0f / 8388608, count);
+            referenceConvertInt24(&b[offset], &i24[3 * offset], 1.0f / 8388608, count);
+            ok = ok && a == b;
+
+            // 24-bit values, as WavPack unpacks them, with the extremes first
+            std::vector<int32_t> i32(2 * (count + offset));
+            for (size_t i = 0; i < i32.size(); i++) i32[i] = int24Value(&i24[3 * (i % (count + offset))]);
+            std::vector<float> ar(count + offset), br(count + offset);
+            vectorConvertInt32(&a[offset], &i32[offset], 1.0f / 8388608, count);
+            referenceConvertInt24(&b[offset], &i24[3 * offset], 1.0f / 8388608, count);
+            ok = ok && a == b;
+
+            vectorDeinterleaveInt32(&a[offset], &ar[offset], &i32[2 * offset], 1.0f / 8388608, count);
+            referenceDeinterleaveInt32(&b[offset], &br[offset], &i32[2 * offset], 1.0f / 8388608, count);
+            ok = ok && a == b && ar == br;
+
+            if (!ok)
+            {
+                fprintf(stderr, "vector ops (%s) mismatch at count %zu, offset %zu\n", vectorOpsBackend(), count, offset);
+                return false;
+            }
+        }
+    }
+    printf("vector ops (%s) match the reference loops\n", vectorOpsBackend());
+    return true;
+}
+
+template <typename Op>
+static double framesPerSecond(size_t count, Op op)
+{
+    const size_t totalFrames = 1 << 26;
+    size_t repeats = totalFrames / count;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < repeats; r++) op();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return double(repeats * count) / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    bool checkOnly = argc > 1 && strcmp(argv[1], "--check") == 0;
+    if (!check()) return 1;
+    if (checkOnly) return 0;
+
+    printf("%8s %14s %14s %14s %14s %14s %14s   (Mframes/s)\n", "frames",
+           "add", "add ref", "addRev", "addRev ref", "scale", "scale ref");
+    for (size_t count : { 16, 256, 1024, 4096 })
+    {
+        std::vector<float> src(count), dst(count);
+        fill(src, 1);
+        fill(dst, 2);
+        float *d = dst.data();
+        const float *s = src.data();
+
+        // keep values bounded so repeated adds don't overflow into infinities
+        double add = framesPerSecond(count, [&] { vectorAdd(d, s, count); vectorScale(d, 0.5f, count); });
+        double addRef = framesPerSecond(count, [&] { referenceAdd(d, s, count); referenceScale(d, 0.5f, count); });
+        double addRev = framesPerSecond(count, [&] { vectorAddReversed(d, s, count); vectorScale(d, 0.5f, count); });
+        double addRevRef = framesPerSecond(count, [&] { referenceAddReversed(d, s, count); referenceScale(d, 0.5f, count); });
+        // exact gains, so values neither drift into denormals nor overflow
+        double scale = 2.0 * framesPerSecond(count, [&] { vectorScale(d, 2.0f, count); vectorScale(d, 0.5f, count); });
+        double scaleRef = 2.0 * framesPerSecond(count, [&] { referenceScale(d, 2.0f, count); referenceScale(d, 0.5f, count); });
+
+        printf("%8zu %14.0f %14.0f %14.0f %14.0f %14.0f %14.0f\n", count,
+               add * 1e-6, addRef * 1e-6, addRev * 1e-6, addRevRef * 1e-6, scale * 1e-6, scaleRef * 1e-6);
+    }
+    printf("backend: %s (add and addRev columns include a scale pass)\n", vectorOpsBackend());
+
+    printf("\n%8s %14s %14s %14s %14s   (Mframes/s)\n", "frames", "int16", "int16 ref", "int24", "int24 ref");
+    for (size_t count : { 16, 256, 1024, 4096 })
+    {
+        std::vector<int16_t> i16(count);
+        std::vector<uint8_t> i24(3 * count);
+        std::vector<float> dst(count);
+        fillIntegers(i16, i24, 1);
+        float *d = dst.data();
+
+        double int16 = framesPerSecond(count, [&] { vectorConvertInt16(d, i16.data(), 1.0f / 32768, count); });
+        double int16Ref = framesPerSecond(count, [&] { referenceConvertInt16(d, i16.data(), 1.0f / 32768, count); });
+        double int24 = framesPerSecond(count, [&] { vectorConvertInt24(d, i24.data(), 1.0f / 8388608, count); });
+        double int24Ref = framesPerSecond(count, [&] { referenceConvertInt24(d, i24.data(), 1.0f / 8388608, count); });
+        printf("%8zu %14.0f %14.0f %14.0f %14.0f\n", count, int16 * 1e-6, int16Ref * 1e-6, int24 * 1e-6, int24Ref * 1e-6);
+    }
+
+    // WavPack's unpacked stereo into planar floats, as sample files load; MB/s of float output
+    printf("\n%8s %14s %14s   (MB/s)\n", "frames", "deinterleave", "deint ref");
+    for (size_t count : { 256, 4096, 16384 })
+    {
+        std::vector<int32_t> i32(2 * count);
+        for (size_t i = 0; i < i32.size(); i++) i32[i] = int32_t(i * 2654435761u) >> 8;
+        std::vector<float> left(count), right(count);
+        float *l = left.data(), *r = right.data();
+
+        const double bytesPerFrame = 2 * sizeof(float);
+        double deint = framesPerSecond(count, [&] { vectorDeinterleaveInt32(l, r, i32.data(), 1.0f / 8388608, count); });
+        double deintRef = framesPerSecond(count, [&] { referenceDeinterleaveInt32(l, r, i32.data(), 1.0f / 8388608, count); });
+        printf("%8zu %14.0f %14.0f\n", count, deint * bytesPerFrame * 1e-6, deintRef * bytesPerFrame * 1e-6);
+    }
+    return 0;
+}
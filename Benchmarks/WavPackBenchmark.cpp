@@ -0,0 +1,201 @@
+// Copyright AudioKit. All Rights Reserved.
+
+// Writes a corpus of WavPack files with the encoder, in every mode from fast to extra-high plus
+// hybrid lossy, as 16-, 24- and 32-bit integers and as floats, mono and stereo, and decodes each
+// twice: with the decoder's SIMD decorrelation loops and with its original scalar ones
+// (OPEN_NO_SIMD). The two must match exactly, and lossless files must give back what was written.
+// Then times decoding longer files in each mode both ways.
+//
+//   WavPackBenchmark [--check]
+//
+// The files are written to the working directory and removed afterwards. --check uses short files
+// and skips the timing (exit status 1 on mismatch), for use as a quick test.
+
+#include "wavpack.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+struct Mode
+{
+    const char *name;
+    int flags;
+};
+
+static const Mode modes[] = {
+    { "fast", CONFIG_FAST_FLAG },
+    { "normal", 0 },
+    { "high", CONFIG_HIGH_FLAG },
+    { "very high", CONFIG_HIGH_FLAG | CONFIG_VERY_HIGH_FLAG },
+    { "extra", CONFIG_HIGH_FLAG | CONFIG_EXTRA_MODE },
+    { "hybrid", CONFIG_HYBRID_FLAG },
+};
+
+struct Format
+{
+    const char *name;
+    int bits;
+    bool isFloat;
+};
+
+static const Format formats[] = {
+    { "16-bit", 16, false },
+    { "24-bit", 24, false },
+    { "32-bit", 32, false },
+    { "float", 32, true },
+};
+
+static const char *path = "WavPackBenchmark.wv";
+
+// a different kind of signal for each seed: tones, full-scale noise, clipped square waves, or quiet
+// bursts between stretches of silence
+static std::vector<int32_t> makeSignal(int kind, const Format &format, int channelCount, size_t frameCount)
+{
+    std::vector<int32_t> samples(frameCount * channelCount);
+    unsigned seed = 12345u + kind;
+    double fullScale = format.isFloat ? 1.0 : std::ldexp(1.0, format.bits - 1) - 1.0;
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        for (int c = 0; c < channelCount; c++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            double noise = (seed >> 8) / double(1 << 23) - 1.0;
+            double value;
+            switch (kind % 4)
+            {
+                case 0: value = 0.5 * sin(i * (0.01 + 0.002 * c)) + 0.3 * sin(i * 0.0007) + 0.01 * noise; break;
+                case 1: value = noise; break;
+                case 2: value = sin(i * 0.003 * (c + 1)) > 0.0 ? 1.0 : -1.0; break;
+                default: value = (i / 4800) % 3 == 0 ? 0.001 * noise * sin(i * 0.05) : 0.0; break;
+            }
+            value = std::max(-1.0, std::min(value * fullScale, fullScale));
+            if (format.isFloat)
+            {
+                float f = float(value);
+                memcpy(&samples[i * channelCount + c], &f, sizeof(f));
+            }
+            else
+                samples[i * channelCount + c] = int32_t(lrint(value));
+        }
+    }
+    return samples;
+}
+
+static int writeBlock(void *id, void *data, int32_t byteCount)
+{
+    return fwrite(data, 1, byteCount, (FILE *)id) == size_t(byteCount);
+}
+
+static bool writeFile(const Mode &mode, const Format &format, int channelCount, const std::vector<int32_t> &samples)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+
+    WavpackContext *wpc = WavpackOpenFileOutput(writeBlock, file, 0);
+    WavpackConfig config = {};
+    config.bits_per_sample = format.bits;
+    config.bytes_per_sample = format.bits / 8;
+    config.float_norm_exp = format.isFloat ? 127 : 0;
+    config.num_channels = channelCount;
+    config.channel_mask = channelCount == 1 ? 4 : 3;
+    config.sample_rate = 48000;
+    config.flags = mode.flags;
+    config.bitrate = 3.0f;                      // bits per sample, hybrid mode only
+    if (mode.flags & CONFIG_EXTRA_MODE) config.xmode = 3;
+
+    uint32_t frameCount = uint32_t(samples.size() / channelCount);
+    bool ok = WavpackSetConfiguration64(wpc, &config, frameCount, 0) && WavpackPackInit(wpc) &&
+              WavpackPackSamples(wpc, const_cast<int32_t *>(samples.data()), frameCount) && WavpackFlushSamples(wpc);
+    WavpackCloseFile(wpc);
+    return (fclose(file) == 0) && ok;
+}
+
+// decode the whole file in uneven pieces, some too short for the SIMD loops; false on any error
+static bool readFile(int flags, std::vector<int32_t> &samples, double *seconds = 0)
+{
+    char errorMessage[100];
+    WavpackContext *wpc = WavpackOpenFileInput(path, errorMessage, flags, 0);
+    if (wpc == 0) return false;
+    int channelCount = WavpackGetNumChannels(wpc);
+    uint32_t frameCount = uint32_t(WavpackGetNumSamples64(wpc));
+    samples.assign(size_t(frameCount) * channelCount, 0);
+
+    static const uint32_t pieces[] = { 7, 4099, 15, 16, 17, 30011 };
+    auto start = std::chrono::steady_clock::now();
+    uint32_t done = 0;
+    for (int i = 0; done < frameCount; i++)
+    {
+        uint32_t count = std::min(pieces[i % 6], frameCount - done);
+        if (WavpackUnpackSamples(wpc, &samples[size_t(done) * channelCount], count) != count) break;
+        done += count;
+    }
+    if (seconds) *seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    bool ok = done == frameCount && WavpackGetNumErrors(wpc) == 0;
+    WavpackCloseFile(wpc);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bool check = argc > 1 && strcmp(argv[1], "--check") == 0;
+    if (argc > 2 || (argc == 2 && !check))
+    {
+        fprintf(stderr, "usage: WavPackBenchmark [--check]\n");
+        return 1;
+    }
+
+    // the corpus: every mode, format and channel count, each with the next kind of signal
+    int failures = 0, fileCount = 0, kind = 0;
+    for (const Mode &mode : modes)
+        for (const Format &format : formats)
+            for (int channelCount = 1; channelCount <= 2; channelCount++)
+            {
+                std::vector<int32_t> original = makeSignal(kind++, format, channelCount, check ? 20000 : 100000);
+                std::vector<int32_t> simd, scalar;
+                bool lossless = !(mode.flags & CONFIG_HYBRID_FLAG);
+                bool ok = writeFile(mode, format, channelCount, original) &&
+                          readFile(0, simd) && readFile(OPEN_NO_SIMD, scalar) &&
+                          simd == scalar && (!lossless || simd == original);
+                if (!ok)
+                {
+                    fprintf(stderr, "%s %s %s: SIMD and C decodes differ, or do not match the original\n",
+                            mode.name, format.name, channelCount == 1 ? "mono" : "stereo");
+                    failures++;
+                }
+                fileCount++;
+            }
+    printf("%d of %d files decoded identically with and without SIMD\n", fileCount - failures, fileCount);
+
+    // ten seconds of tones, mono and stereo, decoded a few times each way
+    if (!check && failures == 0)
+    {
+        const Format &format = formats[1];
+        printf("24-bit     %12s %12s %12s %12s\n", "mono C", "mono SIMD", "stereo C", "stereo SIMD");
+        for (const Mode &mode : modes)
+        {
+            printf("%-10s", mode.name);
+            for (int channelCount = 1; channelCount <= 2; channelCount++)
+            {
+                std::vector<int32_t> original = makeSignal(0, format, channelCount, 480000), decoded;
+                if (!writeFile(mode, format, channelCount, original)) failures++;
+                double best[2] = { 1e9, 1e9 };
+                for (int run = 0; run < 6; run++)
+                {
+                    double seconds;
+                    if (!readFile(run % 2 ? 0 : OPEN_NO_SIMD, decoded, &seconds)) failures++;
+                    best[run % 2] = std::min(best[run % 2], seconds);
+                }
+                double megabytes = original.size() * sizeof(float) / 1048576.0;
+                printf(" %7.0f MB/s %7.0f MB/s", megabytes / best[0], megabytes / best[1]);
+            }
+            printf("\n");
+        }
+    }
+
+    remove(path);
+    return failures == 0 ? 0 : 1;
+}
@@ -2,6 +2,20 @@
 // The swift-tools-version declares the minimum version of Swift required to build this package.
 
 import PackageDescription
+import Foundation
+
+// RubberBand's FFT uses Accelerate by default. Set DUNNEAUDIOKIT_FFT=kissfft (the KissFFT package
+// below) or DUNNEAUDIOKIT_FFT=builtin when building to compare.
+let fftSettings: [CXXSetting] = {
+    switch ProcessInfo.processInfo.environment["DUNNEAUDIOKIT_FFT"] {
+    case "kissfft":
+        return [.define("USE_KISSFFT"), .define("FFT_DEFAULT_IMPLEMENTATION", to: "\"kissfft\"")]
+    case "builtin":
+        return [.define("USE_BUILTIN_FFT"), .define("FFT_DEFAULT_IMPLEMENTATION", to: "\"cross\"")]
+    default:
+        return []
+    }
+}()
 
 let package = Package(
     name: "DunneAudioKit",
@@ -22,7 +36,7 @@ let package = Package(
                 "DunneCore/Sampler/README.md",
                 "DunneCore/README.md",
             ],
-            cxxSettings: [.headerSearchPath("DunneCore/Common")]),
+            cxxSettings: [.headerSearchPath("DunneCore/Common")] + fftSettings),
         .testTarget(name: "DunneAudioKitTests", dependencies: ["DunneAudioKit"], resources: [.copy("TestResources/")]),
     ],
     cxxLanguageStandard: .cxx14
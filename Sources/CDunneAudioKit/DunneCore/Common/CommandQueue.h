@@ -0,0 +1,46 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#pragma once
+#include <atomic>
+
+namespace DunneCore
+{
+    // A fixed-size, lock-free FIFO for passing small trivially-copyable commands from one producer
+    // thread (e.g. the UI) to one consumer thread (e.g. the render thread). Neither push() nor pop()
+    // ever blocks or allocates; push() fails when the queue is full.
+    template <typename T, unsigned capacity>
+    class CommandQueue
+    {
+        static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "capacity must be a power of 2");
+
+    public:
+        // producer only
+        bool push(const T &command)
+        {
+            unsigned tail = writeIndex.load(std::memory_order_relaxed);
+            if (tail - readIndex.load(std::memory_order_acquire) == capacity) return false;
+            slots[tail & (capacity - 1)] = command;
+            writeIndex.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer only
+        bool pop(T &command)
+        {
+            unsigned head = readIndex.load(std::memory_order_relaxed);
+            if (head == writeIndex.load(std::memory_order_acquire)) return false;
+            command = slots[head & (capacity - 1)];
+            readIndex.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        // indices count up forever (wrapping); padded apart so the two threads don't contend for
+        // one cache line
+        std::atomic<unsigned> writeIndex { 0 };
+        char padding1[64 - sizeof(std::atomic<unsigned>)];
+        std::atomic<unsigned> readIndex { 0 };
+        char padding2[64 - sizeof(std::atomic<unsigned>)];
+        T slots[capacity];
+    };
+}
@@ -0,0 +1,183 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#include "RenderThreadPool.h"
+#include <chrono>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#define RENDERTHREADPOOL_PAUSE() _mm_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define RENDERTHREADPOOL_PAUSE() __asm__ __volatile__("yield")
+#else
+#define RENDERTHREADPOOL_PAUSE() ((void)0)
+#endif
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#endif
+
+namespace DunneCore
+{
+    // idle workers spin this many times, then yield for a while, then nap between checks
+    static const int spinCount = 2000;
+    static const auto yieldTime = std::chrono::milliseconds(50);
+    static const auto napTime = std::chrono::microseconds(500);
+
+    // run()'s caller: note its scheduling policy and priority for the workers to take on, so they
+    // are never preferred over the render thread they help (nor left behind it). Apple's audio
+    // threads are time-constrained, which their POSIX priority doesn't show, so copy that policy.
+    void RenderThreadPool::publishCallerScheduling()
+    {
+#if defined(__APPLE__)
+        thread_time_constraint_policy_data_t constraint = {};
+        mach_msg_type_number_t count = THREAD_TIME_CONSTRAINT_POLICY_COUNT;
+        boolean_t isDefault = FALSE;
+        bool timeConstrained = thread_policy_get(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY,
+                                                 (thread_policy_t)&constraint, &count, &isDefault) == KERN_SUCCESS && !isDefault;
+        callerPeriod.store(constraint.period, std::memory_order_relaxed);
+        callerComputation.store(constraint.computation, std::memory_order_relaxed);
+        callerConstraint.store(constraint.constraint, std::memory_order_relaxed);
+        callerPreemptible.store(constraint.preemptible, std::memory_order_relaxed);
+        callerTimeConstrained.store(timeConstrained, std::memory_order_relaxed);
+#endif
+#if defined(__APPLE__) || defined(__linux__)
+        int policy;
+        sched_param param = {};
+        if (pthread_getschedparam(pthread_self(), &policy, &param) == 0)
+        {
+            callerPolicy.store(policy, std::memory_order_relaxed);
+            callerPriority.store(param.sched_priority, std::memory_order_relaxed);
+        }
+#endif
+        callerThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+        schedulingGeneration.fetch_add(1, std::memory_order_release);
+    }
+
+    // worker: take on what publishCallerScheduling() noted
+    void RenderThreadPool::adoptCallerScheduling()
+    {
+#if defined(__APPLE__)
+        if (callerTimeConstrained.load(std::memory_order_relaxed))
+        {
+            thread_time_constraint_policy_data_t constraint;
+            constraint.period = callerPeriod.load(std::memory_order_relaxed);
+            constraint.computation = callerComputation.load(std::memory_order_relaxed);
+            constraint.constraint = callerConstraint.load(std::memory_order_relaxed);
+            constraint.preemptible = callerPreemptible.load(std::memory_order_relaxed);
+            thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY,
+                              (thread_policy_t)&constraint, THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+            return;
+        }
+#endif
+#if defined(__APPLE__) || defined(__linux__)
+        sched_param param = {};
+        param.sched_priority = callerPriority.load(std::memory_order_relaxed);
+        pthread_setschedparam(pthread_self(), callerPolicy.load(std::memory_order_relaxed), &param);
+#endif
+    }
+
+    void RenderThreadPool::start(int count)
+    {
+        stop();
+        quit.store(false);
+        for (int i = 1; i < count; i++)
+            workers.emplace_back([this] { workerLoop(); });
+        threadCount.store(int(workers.size()) + 1, std::memory_order_relaxed);
+    }
+
+    void RenderThreadPool::stop()
+    {
+        threadCount.store(1, std::memory_order_relaxed);
+        quit.store(true);
+        for (auto &worker : workers) worker.join();
+        workers.clear();
+    }
+
+    // ticket layout: generation in bits 32-63, task count in bits 16-31, next task in bits 0-15
+    static inline uint32_t ticketGeneration(uint64_t ticket) { return uint32_t(ticket >> 32); }
+    static inline int ticketCount(uint64_t ticket) { return int((ticket >> 16) & 0xffff); }
+    static inline int ticketNext(uint64_t ticket) { return int(ticket & 0xffff); }
+
+    void RenderThreadPool::run(TaskFunction task, void *context, int count)
+    {
+        if (count <= 0) return;
+        if (count > 0xffff) count = 0xffff;
+        if (callerThread.load(std::memory_order_relaxed) != std::this_thread::get_id()) publishCallerScheduling();
+        uint32_t generation = ticketGeneration(ticket.load(std::memory_order_relaxed)) + 1;
+        taskFunction.store(task, std::memory_order_relaxed);
+        taskContext.store(context, std::memory_order_relaxed);
+        tasksPending.store(count, std::memory_order_relaxed);
+        ticket.store((uint64_t(generation) << 32) | (uint64_t(count) << 16), std::memory_order_release);
+
+        // a worker still busy on a task may have been preempted (e.g. fewer cores than threads),
+        // so stop spinning after a while and let it finish
+        runTasks(generation);
+        for (int spins = 0; tasksPending.load(std::memory_order_acquire) > 0; spins++)
+        {
+            if (spins < spinCount) RENDERTHREADPOOL_PAUSE();
+            else std::this_thread::yield();
+        }
+    }
+
+    void RenderThreadPool::runTasks(uint32_t generation)
+    {
+        uint64_t current = ticket.load(std::memory_order_acquire);
+        if (ticketGeneration(current) != generation) return;
+
+        // if this generation finished since the ticket was read, the fields may belong to a later
+        // one; but then the ticket has moved on too and every claim below fails, so a claimed task
+        // always runs with its own generation's fields
+        TaskFunction task = taskFunction.load(std::memory_order_relaxed);
+        void *context = taskContext.load(std::memory_order_relaxed);
+        while (ticketGeneration(current) == generation && ticketNext(current) < ticketCount(current))
+        {
+            if (ticket.compare_exchange_weak(current, current + 1, std::memory_order_acquire))
+            {
+                task(context, ticketNext(current));
+                tasksPending.fetch_sub(1, std::memory_order_release);
+                current = ticket.load(std::memory_order_acquire);
+            }
+        }
+    }
+
+    void RenderThreadPool::workerLoop()
+    {
+        uint32_t lastGeneration = ticketGeneration(ticket.load(std::memory_order_acquire));
+        uint32_t lastScheduling = 0;
+        int spins = 0;
+        auto idleSince = std::chrono::steady_clock::now();
+        while (!quit.load(std::memory_order_relaxed))
+        {
+            uint32_t scheduling = schedulingGeneration.load(std::memory_order_acquire);
+            if (scheduling != lastScheduling)
+            {
+                lastScheduling = scheduling;
+                adoptCallerScheduling();
+            }
+
+            uint32_t generation = ticketGeneration(ticket.load(std::memory_order_acquire));
+            if (generation != lastGeneration)
+            {
+                lastGeneration = generation;
+                runTasks(generation);
+                spins = 0;
+                idleSince = std::chrono::steady_clock::now();
+            }
+            else if (spins < spinCount)
+            {
+                spins++;
+                RENDERTHREADPOOL_PAUSE();
+            }
+            else if (std::chrono::steady_clock::now() - idleSince < yieldTime)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(napTime);
+        }
+    }
+}
@@ -0,0 +1,68 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace DunneCore
+{
+    // A fixed pool of worker threads that help the render thread through a list of independent
+    // tasks, e.g. one per active voice, once per render chunk.
+    //
+    // run() never locks or allocates: tasks are claimed from an atomic ticket, the calling thread
+    // claims them too, and it spins until every task is done. A worker that is late to wake simply
+    // finds nothing left to do, so the render thread never waits on a descheduled worker, only
+    // on tasks already in progress. Workers take on the scheduling of the thread calling run()
+    // (on Apple platforms, its time-constraint policy): run() publishes it when a new thread calls,
+    // and each worker applies it to itself, so run() never touches the workers start() and stop()
+    // manage. Idle workers spin, then yield, then nap, so an idle pool costs little; start() and
+    // stop() are not realtime-safe, but may be called from a control thread while another runs.
+    class RenderThreadPool
+    {
+    public:
+        typedef void (*TaskFunction)(void *context, int taskIndex);
+
+        RenderThreadPool() {}
+        ~RenderThreadPool() { stop(); }
+
+        // count includes the thread calling run(), so this starts count - 1 workers
+        void start(int count);
+        void stop();
+
+        // number of threads run() spreads tasks over, including the caller; 1 if stopped
+        int getThreadCount() const { return threadCount.load(std::memory_order_relaxed); }
+
+        // calls task(context, i) for every i in [0, taskCount) and returns when all are done;
+        // at most 65535 tasks per run
+        void run(TaskFunction task, void *context, int taskCount);
+
+    private:
+        void workerLoop();
+        void runTasks(uint32_t generation);
+        void publishCallerScheduling();
+        void adoptCallerScheduling();
+
+        // control thread only
+        std::vector<std::thread> workers;
+        std::atomic<bool> quit { false };
+        std::atomic<int> threadCount { 1 };
+
+        // the scheduling of the thread last calling run(), which workers take on whenever the
+        // generation moves on; fields are read one by one, but a worker reading a mix of two
+        // callers' sees the generation move again and rereads
+        std::atomic<std::thread::id> callerThread { std::thread::id() };
+        std::atomic<uint32_t> schedulingGeneration { 0 };
+        std::atomic<int> callerPolicy { 0 }, callerPriority { 0 };
+        std::atomic<bool> callerTimeConstrained { false };
+        std::atomic<uint32_t> callerPeriod { 0 }, callerComputation { 0 }, callerConstraint { 0 };
+        std::atomic<bool> callerPreemptible { true };
+
+        // the current run's generation, task count and next unclaimed task, swapped atomically
+        std::atomic<uint64_t> ticket { 0 };
+        std::atomic<TaskFunction> taskFunction { nullptr };
+        std::atomic<void *> taskContext { nullptr };
+        std::atomic<int> tasksPending { 0 };
+    };
+}
@@ -0,0 +1,302 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Portable float vector operations used by the DunneCore DSP modules, plus the integer-to-float
+// conversions used to play compactly stored samples.
+//
+// Backend is chosen at compile time: Accelerate (vDSP) on Apple platforms, otherwise AVX2, SSE2
+// or NEON intrinsics when the target supports them, otherwise plain loops. Define
+// DUNNECORE_VECTOROPS_PORTABLE to skip vDSP on Apple, or DUNNECORE_VECTOROPS_SCALAR to force
+// the plain loops everywhere (e.g. to compare results).
+
+#if defined(DUNNECORE_VECTOROPS_SCALAR)
+#define DUNNECORE_VECTOROPS_BACKEND "scalar"
+#elif defined(__APPLE__) && !defined(DUNNECORE_VECTOROPS_PORTABLE)
+#define DUNNECORE_VECTOROPS_VDSP 1
+#define DUNNECORE_VECTOROPS_BACKEND "vDSP"
+#include <Accelerate/Accelerate.h>
+#elif defined(__AVX2__)
+#define DUNNECORE_VECTOROPS_AVX2 1
+#define DUNNECORE_VECTOROPS_BACKEND "AVX2"
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DUNNECORE_VECTOROPS_SSE 1
+#define DUNNECORE_VECTOROPS_BACKEND "SSE2"
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DUNNECORE_VECTOROPS_NEON 1
+#define DUNNECORE_VECTOROPS_BACKEND "NEON"
+#include <arm_neon.h>
+#else
+#define DUNNECORE_VECTOROPS_BACKEND "scalar"
+#endif
+
+namespace DunneCore
+{
+    // name of the backend compiled in, for benchmarks and diagnostics
+    inline const char *vectorOpsBackend() { return DUNNECORE_VECTOROPS_BACKEND; }
+
+    // dst[i] = 0
+    inline void vectorClear(float *dst, size_t count)
+    {
+#if defined DUNNECORE_VECTOROPS_VDSP
+        vDSP_vclr(dst, 1, vDSP_Length(count));
+#else
+        memset(dst, 0, count * sizeof(float));
+#endif
+    }
+
+    // dst[i] += src[i]
+    inline void vectorAdd(float *dst, const float *src, size_t count)
+    {
+        size_t i = 0;
+#if defined DUNNECORE_VECTOROPS_VDSP
+        vDSP_vadd(dst, 1, src, 1, dst, 1, vDSP_Length(count));
+        i = count;
+#elif defined DUNNECORE_VECTOROPS_AVX2
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+#elif defined DUNNECORE_VECTOROPS_SSE
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+#elif defined DUNNECORE_VECTOROPS_NEON
+        for (; i + 4 <= count; i += 4)
+            vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), vld1q_f32(src + i)));
+#endif
+        for (; i < count; i++) dst[i] += src[i];
+    }
+
+    // dst[i] += src[count - 1 - i], i.e. add src[0..count) read backwards
+    inline void vectorAddReversed(float *dst, const float *src, size_t count)
+    {
+        size_t i = 0;
+#if defined DUNNECORE_VECTOROPS_VDSP
+        // vDSP addresses negative strides from the last element
+        if (count > 0) vDSP_vadd(dst, 1, src + count - 1, -1, dst, 1, vDSP_Length(count));
+        i = count;
+#elif defined DUNNECORE_VECTOROPS_AVX2
+        const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 s = _mm256_permutevar8x32_ps(_mm256_loadu_ps(src + count - i - 8), reverse);
+            _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), s));
+        }
+#elif defined DUNNECORE_VECTOROPS_SSE
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 s = _mm_loadu_ps(src + count - i - 4);
+            s = _mm_shuffle_ps(s, s, _MM_SHUFFLE(0, 1, 2, 3));
+            _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), s));
+        }
+#elif defined DUNNECORE_VECTOROPS_NEON
+        for (; i + 4 <= count; i += 4)
+        {
+            float32x4_t s = vrev64q_f32(vld1q_f32(src + count - i - 4));
+            s = vcombine_f32(vget_high_f32(s), vget_low_f32(s));
+            vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), s));
+        }
+#endif
+        for (; i < count; i++) dst[i] += src[count - 1 - i];
+    }
+
+    // dst[i] *= gain
+    inline void vectorScale(float *dst, float gain, size_t count)
+    {
+        size_t i = 0;
+#if defined DUNNECORE_VECTOROPS_VDSP
+        vDSP_vsmul(dst, 1, &gain, dst, 1, vDSP_Length(count));
+        i = count;
+#elif defined DUNNECORE_VECTOROPS_AVX2
+        const __m256 g = _mm256_set1_ps(gain);
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(dst + i), g));
+#elif defined DUNNECORE_VECTOROPS_SSE
+        const __m128 g = _mm_set1_ps(gain);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(dst + i), g));
+#elif defined DUNNECORE_VECTOROPS_NEON
+        const float32x4_t g = vdupq_n_f32(gain);
+        for (; i + 4 <= count; i += 4)
+            vst1q_f32(dst + i, vmulq_f32(vld1q_f32(dst + i), g));
+#endif
+        for (; i < count; i++) dst[i] *= gain;
+    }
+
+    // reverse v[0..count) in place
+    inline void vectorReverse(float *v, size_t count)
+    {
+#if defined DUNNECORE_VECTOROPS_VDSP
+        vDSP_vrvrs(v, 1, vDSP_Length(count));
+#else
+        for (size_t i = 0, j = count; i + 1 < j; i++)
+        {
+            j--;
+            float t = v[i];
+            v[i] = v[j];
+            v[j] = t;
+        }
+#endif
+    }
+
+    // dst[i] = scale * src[i], for 16-bit samples
+    inline void vectorConvertInt16(float *dst, const int16_t *src, float scale, size_t count)
+    {
+        size_t i = 0;
+#if defined DUNNECORE_VECTOROPS_VDSP
+        vDSP_vflt16(src, 1, dst, 1, vDSP_Length(count));
+        vDSP_vsmul(dst, 1, &scale, dst, 1, vDSP_Length(count));
+        i = count;
+#elif defined DUNNECORE_VECTOROPS_AVX2
+        const __m256 g = _mm256_set1_ps(scale);
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), g));
+        }
+#elif defined DUNNECORE_VECTOROPS_SSE
+        const __m128 g = _mm_set1_ps(scale);
+        for (; i + 8 <= count; i += 8)
+        {
+            // widen by pairing each sample with itself, then shifting the copy out with sign extension
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), g));
+            _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), g));
+        }
+#elif defined DUNNECORE_VECTOROPS_NEON
+        const float32x4_t g = vdupq_n_f32(scale);
+        for (; i + 8 <= count; i += 8)
+        {
+            int16x8_t v = vld1q_s16(src + i);
+            vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), g));
+            vst1q_f32(dst + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), g));
+        }
+#endif
+        for (; i < count; i++) dst[i] = scale * src[i];
+    }
+
+    // dst[i] = scale * src[i], for 32-bit integer samples
+    inline void vectorConvertInt32(float *dst, const int32_t *src, float scale, size_t count)
+    {
+        size_t i = 0;
+#if defined DUNNECORE_VECTOROPS_VDSP
+        vDSP_vflt32(src, 1, dst, 1, vDSP_Length(count));
+        vDSP_vsmul(dst, 1, &scale, dst, 1, vDSP_Length(count));
+        i = count;
+#elif defined DUNNECORE_VECTOROPS_AVX2
+        const __m256 g = _mm256_set1_ps(scale);
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(src + i))), g));
+#elif defined DUNNECORE_VECTOROPS_SSE
+        const __m128 g = _mm_set1_ps(scale);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + i))), g));
+#elif defined DUNNECORE_VECTOROPS_NEON
+        const float32x4_t g = vdupq_n_f32(scale);
+        for (; i + 4 <= count; i += 4)
+            vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(vld1q_s32(src + i)), g));
+#endif
+        for (; i < count; i++) dst[i] = scale * src[i];
+    }
+
+    // left[i] = scale * src[2i], right[i] = scale * src[2i + 1]: interleaved stereo 32-bit integer
+    // samples to planar floats, in one pass
+    inline void vectorDeinterleaveInt32(float *left, float *right, const int32_t *src, float scale, size_t count)
+    {
+        size_t i = 0;
+#if defined DUNNECORE_VECTOROPS_VDSP
+        vDSP_vflt32(src, 2, left, 1, vDSP_Length(count));
+        vDSP_vflt32(src + 1, 2, right, 1, vDSP_Length(count));
+        vDSP_vsmul(left, 1, &scale, left, 1, vDSP_Length(count));
+        vDSP_vsmul(right, 1, &scale, right, 1, vDSP_Length(count));
+        i = count;
+#elif defined DUNNECORE_VECTOROPS_AVX2
+        // shuffle_ps pairs up the lanes' left and right samples out of order (0 1 4 5 | 2 3 6 7),
+        // and a 64-bit permute puts them back in order
+        const __m256 g = _mm256_set1_ps(scale);
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 a = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(src + 2 * i))), g);
+            __m256 b = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(src + 2 * i + 8))), g);
+            __m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            __m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm256_storeu_ps(left + i, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0))));
+            _mm256_storeu_ps(right + i, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0))));
+        }
+#elif defined DUNNECORE_VECTOROPS_SSE
+        const __m128 g = _mm_set1_ps(scale);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + 2 * i))), g);
+            __m128 b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + 2 * i + 4))), g);
+            _mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+#elif defined DUNNECORE_VECTOROPS_NEON
+        const float32x4_t g = vdupq_n_f32(scale);
+        for (; i + 4 <= count; i += 4)
+        {
+            int32x4x2_t v = vld2q_s32(src + 2 * i);
+            vst1q_f32(left + i, vmulq_f32(vcvtq_f32_s32(v.val[0]), g));
+            vst1q_f32(right + i, vmulq_f32(vcvtq_f32_s32(v.val[1]), g));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            left[i] = scale * src[2 * i];
+            right[i] = scale * src[2 * i + 1];
+        }
+    }
+
+    // one packed little-endian 24-bit sample, sign-extended
+    inline int32_t int24Value(const uint8_t *p)
+    {
+        return int32_t(uint32_t(p[0]) << 8 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 24) >> 8;
+    }
+
+    // dst[i] = scale * src[i], for packed 24-bit samples (3 bytes each)
+    inline void vectorConvertInt24(float *dst, const uint8_t *src, float scale, size_t count)
+    {
+        size_t i = 0;
+#if defined DUNNECORE_VECTOROPS_VDSP
+        vDSP_vflt24((const vDSP_int24 *)src, 1, dst, 1, vDSP_Length(count));
+        vDSP_vsmul(dst, 1, &scale, dst, 1, vDSP_Length(count));
+        i = count;
+#elif defined DUNNECORE_VECTOROPS_AVX2
+        // each 128-bit lane loads 16 bytes and places four samples in the top three bytes of each
+        // 32-bit slot, so an arithmetic shift sign-extends them; the loads reach 4 bytes past the
+        // 8 samples converted, hence stopping 2 samples early
+        const __m256i spread = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                                -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+        const __m256 g = _mm256_set1_ps(scale);
+        for (; i + 10 <= count; i += 8)
+        {
+            const uint8_t *p = src + 3 * i;
+            __m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                                                    _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+            __m256i v = _mm256_srai_epi32(_mm256_shuffle_epi8(bytes, spread), 8);
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), g));
+        }
+#elif defined DUNNECORE_VECTOROPS_NEON
+        const float32x4_t g = vdupq_n_f32(scale);
+        for (; i + 8 <= count; i += 8)
+        {
+            // de-interleave the bytes of 8 samples, then rebuild each sample in the top of a 32-bit slot
+            uint8x8x3_t b = vld3_u8(src + 3 * i);
+            uint16x8_t low = vshll_n_u8(b.val[0], 8);
+            uint16x8_t high = vorrq_u16(vmovl_u8(b.val[1]), vshll_n_u8(b.val[2], 8));
+            int32x4_t v0 = vreinterpretq_s32_u32(vorrq_u32(vmovl_u16(vget_low_u16(low)), vshll_n_u16(vget_low_u16(high), 16)));
+            int32x4_t v1 = vreinterpretq_s32_u32(vorrq_u32(vmovl_u16(vget_high_u16(low)), vshll_n_u16(vget_high_u16(high), 16)));
+            vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(vshrq_n_s32(v0, 8)), g));
+            vst1q_f32(dst + i + 4, vmulq_f32(vcvtq_f32_s32(vshrq_n_s32(v1, 8)), g));
+        }
+#endif
+        for (; i < count; i++) dst[i] = scale * int24Value(src + 3 * i);
+    }
+
+}
@@ -315,6 +315,7 @@ WavpackContext *WavpackOpenFileInput (const char *infilename, char *error, int f
 #define OPEN_ALT_TYPES  0x400   // application is aware of alternate file types & qmode
                                 // (just affects retrieving wrappers & MD5 checksums)
 #define OPEN_NO_CHECKSUM 0x800  // don't verify block checksums before decoding
+#define OPEN_NO_SIMD    0x1000  // decode with the original scalar loops only (for checking the others)
 
 int WavpackGetMode (WavpackContext *wpc);
 
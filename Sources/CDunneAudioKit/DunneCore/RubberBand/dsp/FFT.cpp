@@ -21,7 +21,17 @@
     you must obtain a valid commercial licence before doing so.
 */
 
+// FFT backends are chosen by the build: define any of USE_KISSFFT, USE_BUILTIN_FFT or HAVE_FFTW3
+// (several may be compiled in side by side, see getImplementations()), and optionally
+// FFT_DEFAULT_IMPLEMENTATION to the name of the one to use by default. With none selected,
+// Accelerate is used on Apple platforms and the built-in implementation elsewhere.
+#if !defined(HAVE_IPP) && !defined(HAVE_FFTW3) && !defined(USE_KISSFFT) && !defined(USE_BUILTIN_FFT) && !defined(HAVE_VDSP) && !defined(HAVE_MEDIALIB) && !defined(HAVE_OPENMAX) && !defined(HAVE_SFFT)
+#if defined(__APPLE__)
 #define HAVE_VDSP 1
+#else
+#define USE_BUILTIN_FFT 1
+#endif
+#endif
 
 #include "FFT.h"
 #include "../system/Thread.h"
@@ -64,7 +74,7 @@ extern "C" {
 #endif
 
 #ifdef USE_KISSFFT
-#include "kissfft/kiss_fftr.h"
+#include "kiss_fftr.h"
 #endif
 
 #ifndef HAVE_IPP
@@ -3137,6 +3147,9 @@ FFT::pickDefaultImplementation()
     if (impls.find("fftw") != impls.end()) best = "fftw";
     if (impls.find("vdsp") != impls.end()) best = "vdsp";
     if (impls.find("ipp") != impls.end()) best = "ipp";
+#ifdef FFT_DEFAULT_IMPLEMENTATION
+    if (impls.find(FFT_DEFAULT_IMPLEMENTATION) != impls.end()) best = FFT_DEFAULT_IMPLEMENTATION;
+#endif
     
     m_implementation = best;
 }
@@ -63,8 +63,14 @@
 /* define balanced samplerate convertor */
 #define ENABLE_SINC_MEDIUM_CONVERTER
 
-/* define best samplerate convertor */
+/* define best samplerate convertor, when its (large) coefficient table is present */
+#if defined(__has_include)
+#if __has_include("high_qual_coeffs.h")
 #define ENABLE_SINC_BEST_CONVERTER
+#endif
+#else
+#define ENABLE_SINC_BEST_CONVERTER
+#endif
 
 /* The size of `int', as computed by sizeof. */
 #define SIZEOF_INT 
@@ -2,12 +2,28 @@
 
 #include "CoreSampler.h"
 #include "SamplerVoice.h"
+#include "SampleMixCache.h"
+#include "SampleStream.h"
+#include "SampleStore.h"
+#include "SampleStretchCache.h"
+#include "SampleKeyMap.h"
+#include "SFZFile.h"
 #include "FunctionTable.h"
 #include "SustainPedalLogic.h"
+#include "RenderThreadPool.h"
+#include "CommandQueue.h"
+#include "VectorOps.h"
 
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
 #include <list>
-#include <map>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
 
 // number of voices
 #define MAX_POLYPHONY 64
@@ -18,13 +34,66 @@
 // Convert MIDI note to Hz, for 12-tone equal temperament
 #define NOTE_HZ(midiNoteNumber) ( 440.0f * pow(2.0f, ((midiNoteNumber) - 69.0f)/12.0f) )
 
+// number of post...() calls that can wait for the next render chunk
+#define COMMAND_QUEUE_SIZE 256
+
+// most threads loadCompressedSampleFiles() decodes on; beyond this the disk is usually the limit
+#define SAMPLELOAD_MAX_THREADS 8
+
+// a call queued by one of the post...() functions; plain data, so queueing it only copies bytes
+struct SamplerCommand
+{
+    enum Type { kPrepareNote, kPlay, kStopNote, kSustainPedal, kSetter, kStopAllVoices, kRestartVoices, kAllNotesOff };
+    Type type = kPlay;
+    unsigned noteNumber = 0, velocity = 0;
+    bool flag = false;      // stopNote's immediate, sustainPedal's down
+    int64_t sampleTime = 0;
+    int64_t due = CORESAMPLER_NOW;      // the frame to carry it out on
+    uint64_t ticket = 0;    // stopAllVoices' ticket
+    void (CoreSampler::*setter)(float) = nullptr;
+    float value = 0.0f;
+
+    // prepareNote's loop, with copies of its arrays
+    LoopDescriptor loop = {};
+    unsigned enabledTracks[SAMPLEBUFFER_RESERVED_LOOP_ENTRIES] = {};
+    unsigned mutedStartPoints[SAMPLEBUFFER_RESERVED_LOOP_ENTRIES] = {};
+    unsigned mutedEndPoints[SAMPLEBUFFER_RESERVED_LOOP_ENTRIES] = {};
+};
+
+// a sample file decoded (or found in the store) and opened for streaming, but not yet added to a sampler
+struct DecodedSampleFile
+{
+    const DunneCore::SampleStoreEntry *entry = 0;
+    DunneCore::WavPackSampleStream *stream = 0;     // only if some of it is left on disk
+};
+
 struct CoreSampler::InternalData {
     // list of (pointers to) all loaded samples
     std::list<DunneCore::KeyMappedSampleBuffer*> sampleBufferList;
     
-    // maps MIDI note numbers to "closest" samples (all velocity layers)
-    std::list<DunneCore::KeyMappedSampleBuffer*> keyMap[MIDI_NOTENUMBERS];
-    std::map<unsigned, DunneCore::SampleBufferGroup> sampleBufferGroups;
+    // maps MIDI note numbers to "closest" samples (all velocity layers), and notes and velocities to
+    // the layers which play
+    DunneCore::SampleKeyMap keyMap;
+    
+    // prepared mixes of multi-track and reversed groups, shared by all voices
+    DunneCore::SampleMixCache mixCache;
+
+    // loops baked at a steady speed and pitch, shared by all voices
+    DunneCore::SampleStretchCache stretchCache;
+
+    // read-ahead for samples streamed from disk, and how much of each loadCompressedSampleFile() keeps
+    // in memory (0 means all of it)
+    DunneCore::SampleStreamRingPool streamPool;
+    size_t streamHeadFrames = 0;
+
+    // how loadCompressedSampleFile() stores what it decodes
+    SampleStorageFormat storageFormat = SampleStorageFloat32;
+
+    // how voices read the stretched samples of notes started afterwards
+    SampleInterpolation interpolation = SampleInterpolationNone;
+
+    // whether samples loaded afterwards get octave pyramids, for voices which interpolate
+    bool buildsPyramids = false;
     
     DunneCore::AHDSHREnvelopeParameters ampEnvelopeParameters;
     DunneCore::ADSREnvelopeParameters filterEnvelopeParameters;
@@ -33,17 +102,387 @@ struct CoreSampler::InternalData {
     // table of voice resources
     DunneCore::SamplerVoice voice[MAX_POLYPHONY];
     
-    // one vibrato LFO shared by all voices
+    // one vibrato LFO shared by all voices, and its value for the current render chunk
     DunneCore::FunctionTableOscillator vibratoLFO;
+    float vibratoSample = 0.0f;
     
     DunneCore::SustainPedalLogic pedalLogic;
     
-    std::list<DunneCore::SamplerVoice*> preparedVoices;
+    // voices waiting for play(), in order of preparation
+    DunneCore::SamplerVoice *preparedVoices[MAX_POLYPHONY];
+    int preparedVoiceCount = 0;
     
     // tuning table
     float tuningTable[128];
+
+    // calls from control threads, carried out at the start of each render chunk; the queue takes
+    // one producer, so pushing holds postLock, which only control threads ever take
+    DunneCore::CommandQueue<SamplerCommand, COMMAND_QUEUE_SIZE> commands;
+    std::atomic_flag postLock = ATOMIC_FLAG_INIT;
+    std::atomic<std::thread::id> renderThread { std::thread::id() };
+
+    // render() leaves its chunks silent while any control thread holds it off, e.g. to unload the
+    // samples, and says when it is in the middle of one
+    std::atomic<int> renderHolds { 0 };
+    std::atomic<bool> rendering { false };
+
+    // not on the render thread: returns once render() can't be using the voices or samples
+    void holdRender()
+    {
+        renderHolds.fetch_add(1);
+        while (rendering.load()) std::this_thread::yield();
+    }
+
+    void releaseRender() { renderHolds.fetch_sub(1); }
+
+    // the last stop-all-voices ticket handed out, and the highest carried out
+    std::atomic<uint64_t> stopTicketsIssued { 0 };
+    std::atomic<uint64_t> stopTicketsDone { 0 };
+
+    bool post(SamplerCommand &command)
+    {
+        if (renderThread.load(std::memory_order_relaxed) == std::this_thread::get_id())
+        {
+            run(command);
+            return true;
+        }
+        while (postLock.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+        bool pushed = commands.push(command);
+        postLock.clear(std::memory_order_release);
+        return pushed;
+    }
+
+    // render thread: timed calls popped from the queue wait in pending until due, so they never
+    // hold back those queued behind them. pendingOrder lists their slots latest due first, those
+    // due together last queued first, so the next to carry out is always at the end.
+    SamplerCommand pending[COMMAND_QUEUE_SIZE];
+    int pendingOrder[COMMAND_QUEUE_SIZE];
+    int freeSlots[COMMAND_QUEUE_SIZE];     // from pendingCount on, the slots not in use
+    int pendingCount = 0;
+
+    InternalData() { resetPending(); }
+
+    // the last call popped, if not yet carried out or pending: one to carry out at once, or a
+    // timed one for which pending had no room
+    SamplerCommand nextCommand;
+    bool hasNextCommand = false;
+
+    static bool isFence(const SamplerCommand &command)
+    {
+        return command.type == SamplerCommand::kStopAllVoices || command.type == SamplerCommand::kRestartVoices;
+    }
+
+    // whether the call waits in pending, given that those due before time are carried out now
+    static bool isHeld(const SamplerCommand &command, int64_t time)
+    {
+        return command.due >= time && !isFence(command);
+    }
+
+    const SamplerCommand &nextPending() { return pending[pendingOrder[pendingCount - 1]]; }
+
+    bool addPending(const SamplerCommand &command)
+    {
+        if (pendingCount == COMMAND_QUEUE_SIZE) return false;
+        int slot = freeSlots[pendingCount];
+        pending[slot] = command;
+        int i = pendingCount++;
+        for (; i > 0 && pending[pendingOrder[i - 1]].due <= command.due; i--) pendingOrder[i] = pendingOrder[i - 1];
+        pendingOrder[i] = slot;
+        return true;
+    }
+
+    void removeNextPending()
+    {
+        pendingCount--;
+        freeSlots[pendingCount] = pendingOrder[pendingCount];
+    }
+
+    // render thread: pop queued calls into pending, until one must be carried out first
+    void collectCommands(int64_t time)
+    {
+        while (hasNextCommand || (hasNextCommand = commands.pop(nextCommand)))
+        {
+            if (!isHeld(nextCommand, time) || !addPending(nextCommand)) return;
+            hasNextCommand = false;
+        }
+    }
+
+    // render thread: the frame the next pending call is due on, or INT64_MAX if there is none;
+    // calls to carry out at once wait for the next piece of the chunk
+    int64_t nextCommandTime(int64_t time)
+    {
+        collectCommands(time);
+        int64_t next = pendingCount > 0 ? nextPending().due : INT64_MAX;
+        if (hasNextCommand && isHeld(nextCommand, time)) next = std::min(next, nextCommand.due);
+        return next;
+    }
+
+    // render thread: carry out the calls due before time, pending ones first, then the rest of
+    // the queue in order
+    void runCommands(int64_t time)
+    {
+        for (;;)
+        {
+            if (pendingCount > 0 && nextPending().due < time)
+            {
+                SamplerCommand &command = pending[pendingOrder[pendingCount - 1]];
+                removeNextPending();
+                run(command);
+                continue;
+            }
+            collectCommands(time);
+            if (!hasNextCommand || isHeld(nextCommand, time)) return;
+            hasNextCommand = false;
+
+            // stopping everything also drops what was queued to happen later
+            if (nextCommand.type == SamplerCommand::kStopAllVoices) resetPending();
+            run(nextCommand);
+        }
+    }
+
+    void resetPending()
+    {
+        pendingCount = 0;
+        for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) freeSlots[i] = i;
+    }
+
+    // render thread only
+    void run(SamplerCommand &command)
+    {
+        switch (command.type)
+        {
+            case SamplerCommand::kPrepareNote:
+                command.loop.enabledTracks = command.enabledTracks;
+                command.loop.mutedStartPoints = command.mutedStartPoints;
+                command.loop.mutedEndPoints = command.mutedEndPoints;
+                sampler->prepareNote(command.noteNumber, command.velocity, command.loop);
+                break;
+            case SamplerCommand::kPlay:
+                sampler->play(command.sampleTime);
+                break;
+            case SamplerCommand::kStopNote:
+                sampler->stopNote(command.noteNumber, command.flag);
+                break;
+            case SamplerCommand::kSustainPedal:
+                sampler->sustainPedal(command.flag);
+                break;
+            case SamplerCommand::kSetter:
+                (sampler->*command.setter)(command.value);
+                break;
+            case SamplerCommand::kStopAllVoices:
+                // lock out new notes until restartVoices(), and silence every voice now
+                sampler->stoppingAllVoices = true;
+                stopVoices();
+                // threads racing to post may queue their tickets out of order; never go back
+                if (command.ticket > stopTicketsDone.load(std::memory_order_relaxed))
+                    stopTicketsDone.store(command.ticket, std::memory_order_release);
+                break;
+            case SamplerCommand::kRestartVoices:
+                sampler->stoppingAllVoices = false;
+                break;
+            case SamplerCommand::kAllNotesOff:
+                stopVoices();
+                break;
+        }
+    }
+
+    // render thread: silence every voice, and forget any waiting for play()
+    void stopVoices()
+    {
+        for (int i = 0; i < MAX_POLYPHONY; i++) voice[i].stop();
+        preparedVoiceCount = 0;
+    }
+
+    // optional helper threads for render(), and what each render chunk hands them
+    DunneCore::RenderThreadPool renderPool;
+    int activeVoices[MAX_POLYPHONY];
+    float voiceOutput[MAX_POLYPHONY][2][CORESAMPLER_CHUNKSIZE];
+    CoreSampler *sampler;
+    VoiceRenderParameters renderParameters;
+
+    // renders one active voice into its own output slice; any thread
+    static void renderVoiceTask(void *context, int taskIndex)
+    {
+        InternalData *data = (InternalData *)context;
+        const VoiceRenderParameters &p = data->renderParameters;
+        int i = data->activeVoices[taskIndex];
+        float *pOutLeft = data->voiceOutput[i][0];
+        float *pOutRight = data->voiceOutput[i][1];
+        memset(pOutLeft, 0, p.sampleCount * sizeof(float));
+        memset(pOutRight, 0, p.sampleCount * sizeof(float));
+        data->sampler->renderVoiceChunk(p, pOutLeft, pOutRight, &data->voice[i]);
+    }
+
+    void addPreparedVoice(DunneCore::SamplerVoice *pVoice)
+    {
+        for (int i = 0; i < preparedVoiceCount; i++)
+            if (preparedVoices[i] == pVoice) return;
+        preparedVoices[preparedVoiceCount++] = pVoice;
+    }
+
+    // give every voice room for the largest set of tracks mapped to any note, so note-on never allocates;
+    // if any samples are streamed, every voice's pair of groups gets a ring's worth of read-ahead
+    void reserveVoiceResources()
+    {
+        size_t maxBuffers = std::max<size_t>(1, keyMap.getMaxBufferCount());
+        for (int i = 0; i < MAX_POLYPHONY; i++)
+            voice[i].reserveSampleBuffers(maxBuffers);
+
+        bool anyStreamed = false;
+        for (DunneCore::KeyMappedSampleBuffer *pBuf : sampleBufferList)
+            anyStreamed = anyStreamed || pBuf->isStreamed();
+        if (anyStreamed && !streamPool.isAllocated())
+            streamPool.allocate(2 * MAX_POLYPHONY, SAMPLESTREAM_RING_FRAMES);
+    }
+
+    // a new buffer, mapped and trimmed as the descriptor says, with no sample data yet
+    DunneCore::KeyMappedSampleBuffer *addSampleBuffer(const SampleDescriptor &sd, float sampleRate,
+                                                      int channelCount, int sampleCount, bool isInterleaved)
+    {
+        DunneCore::KeyMappedSampleBuffer *pBuf = new DunneCore::KeyMappedSampleBuffer();
+        pBuf->minimumNoteNumber = sd.minimumNoteNumber;
+        pBuf->maximumNoteNumber = sd.maximumNoteNumber;
+        pBuf->minimumVelocity = sd.minimumVelocity;
+        pBuf->maximumVelocity = sd.maximumVelocity;
+        sampleBufferList.push_back(pBuf);
+
+        pBuf->init(sampleRate, channelCount, sampleCount, isInterleaved);
+        pBuf->noteNumber = sd.noteNumber;
+        pBuf->noteFrequency = sd.noteFrequency;
+
+        if (sd.startPoint > 0.0f) pBuf->startPoint = sd.startPoint;
+        if (sd.endPoint > 0.0f)   pBuf->endPoint = sd.endPoint;
+        return pBuf;
+    }
+
+    // decoded data comes from the process-wide store, so samplers loading the same file share it;
+    // with streaming on only the head is decoded, and each sampler reads the rest itself. Only
+    // reads the sampler's settings, so several threads can open files at once.
+    bool openSampleFile(const DunneCore::WavPackSource &source, DecodedSampleFile &file)
+    {
+        char errMsg[100];
+        file.entry = DunneCore::SampleStore::shared().acquire(source, streamHeadFrames, storageFormat, errMsg);
+        if (file.entry == 0)
+        {
+            printf("Wavpack error loading %s: %s\n", source.getName().c_str(), errMsg);
+            return false;
+        }
+
+        if (file.entry->residentCount < file.entry->sampleCount)
+        {
+            file.stream = new DunneCore::WavPackSampleStream();
+            if (!file.stream->open(source, errMsg))
+            {
+                printf("Wavpack error loading %s: %s\n", source.getName().c_str(), errMsg);
+                closeSampleFile(file);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void closeSampleFile(DecodedSampleFile &file)
+    {
+        delete file.stream;
+        DunneCore::SampleStore::shared().release(file.entry);
+        file.stream = 0;
+        file.entry = 0;
+    }
+
+    // octave-down copies of a newly loaded buffer, if asked for, taking at most as much memory again
+    void addPyramid(DunneCore::KeyMappedSampleBuffer *pBuf)
+    {
+        if (buildsPyramids) pBuf->buildOctaves(pBuf->residentCount * pBuf->bytesPerFrame());
+    }
+
+    // the buffer takes over the file's store entry and stream
+    void addSampleFile(const SampleDescriptor &sd, const DecodedSampleFile &file)
+    {
+        const DunneCore::SampleStoreEntry *entry = file.entry;
+        DunneCore::KeyMappedSampleBuffer *pBuf = addSampleBuffer(sd, entry->sampleRate, entry->channelCount,
+                                                                 entry->sampleCount, false);
+        pBuf->samples = entry->samples;
+        pBuf->storageFormat = entry->format;
+        pBuf->packedSamples = entry->packedSamples;
+        pBuf->packedScale = entry->packedScale;
+        pBuf->storeEntry = entry;
+        pBuf->residentCount = entry->residentCount;
+        pBuf->channelStride = entry->channelStride;
+        pBuf->stream = file.stream;
+        if (sd.endPoint <= 0.0f) pBuf->endPoint = (float)entry->sampleCount;   // the caller can't know it
+        addPyramid(pBuf);
+    }
+
+    // decode a batch of files on up to threadCount threads, then add them all, or none if any fails
+    bool loadSampleFiles(const std::vector<DunneCore::WavPackSource> &sources, const std::vector<SampleDescriptor> &descriptors,
+                         int threadCount, SampleLoadProgressCallback progress, void *progressContext)
+    {
+        int count = (int)sources.size();
+
+        // workers claim files in turn, and stop claiming once any file fails
+        std::vector<DecodedSampleFile> files(count);
+        std::atomic<int> nextFile { 0 };
+        std::atomic<bool> failed { false };
+        std::mutex mutex;
+        std::condition_variable changed;
+        int decodedCount = 0, runningCount = 0;
+
+        auto decodeFiles = [&]() {
+            for (int i; !failed.load() && (i = nextFile.fetch_add(1)) < count; )
+            {
+                if (!openSampleFile(sources[i], files[i])) failed.store(true);
+                std::lock_guard<std::mutex> lock(mutex);
+                decodedCount++;
+                changed.notify_one();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            runningCount--;
+            changed.notify_one();
+        };
+
+        if (threadCount <= 0) threadCount = (int)std::max(1u, std::thread::hardware_concurrency());
+        threadCount = std::min(threadCount, std::min(count, SAMPLELOAD_MAX_THREADS));
+        std::vector<std::thread> threads;
+        runningCount = threadCount;
+        for (int t = 0; t < threadCount; t++) threads.emplace_back(decodeFiles);
+
+        // report progress from here, so the caller never hears from the workers' threads
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            int reportedCount = 0;
+            for (;;)
+            {
+                changed.wait(lock, [&]() { return decodedCount > reportedCount || runningCount == 0; });
+                if (decodedCount == reportedCount) break;
+                reportedCount = decodedCount;
+                if (progress == 0) continue;
+                lock.unlock();
+                progress(progressContext, reportedCount, count);
+                lock.lock();
+            }
+        }
+        for (std::thread &thread : threads) thread.join();
+
+        if (failed.load())
+        {
+            for (DecodedSampleFile &file : files) closeSampleFile(file);
+            return false;
+        }
+
+        // add them in order, so the key map comes out just as if they had been loaded one by one
+        for (int i = 0; i < count; i++) addSampleFile(descriptors[i], files[i]);
+        return true;
+    }
 };
 
+// true if the given track index is in the loop's list of enabled tracks
+static bool isTrackEnabled(const LoopDescriptor &loop, unsigned track)
+{
+    for (unsigned i = 0; i < loop.enabledTracksCount; i++)
+        if (loop.enabledTracks[i] == track) return true;
+    return false;
+}
+
 CoreSampler::CoreSampler()
 : currentSampleRate(48000.0f)    // sensible guess
 , ident(0)
@@ -57,6 +496,9 @@ CoreSampler::CoreSampler()
 , voiceVibratoDepth(0.0f)
 , voiceVibratoFrequency(5.0f)
 , glideRate(0.0f)   // 0 sec/octave means "no glide"
+, speed(0.0f)
+, pitch(0.0f)
+, varispeed(0.0f)
 , isMonophonic(false)
 , isLegato(false)
 , portamentoRate(1.0f)
@@ -70,6 +512,7 @@ CoreSampler::CoreSampler()
 , stoppingAllVoices(false)
 , data(new InternalData)
 {
+    data->sampler = this;
     DunneCore::SamplerVoice *pVoice = data->voice;
     for (int i=0; i < MAX_POLYPHONY; i++, pVoice++)
     {
@@ -97,6 +540,7 @@ int CoreSampler::init(double sampleRate)
     data->pitchEnvelopeParameters.updateSampleRate((float)(sampleRate/CORESAMPLER_CHUNKSIZE));
     data->vibratoLFO.waveTable.sinusoid();
     data->vibratoLFO.init(sampleRate/CORESAMPLER_CHUNKSIZE, 5.0f);
+    data->stretchCache.setSampleRate((float)sampleRate);
     
     for (int i=0; i<MAX_POLYPHONY; i++)
         data->voice[i].init(sampleRate);
@@ -109,69 +553,285 @@ void CoreSampler::deinit()
 
 void CoreSampler::unloadAllSamples()
 {
+    // render() may be running, and may not have stopped every voice yet, so keep it out meanwhile
+    // and silence them here
+    data->holdRender();
+    data->stopVoices();
     isKeyMapValid = false;
+    data->streamPool.stop();
+    for (int i=0; i < MAX_POLYPHONY; i++)
+        data->voice[i].releaseSampleBuffers();
+    data->streamPool.deallocate();
+    data->mixCache.clear();
+    data->stretchCache.clear();
     for (DunneCore::KeyMappedSampleBuffer *pBuf : data->sampleBufferList)
         delete pBuf;
     data->sampleBufferList.clear();
-    for (int i=0; i < MIDI_NOTENUMBERS; i++)
-        data->keyMap[i].clear();
+    data->keyMap.clear();
+    data->releaseRender();
 }
 
 void CoreSampler::loadSampleData(SampleDataDescriptor& sdd)
 {
-    DunneCore::KeyMappedSampleBuffer *pBuf = new DunneCore::KeyMappedSampleBuffer();
-    pBuf->minimumNoteNumber = sdd.sampleDescriptor.minimumNoteNumber;
-    pBuf->maximumNoteNumber = sdd.sampleDescriptor.maximumNoteNumber;
-    pBuf->minimumVelocity = sdd.sampleDescriptor.minimumVelocity;
-    pBuf->maximumVelocity = sdd.sampleDescriptor.maximumVelocity;
-    data->sampleBufferList.push_back(pBuf);
-    
-    pBuf->init(sdd.sampleRate, sdd.channelCount, sdd.sampleCount, sdd.isInterleaved);
+    DunneCore::KeyMappedSampleBuffer *pBuf = data->addSampleBuffer(sdd.sampleDescriptor, sdd.sampleRate,
+                                                                   sdd.channelCount, sdd.sampleCount, sdd.isInterleaved);
     pBuf->samples = sdd.data;
-    pBuf->noteNumber = sdd.sampleDescriptor.noteNumber;
-    pBuf->noteFrequency = sdd.sampleDescriptor.noteFrequency;
+    if (sdd.sampleDescriptor.endPoint <= 0.0f) pBuf->endPoint = (float)sdd.sampleCount;    // e.g. an SFZ region without end=
+    data->addPyramid(pBuf);
+}
 
-    if (sdd.sampleDescriptor.startPoint > 0.0f) pBuf->startPoint = sdd.sampleDescriptor.startPoint;
-    if (sdd.sampleDescriptor.endPoint > 0.0f)   pBuf->endPoint = sdd.sampleDescriptor.endPoint;
+bool CoreSampler::loadCompressedSampleFile(SampleFileDescriptor& sfd)
+{
+    DecodedSampleFile file;
+    if (!data->openSampleFile(DunneCore::WavPackSource::file(sfd.path), file)) return false;
+    data->addSampleFile(sfd.sampleDescriptor, file);
+    return true;
 }
 
-DunneCore::SampleBufferGroup CoreSampler::lookupSamples(unsigned noteNumber, unsigned velocity, LoopDescriptor loop)
+bool CoreSampler::loadCompressedSampleMemory(SampleMemoryDescriptor& smd)
 {
-    std::list<DunneCore::SampleBuffer*> result;
-    const auto buffers = data->keyMap[noteNumber];
-    bool enabled_tracks[buffers.size()];
-    memset(enabled_tracks, false, buffers.size() * sizeof(bool));
-    
-    for(int i = 0; i < loop.enabledTracksCount; i++) {
-        enabled_tracks[loop.enabledTracks[i]] = true;
+    DecodedSampleFile file;
+    if (!data->openSampleFile(DunneCore::WavPackSource::memory(smd.data, smd.byteCount), file)) return false;
+    data->addSampleFile(smd.sampleDescriptor, file);
+    return true;
+}
+
+bool CoreSampler::loadCompressedSampleFiles(const SampleFileDescriptor *sfds, int count, int threadCount,
+                                            SampleLoadProgressCallback progress, void *progressContext)
+{
+    std::vector<DunneCore::WavPackSource> sources;
+    std::vector<SampleDescriptor> descriptors;
+    for (int i = 0; i < count; i++)
+    {
+        sources.push_back(DunneCore::WavPackSource::file(sfds[i].path));
+        descriptors.push_back(sfds[i].sampleDescriptor);
     }
-    
-    // common case: only one sample mapped to this note - return it immediately
-    if (buffers.size() == 1 && enabled_tracks[0] == true) {
-        result.push_back(buffers.front());
+    if (!data->loadSampleFiles(sources, descriptors, threadCount, progress, progressContext)) return false;
+    buildKeyMap();
+    return true;
+}
+
+bool CoreSampler::loadCompressedSampleMemories(const SampleMemoryDescriptor *smds, int count, int threadCount,
+                                               SampleLoadProgressCallback progress, void *progressContext)
+{
+    std::vector<DunneCore::WavPackSource> sources;
+    std::vector<SampleDescriptor> descriptors;
+    for (int i = 0; i < count; i++)
+    {
+        sources.push_back(DunneCore::WavPackSource::memory(smds[i].data, smds[i].byteCount));
+        descriptors.push_back(smds[i].sampleDescriptor);
     }
-    else {
-        // search samples mapped to this note for best choice based on velocity
-        auto iter = buffers.begin();
-        for (int i = 0; i < buffers.size(); i++, iter++) {
-            auto pBuf = *iter;
-            // if sample does not have velocity range, accept it trivially
-            if (enabled_tracks[i] && ((pBuf->minimumVelocity < 0 || pBuf->maximumVelocity < 0) ||
-                ((int)velocity >= pBuf->minimumVelocity && (int)velocity <= pBuf->maximumVelocity)))
-                result.push_back(pBuf);
+    if (!data->loadSampleFiles(sources, descriptors, threadCount, progress, progressContext)) return false;
+    buildKeyMap();
+    return true;
+}
+
+// the region's sample if it is WavPack, or a .wv file beside its .wav or .aif sample; empty if neither
+static std::string compressedSamplePath(const std::string &sample)
+{
+    auto hasSuffix = [&](const char *suffix) {
+        size_t n = strlen(suffix);
+        return sample.size() > n && sample.compare(sample.size() - n, n, suffix) == 0;
+    };
+    if (hasSuffix(".wv")) return sample;
+    if (!hasSuffix(".wav") && !hasSuffix(".aif")) return std::string();
+    std::string path = sample.substr(0, sample.size() - 4) + ".wv";
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == 0) return std::string();
+    fclose(file);
+    return path;
+}
+
+static void setSampleLoop(DunneCore::KeyMappedSampleBuffer *pBuf, const DunneCore::SFZRegion &region)
+{
+    pBuf->isLooping = region.isLooping();
+    pBuf->loopStartPoint = region.loopStart;
+    pBuf->loopEndPoint = region.loopEnd;
+}
+
+bool CoreSampler::loadSFZ(const char *path, int threadCount, SFZSampleCallback loadOther, void *context)
+{
+    DunneCore::SFZFile sfz;
+    char errMsg[100];
+    if (!sfz.load(path, errMsg))
+    {
+        printf("SFZ error loading %s: %s\n", path, errMsg);
+        return false;
+    }
+
+    std::vector<DunneCore::WavPackSource> sources;
+    std::vector<SampleDescriptor> descriptors;
+    std::vector<const DunneCore::SFZRegion *> compressed, others;
+    for (const DunneCore::SFZRegion &region : sfz.regions)
+    {
+        std::string compressedPath = compressedSamplePath(region.sample);
+        if (compressedPath.empty())
+        {
+            others.push_back(&region);
+            continue;
         }
+        sources.push_back(DunneCore::WavPackSource::file(compressedPath.c_str()));
+        descriptors.push_back(region.sampleDescriptor);
+        compressed.push_back(&region);
     }
-    
-    DunneCore::SampleBufferGroup group;
-    group.init(result, loop);
-    auto findGroup = data->sampleBufferGroups.find(noteNumber);
-    if (findGroup != data->sampleBufferGroups.end()) {
-        findGroup->second = group;
-        return findGroup->second;
-    } else {
-        data->sampleBufferGroups.insert({noteNumber, group});
-        return group;
+    if (!data->loadSampleFiles(sources, descriptors, threadCount, 0, 0)) return false;
+
+    // the batch went on the end of the list, in order
+    auto it = data->sampleBufferList.rbegin();
+    for (size_t i = compressed.size(); i > 0; i--, it++) setSampleLoop(*it, *compressed[i - 1]);
+
+    for (const DunneCore::SFZRegion *region : others)
+    {
+        if (loadOther == 0) break;
+        size_t count = data->sampleBufferList.size();
+        loadOther(context, &region->sampleDescriptor, region->sample.c_str());
+        if (data->sampleBufferList.size() > count) setSampleLoop(data->sampleBufferList.back(), *region);
     }
+    buildKeyMap();
+    return true;
+}
+
+bool CoreSampler::getSampleLoop(unsigned noteNumber, unsigned velocity, LoopDescriptor &loop)
+{
+    for (const DunneCore::SampleKeyMap::Entry &entry : data->keyMap.lookup(noteNumber, velocity))
+    {
+        const DunneCore::KeyMappedSampleBuffer *pBuf = entry.buffer;
+        if (!pBuf->isLooping) return false;
+        loop.isLooping = true;
+        loop.startPoint = pBuf->loopStartPoint;
+        loop.endPoint = pBuf->loopEndPoint;
+        return true;
+    }
+    return false;
+}
+
+void CoreSampler::setSampleStorageFormat(SampleStorageFormat format)
+{
+    data->storageFormat = format;
+}
+
+void CoreSampler::setSampleInterpolation(SampleInterpolation interpolation)
+{
+    data->interpolation = interpolation;
+}
+
+void CoreSampler::setSamplePyramids(bool enabled)
+{
+    data->buildsPyramids = enabled;
+}
+
+void CoreSampler::setSampleStreaming(bool enabled, size_t headFrames)
+{
+    data->streamHeadFrames = enabled ? std::max<size_t>(headFrames, 1) : 0;
+}
+
+SampleStreamingStatistics CoreSampler::getStreamingStatistics()
+{
+    SampleStreamingStatistics stats = {};
+    for (DunneCore::KeyMappedSampleBuffer *pBuf : data->sampleBufferList)
+    {
+        size_t frameBytes = pBuf->bytesPerFrame();
+        stats.residentBytes += pBuf->residentCount * frameBytes;
+        if (pBuf->isStreamed())
+        {
+            stats.streamedBytes += (pBuf->sampleCount - pBuf->residentCount) * frameBytes;
+            stats.streamedSampleCount++;
+        }
+    }
+    stats.ringBytes = data->streamPool.getByteCount();
+    stats.underruns = data->streamPool.getUnderruns();
+    stats.underrunFrames = data->streamPool.getUnderrunFrames();
+    stats.framesRead = data->streamPool.getFramesRead();
+    return stats;
+}
+
+bool CoreSampler::lookupSamples(unsigned noteNumber, unsigned velocity, LoopDescriptor loop, DunneCore::SampleBufferGroup *group)
+{
+    // the samples mapped to this note which play at this velocity (all of them, if there is only one)
+    group->sampleBuffers.clear();
+    for (const DunneCore::SampleKeyMap::Entry &entry : data->keyMap.lookup(noteNumber, velocity))
+        if (isTrackEnabled(loop, entry.track)) group->sampleBuffers.push_back(entry.buffer);
+
+    group->interpolation = data->interpolation;
+    group->stretchCache = &data->stretchCache;
+
+    // a voice which would resample its tracks more than an octave up plays copies from their
+    // pyramids instead, the first at which its increment is at most 1
+    int octaves = 0;
+    if (data->interpolation != SampleInterpolationNone && !group->sampleBuffers.empty())
+    {
+        DunneCore::SampleBuffer *pBuf = group->sampleBuffers.front();
+        double increment = (pBuf->sampleRate / currentSampleRate) * (data->tuningTable[noteNumber] / pBuf->noteFrequency);
+        for (; increment > 1.0; increment *= 0.5, octaves++)
+        {
+            bool deeper = true;
+            for (DunneCore::SampleBuffer *pTrack : group->sampleBuffers)
+                deeper = deeper && pTrack->getOctave(octaves + 1) != 0;
+            if (!deeper) break;
+        }
+    }
+    return group->init(loop, &data->mixCache, &data->streamPool, octaves);
+}
+
+void CoreSampler::setMixCacheBudget(size_t bytes)
+{
+    data->mixCache.setBudget(bytes);
+}
+
+SampleMixCacheStatistics CoreSampler::getMixCacheStatistics()
+{
+    SampleMixCacheStatistics stats;
+    stats.hits = data->mixCache.getHits();
+    stats.misses = data->mixCache.getMisses();
+    stats.evictions = data->mixCache.getEvictions();
+    stats.bytesUsed = data->mixCache.getBytesUsed();
+    stats.bytesBudget = data->mixCache.getBudget();
+    stats.entryCount = data->mixCache.getEntryCount();
+    return stats;
+}
+
+void CoreSampler::setStretchCacheBudget(size_t bytes)
+{
+    data->stretchCache.setBudget(bytes);
+}
+
+SampleStretchCacheStatistics CoreSampler::getStretchCacheStatistics()
+{
+    SampleStretchCacheStatistics stats;
+    stats.bakes = data->stretchCache.getBakes();
+    stats.failures = data->stretchCache.getFailures();
+    stats.plays = data->stretchCache.getPlays();
+    stats.evictions = data->stretchCache.getEvictions();
+    stats.bytesUsed = data->stretchCache.getBytesUsed();
+    stats.bytesBudget = data->stretchCache.getBudget();
+    stats.entryCount = data->stretchCache.getEntryCount();
+    return stats;
+}
+
+SampleMemoryStatistics CoreSampler::getMemoryStatistics()
+{
+    SampleMemoryStatistics stats = {};
+    DunneCore::SampleStore &store = DunneCore::SampleStore::shared();
+    for (DunneCore::KeyMappedSampleBuffer *pBuf : data->sampleBufferList)
+    {
+        size_t bytes = pBuf->residentCount * pBuf->bytesPerFrame();
+        stats.sampleCount++;
+        stats.pyramidBytes += pBuf->getOctaveBytes();
+        if (pBuf->storeEntry == 0)
+        {
+            stats.externalBytes += bytes;
+            continue;
+        }
+        int useCount = store.getUseCount(pBuf->storeEntry);
+        stats.sampleBytes += bytes;
+        stats.proportionalBytes += bytes / useCount;
+        if (useCount > 1) stats.sharedBytes += bytes;
+    }
+    stats.mixCacheBytes = data->mixCache.getBytesUsed();
+    stats.stretchCacheBytes = data->stretchCache.getBytesUsed();
+    stats.streamRingBytes = data->streamPool.getByteCount();
+    stats.storeBytes = store.getBytesUsed();
+    return stats;
 }
 
 void CoreSampler::setNoteFrequency(int noteNumber, float noteFrequency)
@@ -185,8 +845,7 @@ void CoreSampler::buildSimpleKeyMap()
 {
     // clear out the old mapping entirely
     isKeyMapValid = false;
-    for (int i=0; i < MIDI_NOTENUMBERS; i++)
-        data->keyMap[i].clear();
+    data->keyMap.clear();
     
     for (int nn=0; nn < MIDI_NOTENUMBERS; nn++)
     {
@@ -209,10 +868,12 @@ void CoreSampler::buildSimpleKeyMap()
             float distance = fabsf(NOTE_HZ(pBuf->noteNumber) - noteFreq);
             if (distance == minDistance)
             {
-                data->keyMap[nn].push_back(pBuf);
+                data->keyMap.add(nn, pBuf);
             }
         }
     }
+    data->keyMap.build();
+    data->reserveVoiceResources();
     isKeyMapValid = true;
 }
 
@@ -221,7 +882,7 @@ void CoreSampler::buildKeyMap(void)
 {
     // clear out the old mapping entirely
     isKeyMapValid = false;
-    for (int i=0; i < MIDI_NOTENUMBERS; i++) data->keyMap[i].clear();
+    data->keyMap.clear();
     
     for (int nn=0; nn < MIDI_NOTENUMBERS; nn++)
     {
@@ -231,9 +892,11 @@ void CoreSampler::buildKeyMap(void)
             float minFreq = NOTE_HZ(pBuf->minimumNoteNumber);
             float maxFreq = NOTE_HZ(pBuf->maximumNoteNumber);
             if (noteFreq >= minFreq && noteFreq <= maxFreq)
-                data->keyMap[nn].push_back(pBuf);
+                data->keyMap.add(nn, pBuf);
         }
     }
+    data->keyMap.build();
+    data->reserveVoiceResources();
     isKeyMapValid = true;
 }
 
@@ -249,11 +912,65 @@ DunneCore::SamplerVoice *CoreSampler::voicePlayingNote(unsigned noteNumber)
 
 void CoreSampler::play(int64_t sampleTime)
 {
-    for (auto &voice : data->preparedVoices)
+    for (int i = 0; i < data->preparedVoiceCount; i++)
     {
-        voice->play(sampleTime);
+        data->preparedVoices[i]->play(sampleTime);
     }
-    data->preparedVoices.clear();
+    data->preparedVoiceCount = 0;
+}
+
+bool CoreSampler::postPrepareNote(unsigned noteNumber, unsigned velocity, LoopDescriptor loop, int64_t sampleTime)
+{
+    if (loop.enabledTracksCount > SAMPLEBUFFER_RESERVED_LOOP_ENTRIES || loop.mutedCount > SAMPLEBUFFER_RESERVED_LOOP_ENTRIES)
+        return false;
+    SamplerCommand command;
+    command.type = SamplerCommand::kPrepareNote;
+    command.noteNumber = noteNumber;
+    command.velocity = velocity;
+    command.loop = loop;
+    command.due = sampleTime;
+    std::copy(loop.enabledTracks, loop.enabledTracks + loop.enabledTracksCount, command.enabledTracks);
+    std::copy(loop.mutedStartPoints, loop.mutedStartPoints + loop.mutedCount, command.mutedStartPoints);
+    std::copy(loop.mutedEndPoints, loop.mutedEndPoints + loop.mutedCount, command.mutedEndPoints);
+    return data->post(command);
+}
+
+bool CoreSampler::postPlay(int64_t sampleTime)
+{
+    SamplerCommand command;
+    command.type = SamplerCommand::kPlay;
+    command.sampleTime = sampleTime;
+    command.due = sampleTime;   // after the notes prepared for then
+    return data->post(command);
+}
+
+bool CoreSampler::postStopNote(unsigned noteNumber, bool immediate, int64_t sampleTime)
+{
+    SamplerCommand command;
+    command.type = SamplerCommand::kStopNote;
+    command.noteNumber = noteNumber;
+    command.flag = immediate;
+    command.due = sampleTime;
+    return data->post(command);
+}
+
+bool CoreSampler::postSustainPedal(bool down, int64_t sampleTime)
+{
+    SamplerCommand command;
+    command.type = SamplerCommand::kSustainPedal;
+    command.flag = down;
+    command.due = sampleTime;
+    return data->post(command);
+}
+
+bool CoreSampler::postSetter(void (CoreSampler::*setter)(float), float value, int64_t sampleTime)
+{
+    SamplerCommand command;
+    command.type = SamplerCommand::kSetter;
+    command.setter = setter;
+    command.value = value;
+    command.due = sampleTime;
+    return data->post(command);
 }
 
 void CoreSampler::prepareNote(unsigned noteNumber, unsigned velocity, LoopDescriptor loop)
@@ -285,9 +1002,6 @@ void CoreSampler::sustainPedal(bool down)
 void CoreSampler::prepare(unsigned noteNumber, unsigned velocity, bool anotherKeyWasDown, LoopDescriptor loop)
 {
     if (stoppingAllVoices) return;
- 
-    auto pBufs = lookupSamples(noteNumber, velocity, loop);
-    if (pBufs.sampleBuffers.size() == 0) return;  // don't crash if someone forgets to build map
 
     float noteFrequency = data->tuningTable[noteNumber];
     
@@ -296,35 +1010,34 @@ void CoreSampler::prepare(unsigned noteNumber, unsigned velocity, bool anotherKe
     
     if (isMonophonic)
     {
+        // our one and only voice
+        DunneCore::SamplerVoice *pVoice = &data->voice[0];
+        auto pBufs = pVoice->freeGroup();
+        if (!lookupSamples(noteNumber, velocity, loop, pBufs)) return;  // don't crash if someone forgets to build map
+
         if (isLegato && anotherKeyWasDown)
         {
             // is our one and only voice playing some note?
-            DunneCore::SamplerVoice *pVoice = &data->voice[0];
             if (pVoice->noteNumber >= 0)
             {
                 pVoice->restartNewNoteLegato(noteNumber, currentSampleRate, noteFrequency);
             }
             else
             {
-                pVoice->prepare(noteNumber, currentSampleRate, noteFrequency, velocity / 127.0f, loop, pBufs);
+                pVoice->prepare(noteNumber, currentSampleRate, noteFrequency, velocity / 127.0f, pBufs);
             }
-            data->preparedVoices.push_back(pVoice);
-            lastPlayedNoteNumber = noteNumber;
-            return;
         }
         else
         {
             // monophonic but not legato: always start a new note
-            DunneCore::SamplerVoice *pVoice = &data->voice[0];
             if (pVoice->noteNumber >= 0)
-                pVoice->restartNewNote(noteNumber, currentSampleRate, noteFrequency, velocity / 127.0f, loop, pBufs);
+                pVoice->restartNewNote(noteNumber, currentSampleRate, noteFrequency, velocity / 127.0f, pBufs);
             else
-                pVoice->prepare(noteNumber, currentSampleRate, noteFrequency, velocity / 127.0f, loop, pBufs);
-            
-            data->preparedVoices.push_back(pVoice);
-            lastPlayedNoteNumber = noteNumber;
-            return;
+                pVoice->prepare(noteNumber, currentSampleRate, noteFrequency, velocity / 127.0f, pBufs);
         }
+        data->addPreparedVoice(pVoice);
+        lastPlayedNoteNumber = noteNumber;
+        return;
     }
     
     else // polyphonic
@@ -334,8 +1047,10 @@ void CoreSampler::prepare(unsigned noteNumber, unsigned velocity, bool anotherKe
         if (pVoice)
         {
             // re-start the note
-            pVoice->restartSameNote(velocity / 127.0f, loop, pBufs);
-            data->preparedVoices.push_back(pVoice);
+            auto pBufs = pVoice->freeGroup();
+            if (!lookupSamples(noteNumber, velocity, loop, pBufs)) return;
+            pVoice->restartSameNote(velocity / 127.0f, pBufs);
+            data->addPreparedVoice(pVoice);
             return;
         }
         
@@ -346,8 +1061,10 @@ void CoreSampler::prepare(unsigned noteNumber, unsigned velocity, bool anotherKe
             DunneCore::SamplerVoice *pVoice = &data->voice[i];
             if (pVoice->noteNumber < 0)
             {
-                pVoice->prepare(noteNumber, currentSampleRate, noteFrequency, velocity / 127.0f, loop, pBufs);
-                data->preparedVoices.push_back(pVoice);
+                auto pBufs = pVoice->freeGroup();
+                if (!lookupSamples(noteNumber, velocity, loop, pBufs)) return;
+                pVoice->prepare(noteNumber, currentSampleRate, noteFrequency, velocity / 127.0f, pBufs);
+                data->addPreparedVoice(pVoice);
                 lastPlayedNoteNumber = noteNumber;
                 return;
             }
@@ -372,8 +1089,8 @@ void CoreSampler::stop(unsigned noteNumber, bool immediate)
         else
         {
             unsigned velocity = 100;
-            auto pBufs = lookupSamples(key, velocity, pVoice->currentLoop);
-            if (pBufs.sampleBuffers.size() == 0) return;  // don't crash if someone forgets to build map
+            auto pBufs = pVoice->freeGroup();
+            if (!lookupSamples(key, velocity, pVoice->currentLoop, pBufs)) return;  // don't crash if someone forgets to build map
             if (pVoice->noteNumber >= 0)
                 pVoice->restartNewNote(key, currentSampleRate, data->tuningTable[key], velocity / 127.0f, pBufs);
             else
@@ -386,80 +1103,178 @@ void CoreSampler::stop(unsigned noteNumber, bool immediate)
     }
 }
 
-void CoreSampler::stopAllVoices()
+uint64_t CoreSampler::postStopAllVoices()
 {
-    // Lock out starting any new notes, and tell Render() to stop all active notes
-    stoppingAllVoices = true;
-    
-    // Wait until Render() has killed all active notes
-    bool noteStillSounding = true;
-    while (noteStillSounding)
+    SamplerCommand command;
+    command.type = SamplerCommand::kStopAllVoices;
+    command.ticket = data->stopTicketsIssued.fetch_add(1, std::memory_order_relaxed) + 1;
+    return data->post(command) ? command.ticket : 0;
+}
+
+bool CoreSampler::voicesStopped(uint64_t ticket)
+{
+    return ticket != 0 && data->stopTicketsDone.load(std::memory_order_acquire) >= ticket;
+}
+
+bool CoreSampler::waitForVoicesStopped(uint64_t ticket, double timeoutSeconds)
+{
+    // render() acts on the ticket at its next chunk, so check about that often
+    auto interval = std::chrono::microseconds(long(1.0e6 * CORESAMPLER_CHUNKSIZE / currentSampleRate) + 1);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeoutSeconds);
+    while (!voicesStopped(ticket))
     {
-        noteStillSounding = false;
-        for (int i=0; i < MAX_POLYPHONY; i++)
-            if (data->voice[i].noteNumber >= 0) noteStillSounding = true;
+        if (ticket == 0 || std::chrono::steady_clock::now() >= deadline) return false;
+        std::this_thread::sleep_for(interval);
     }
+    return true;
+}
+
+bool CoreSampler::stopAllVoices(double timeoutSeconds)
+{
+    return waitForVoicesStopped(postStopAllVoices(), timeoutSeconds);
+}
+
+bool CoreSampler::postAllNotesOff(int64_t sampleTime)
+{
+    SamplerCommand command;
+    command.type = SamplerCommand::kAllNotesOff;
+    command.due = sampleTime;
+    return data->post(command);
 }
 
 void CoreSampler::restartVoices()
 {
-    // Allow starting new notes again
-    stoppingAllVoices = false;
+    // allow starting new notes again, after any stop already queued
+    SamplerCommand command;
+    command.type = SamplerCommand::kRestartVoices;
+    data->post(command);
 }
 
-void CoreSampler::renderVoice(bool allowSampleRunout, float cutoffMul, float *pOutLeft, float *pOutRight, DunneCore::SamplerVoice *pVoice, float pitchDev, unsigned int sampleCount) {
+void CoreSampler::renderVoice(const VoiceRenderParameters &p, float *pOutLeft, float *pOutRight, DunneCore::SamplerVoice *pVoice, int64_t now, unsigned int sampleCount) {
     int nn = pVoice->noteNumber;
     if (nn >= 0)
     {
+        // envelopes and LFOs step once per chunk, however render() splits it: the voice is set up
+        // for the rest of the chunk by its first piece, and later pieces carry on from there
+        bool prepare = pVoice->preparedChunkEnd != p.chunkEnd;
+        pVoice->preparedChunkEnd = p.chunkEnd;
         if (stoppingAllVoices ||
-            pVoice->prepToGetSamples(sampleCount, masterVolume, pitchDev, cutoffMul, keyTracking,
-                                     cutoffEnvelopeStrength, filterEnvelopeVelocityScaling, linearResonance,
-                                     pitchADSRSemitones, voiceVibratoDepth, voiceVibratoFrequency, speed, pitch, varispeed) ||
-            (pVoice->getSamples(sampleCount, pOutLeft, pOutRight) && allowSampleRunout))
+            (prepare && pVoice->prepToGetSamples(int(p.chunkEnd - now), masterVolume, p.pitchDev, p.cutoffMul, keyTracking,
+                                                 cutoffEnvelopeStrength, filterEnvelopeVelocityScaling, linearResonance,
+                                                 pitchADSRSemitones, voiceVibratoDepth, voiceVibratoFrequency, speed, pitch, varispeed)) ||
+            (pVoice->getSamples(sampleCount, pOutLeft, pOutRight) && p.allowSampleRunout))
         {
-            stopNote(nn, true);
+            // same as stopNote(nn, true): no other voice plays nn, and this touches only this voice
+            pVoice->stop();
         }
     }
 }
 
-void CoreSampler::render(unsigned channelCount, unsigned sampleCount, float *outBuffers[], int64_t now)
+void CoreSampler::renderVoiceChunk(const VoiceRenderParameters &p, float *pOutLeft, float *pOutRight, DunneCore::SamplerVoice *pVoice)
 {
-    float *pOutLeft = outBuffers[0];
-    float *pOutRight = outBuffers[1];
+    auto nextTime = pVoice->next.sampleTime;
+    unsigned sampleCount = p.sampleCount;
+
+    // a note starts on its frame of the chunk; one whose time has passed starts now, as far into
+    // its loop as it would have got
+    if (pVoice->next.state == DunneCore::PlayEvent::CREATED && nextTime < p.now + sampleCount) {
+        auto offset = nextTime > p.now ? (unsigned int)(nextTime - p.now) : 0;
+        if (offset > 0) {
+            renderVoice(p, pOutLeft, pOutRight, pVoice, p.now, offset);
+
+            pOutLeft += offset;
+            pOutRight += offset;
+        }
+
+        pVoice->oscillator.indexPoint = double(size_t((p.now + offset) - nextTime) % pVoice->next.buffers->sampleCount);
+        pVoice->startNext();
+        pVoice->next.state = DunneCore::PlayEvent::PLAYING;
+        pVoice->current = pVoice->next;
+
+        // the new note sets the voice up afresh for the rest of the chunk
+        pVoice->preparedChunkEnd = INT64_MIN;
+        renderVoice(p, pOutLeft, pOutRight, pVoice, p.now + offset, sampleCount - offset);
+    } else {
+        renderVoice(p, pOutLeft, pOutRight, pVoice, p.now, sampleCount);
+    }
+}
+
+void CoreSampler::render(unsigned /*channelCount*/, unsigned sampleCount, float *outBuffers[], int64_t now)
+{
+    data->renderThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    data->rendering.store(true);
+    if (data->renderHolds.load() > 0)
+    {
+        data->rendering.store(false);
+        return;
+    }
+
+    // the shared vibrato, like each voice's envelopes, steps once per chunk
     data->vibratoLFO.setFrequency(vibratoFrequency);
-    float pitchDev = this->pitchOffset + vibratoDepth * data->vibratoLFO.getSample();
-    float cutoffMul = isFilterEnabled ? cutoffMultiple : -1.0f;
-    
-    bool allowSampleRunout = !(isMonophonic && isLegato);
+    data->vibratoSample = data->vibratoLFO.getSample();
+    data->renderParameters.chunkEnd = now + sampleCount;
 
-    DunneCore::SamplerVoice *pVoice = &data->voice[0];
-    for (int i=0; i < MAX_POLYPHONY; i++, pVoice++)
+    // queued calls due by each frame act before it; the chunk is split at each one due within it
+    for (unsigned done = 0; done < sampleCount; )
     {
-        pVoice->restartVoiceLFO = restartVoiceLFO;
+        data->runCommands(now + done + 1);
 
-        auto nextTime = pVoice->next.sampleTime;
+        // a call queued since then may already be due; it waits for the next piece
+        int64_t due = std::max(data->nextCommandTime(now + done + 1), now + int64_t(done) + 1);
+        unsigned count = unsigned(std::min(due, now + int64_t(sampleCount)) - (now + done));
+        renderVoices(count, outBuffers[0] + done, outBuffers[1] + done, now + done);
+        done += count;
+    }
+    data->rendering.store(false);
+}
 
-        if (pVoice->next.state == DunneCore::PlayEvent::CREATED && nextTime >= now) {
-            auto offset = nextTime - now >= 0 || nextTime - now < sampleCount ? (unsigned int)(nextTime - now) : 0;
-            if (offset > 0) {
-                renderVoice(allowSampleRunout, cutoffMul, pOutLeft, pOutRight, pVoice, pitchDev, offset);
+void CoreSampler::renderVoices(unsigned sampleCount, float *pOutLeft, float *pOutRight, int64_t now)
+{
+    VoiceRenderParameters &p = data->renderParameters;
+    p.pitchDev = this->pitchOffset + vibratoDepth * data->vibratoSample;
+    p.cutoffMul = isFilterEnabled ? cutoffMultiple : -1.0f;
+    p.allowSampleRunout = !(isMonophonic && isLegato);
+    p.sampleCount = sampleCount;
+    p.now = now;
+
+    // voices that are playing or about to start a note
+    int activeCount = 0;
+    for (int i=0; i < MAX_POLYPHONY; i++)
+    {
+        DunneCore::SamplerVoice *pVoice = &data->voice[i];
+        pVoice->restartVoiceLFO = restartVoiceLFO;
+        if (pVoice->noteNumber >= 0 || pVoice->next.state == DunneCore::PlayEvent::CREATED)
+            data->activeVoices[activeCount++] = i;
+    }
 
-                pOutLeft += offset;
-                pOutRight += offset;
-            }
+    if (activeCount < 2 || data->renderPool.getThreadCount() < 2)
+    {
+        for (int i=0; i < activeCount; i++)
+            renderVoiceChunk(p, pOutLeft, pOutRight, &data->voice[data->activeVoices[i]]);
+        return;
+    }
 
-            pVoice->oscillator.indexPoint = double(size_t((now + offset) - nextTime) % *pVoice->sampleBuffers.sampleCount);
-            pVoice->next.start();
-            pVoice->next.state = DunneCore::PlayEvent::PLAYING;
-            pVoice->current = pVoice->next;
-            
-            renderVoice(allowSampleRunout, cutoffMul, pOutLeft, pOutRight, pVoice, pitchDev, sampleCount - offset);
-        } else {
-            renderVoice(allowSampleRunout, cutoffMul, pOutLeft, pOutRight, pVoice, pitchDev, sampleCount);
-        }
+    // voices render into their own slices on the pool, then are summed in voice order, which
+    // adds exactly what the loop above would, in the same order
+    data->renderPool.run(InternalData::renderVoiceTask, data.get(), activeCount);
+    for (int i=0; i < activeCount; i++)
+    {
+        int v = data->activeVoices[i];
+        DunneCore::vectorAdd(pOutLeft, data->voiceOutput[v][0], sampleCount);
+        DunneCore::vectorAdd(pOutRight, data->voiceOutput[v][1], sampleCount);
     }
 }
 
+void CoreSampler::setRenderThreadCount(int threadCount)
+{
+    data->renderPool.start(std::max(1, std::min(threadCount, MAX_POLYPHONY)));
+}
+
+int CoreSampler::getRenderThreadCount()
+{
+    return data->renderPool.getThreadCount();
+}
+
 void  CoreSampler::setADSRAttackDurationSeconds(float value)
 {
     data->ampEnvelopeParameters.setAttackDurationSeconds(value);
@@ -1,20 +1,20 @@
 // Copyright AudioKit. All Rights Reserved.
 
 #ifdef __cplusplus
-#ifdef _WIN32
+#pragma once
+
 #include "Sampler_Typedefs.h"
 #include <memory>
-#else
-#import "Sampler_Typedefs.h"
-#import <memory>
-#endif
-
-#import <list>
+#include <list>
 #include "SampleBuffer.h"
+#include "SampleStream.h"
 
 // process samples in "chunks" this size
 #define CORESAMPLER_CHUNKSIZE 16
 
+// the sample time of a queued call to carry out at the start of the next chunk, rather than on a given frame
+#define CORESAMPLER_NOW INT64_MIN
+
 
 namespace DunneCore {
     struct SamplerVoice;
@@ -34,16 +34,97 @@ public:
     /// call this to un-load all samples and clear the keymap
     void deinit();
     
-    /// call before/after loading/unloading samples, to ensure none are in use
-    void stopAllVoices();
+    /// call before/after loading/unloading samples, to ensure none are in use; stopAllVoices()
+    /// waits up to timeoutSeconds for render() to silence every voice, and returns false if it didn't
+    /// (e.g. because render() isn't running). Both are queued like the post...() calls below, and
+    /// stopping drops any timed calls still pending.
+    bool stopAllVoices(double timeoutSeconds = 1.0);
     void restartVoices();
+
+    /// stopAllVoices() without the wait: returns a ticket (0 if the queue is full) which voicesStopped()
+    /// reports true for once render() has silenced every voice, at the start of its next chunk
+    uint64_t postStopAllVoices();
+    bool voicesStopped(uint64_t ticket);
+    /// sleeps, rather than spins, between checks; don't call on the render thread
+    bool waitForVoicesStopped(uint64_t ticket, double timeoutSeconds);
     
-    /// call to load samples
+    /// call to load samples; the sampler uses sdd.data in place, so it must outlive them
     void loadSampleData(SampleDataDescriptor& sdd);
 
-    /// call to unload samples, freeing memory
+    /// load a WavPack file; false if it can't be read. Decoded samples are shared with every other
+    /// sampler in the process which loads the same file, and freed when the last one unloads them
+    bool loadCompressedSampleFile(SampleFileDescriptor& sfd);
+
+    /// load count WavPack files at once, decoding them on up to threadCount threads (0 picks a number
+    /// to suit the machine), then build the key map. All or nothing: if any file can't be read, none
+    /// is added and this returns false. progress, if given, is called on the calling thread.
+    bool loadCompressedSampleFiles(const SampleFileDescriptor *sfds, int count, int threadCount = 0,
+                                   SampleLoadProgressCallback progress = 0, void *progressContext = 0);
+
+    /// the same, for WavPack files in memory, e.g. in a bundled archive or a pack file mapped with
+    /// DunneCore::mapFile(). The data is read in place: with streaming on, until the samples are
+    /// unloaded, and either way it must not change while they are loaded, as samplers loading the
+    /// same address share what was decoded from it
+    bool loadCompressedSampleMemory(SampleMemoryDescriptor& smd);
+    bool loadCompressedSampleMemories(const SampleMemoryDescriptor *smds, int count, int threadCount = 0,
+                                      SampleLoadProgressCallback progress = 0, void *progressContext = 0);
+
+    /// load the regions of an SFZ file: its WavPack samples (and .wav or .aif ones with a .wv copy
+    /// beside them) are decoded as one batch, as loadCompressedSampleFiles() does, and for the rest
+    /// loadOther, if given, is called to load them some other way. Then builds the key map. False,
+    /// with nothing loaded, if the file can't be read or any of its WavPack samples can't.
+    bool loadSFZ(const char *path, int threadCount = 0, SFZSampleCallback loadOther = 0, void *context = 0);
+
+    /// the loop defined with the sample the note and velocity map to, e.g. by loadSFZ(); sets the
+    /// loop's isLooping, startPoint and endPoint, and returns false and leaves it as it was if there is none
+    bool getSampleLoop(unsigned noteNumber, unsigned velocity, LoopDescriptor &loop);
+
+    /// how loadCompressedSampleFile() keeps the samples of files loaded afterwards: as floats (the
+    /// default), or compactly as 16-bit or packed 24-bit integers, converted to float as they play
+    void setSampleStorageFormat(SampleStorageFormat format);
+
+    /// how voices started afterwards read their time-stretched samples: frame by frame (the default,
+    /// SampleInterpolationNone, where only the stretcher sets the pitch), or resampled at the note's
+    /// pitch, with bend, glide and vibrato, by a linear, cubic or 4- or 8-point sinc kernel
+    void setSampleInterpolation(SampleInterpolation interpolation);
+
+    /// give samples loaded afterwards octave pyramids: half-band filtered copies at half the rate,
+    /// a quarter and so on, taking at most as much memory again as the sample, which voices that
+    /// interpolate play instead when their notes are over an octave above the sample's pitch
+    void setSamplePyramids(bool enabled);
+
+    /// with streaming on, loadCompressedSampleFile() keeps only the first headFrames frames of each
+    /// file in memory, and a background thread reads the rest ahead of the voices playing it.
+    /// Applies to files loaded afterwards; a voice which catches up with the disk plays silence,
+    /// counted as an underrun in the statistics
+    void setSampleStreaming(bool enabled, size_t headFrames = SAMPLESTREAM_DEFAULT_HEAD_FRAMES);
+    SampleStreamingStatistics getStreamingStatistics();
+
+    /// call to unload samples, freeing memory; safe while render() runs, which it holds off
+    /// meanwhile, silencing every voice itself. Not on the render thread.
     void unloadAllSamples();
     
+    /// limit memory used by prepared mixes of multi-track and reversed loops (least recently used go
+    /// first), which a background thread makes while voices mix as they play; 0 turns caching off.
+    /// Starts or stops a thread, so call from a control thread.
+    void setMixCacheBudget(size_t bytes);
+    SampleMixCacheStatistics getMixCacheStatistics();
+
+    /// bake loops whose speed and pitch hold steady: a background thread renders each through an
+    /// offline stretcher, and voices then play that from their next loop restart instead of
+    /// stretching as they go. bytes limits the memory baked loops take; 0 (the default) turns
+    /// baking off. Starts or stops a thread, so call from a control thread.
+    void setStretchCacheBudget(size_t bytes);
+    SampleStretchCacheStatistics getStretchCacheStatistics();
+
+    /// what this sampler's samples, mixes and read-ahead take, and how much of it is shared
+    SampleMemoryStatistics getMemoryStatistics();
+
+    /// render voices on this many threads, including the render thread (1, the default, renders serially);
+    /// output is bit-identical either way. Starts or stops threads, so call from a control thread
+    void setRenderThreadCount(int threadCount);
+    int getRenderThreadCount();
+    
     // after loading samples, call one of these to build the key map
     
     /// call for noteNumber 0-127 to define tuning table (defaults to standard 12-tone equal temperament)
@@ -64,9 +145,50 @@ public:
     void prepareNote(unsigned noteNumber, unsigned velocity, LoopDescriptor loop);
     void stopNote(unsigned noteNumber, bool immediate);
     void sustainPedal(bool down);
+
+    /// The calls above change voice state directly, so belong on the render thread. Other threads
+    /// should use these instead: they queue the call for the start of render()'s next chunk, and
+    /// never allocate. Calls from different control threads take turns queueing, so they may wait
+    /// briefly on each other, but never on render(). Each returns false if the queue is full, or if the loop has more
+    /// than SAMPLEBUFFER_RESERVED_LOOP_ENTRIES tracks or muted ranges. On the render thread they
+    /// act at once.
+    ///
+    /// Given a sampleTime (counted like render()'s now), a call is carried out on exactly that
+    /// frame: render() splits its chunk there. Calls due on the same frame are carried out in the
+    /// order queued; a call due later never holds back those queued after it, so untimed calls,
+    /// stopAllVoices() and restartVoices() act at the start of the next chunk whatever is pending.
+    /// Times already past mean the start of the next chunk too. postPlay() is due when its notes
+    /// start, so it follows the notes prepared for that frame. Up to 256 timed calls, a full queue,
+    /// may be pending; beyond that, the queue waits for the earliest of them.
+    bool postPrepareNote(unsigned noteNumber, unsigned velocity, LoopDescriptor loop, int64_t sampleTime = CORESAMPLER_NOW);
+    bool postPlay(int64_t sampleTime);
+    bool postStopNote(unsigned noteNumber, bool immediate, int64_t sampleTime = CORESAMPLER_NOW);
+    bool postSustainPedal(bool down, int64_t sampleTime = CORESAMPLER_NOW);
+
+    /// silences every voice, as MIDI's all-notes-off; unlike postStopAllVoices() it leaves new notes allowed
+    bool postAllNotesOff(int64_t sampleTime = CORESAMPLER_NOW);
+
+    /// queues one of the envelope setters below, e.g. postSetter(&CoreSampler::setADSRAttackDurationSeconds, 0.1f)
+    bool postSetter(void (CoreSampler::*setter)(float), float value, int64_t sampleTime = CORESAMPLER_NOW);
     
+    /// always renders stereo, into outBuffers[0] and [1], whatever channelCount says; adds nothing
+    /// while unloadAllSamples() is under way
     void render(unsigned channelCount, unsigned sampleCount, float *outBuffers[], int64_t now);
-    void renderVoice(bool allowSampleRunout, float cutoffMul, float *pOutLeft, float *pOutRight, DunneCore::SamplerVoice *pVoice, float pitchDev, unsigned int sampleCount);
+
+    // what every voice needs to render one piece of a chunk
+    struct VoiceRenderParameters
+    {
+        bool allowSampleRunout;
+        float cutoffMul, pitchDev;
+        unsigned sampleCount;
+        int64_t now;
+        int64_t chunkEnd;   // where render()'s chunk, which this piece is part of, ends
+    };
+
+    // render every voice for sampleCount frames, from now on, added into the output
+    void renderVoices(unsigned sampleCount, float *pOutLeft, float *pOutRight, int64_t now);
+    void renderVoiceChunk(const VoiceRenderParameters &p, float *pOutLeft, float *pOutRight, DunneCore::SamplerVoice *pVoice);
+    void renderVoice(const VoiceRenderParameters &p, float *pOutLeft, float *pOutRight, DunneCore::SamplerVoice *pVoice, int64_t now, unsigned int sampleCount);
     void extracted(bool allowSampleRunout, float cutoffMul, int nn, float *pOutLeft, float *pOutRight, DunneCore::SamplerVoice *pVoice, float pitchDev, unsigned int sampleCount);
     
     void extracted(bool allowSampleRunout, float cutoffMul, float *pOutLeft, float *pOutRight, DunneCore::SamplerVoice *pVoice, float pitchDev, unsigned int sampleCount);
@@ -164,7 +286,7 @@ protected:
     
     // helper functions
     DunneCore::SamplerVoice *voicePlayingNote(unsigned noteNumber);
-    DunneCore::SampleBufferGroup lookupSamples(unsigned noteNumber, unsigned velocity, LoopDescriptor loop);
+    bool lookupSamples(unsigned noteNumber, unsigned velocity, LoopDescriptor loop, DunneCore::SampleBufferGroup *group);
     void prepare(unsigned noteNumber,
               unsigned velocity,
               bool anotherKeyWasDown,
@@ -0,0 +1,383 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#include "SFZFile.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+// #include nests no deeper than this, so a file which includes itself fails instead of recursing forever
+#define SFZFILE_MAX_INCLUDE_DEPTH 16
+
+namespace DunneCore
+{
+    // the opcodes set so far under one header, over those it inherits
+    struct SFZFile::Opcodes
+    {
+        std::string sample;
+        int lokey = 0, hikey = 127, pitchKeycenter = 60;
+        int lovel = 0, hivel = 127;
+        int transpose = 0;
+        float tune = 0.0f;                  // cents
+        long offset = 0, end = 0;           // end is inclusive, and -1 silences the region
+        bool hasEnd = false;
+        SFZLoopMode loopMode = SFZNoLoop;
+        long loopStart = 0, loopEnd = 0;    // loopEnd is inclusive too
+        bool hasLoopEnd = false;
+        bool onNoteOn = true;               // trigger=attack (the default), first or legato
+    };
+
+    static bool isNameChar(char c)
+    {
+        return isalnum((unsigned char)c) || c == '_' || c == '$';
+    }
+
+    static bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    static bool isComment(const char *p, const char *end)
+    {
+        return p + 1 < end && p[0] == '/' && (p[1] == '/' || p[1] == '*');
+    }
+
+    // true if an opcode, name=, starts at p
+    static bool startsOpcode(const char *p, const char *end)
+    {
+        const char *q = p;
+        while (q < end && isNameChar(*q)) q++;
+        return q > p && q < end && *q == '=';
+    }
+
+    static bool parseLong(const std::string &value, long &result)
+    {
+        char *end;
+        long parsed = strtol(value.c_str(), &end, 10);
+        if (end == value.c_str() || *end != 0) return false;
+        result = parsed;
+        return true;
+    }
+
+    static bool parseInt(const std::string &value, int &result)
+    {
+        long parsed;
+        if (!parseLong(value, parsed)) return false;
+        result = (int)parsed;
+        return true;
+    }
+
+    // a MIDI note number, or a note name such as c4 (60), f#3 or eb-1
+    static bool parseKey(const std::string &value, int &result)
+    {
+        long key;
+        if (!parseLong(value, key))
+        {
+            static const int semitones[] = { 9, 11, 0, 2, 4, 5, 7 };     // a to g
+            const char *p = value.c_str();
+            char letter = (char)tolower((unsigned char)*p);
+            if (letter < 'a' || letter > 'g') return false;
+            key = semitones[letter - 'a'];
+            p++;
+            if (*p == '#') { key++; p++; }
+            else if (*p == 'b') { key--; p++; }
+            long octave;
+            if (!parseLong(p, octave)) return false;
+            key += 12 * (octave + 1);
+        }
+        if (key < 0 || key > 127) return false;
+        result = (int)key;
+        return true;
+    }
+
+    // walks the text once, carrying the header levels across any files it includes
+    struct SFZFile::Parser
+    {
+        SFZFile &file;
+        std::string directory, defaultPath;
+        Opcodes global, master, group, region;
+        Opcodes *current = 0;           // 0 before the first header, and under headers which are ignored
+        bool inControl = false, inMaster = false, inGroup = false, inRegion = false;
+        int regionLine = 0;
+        char *errorMessage;
+
+        Parser(SFZFile &file, const std::string &directory, char *errorMessage)
+        : file(file), directory(directory), errorMessage(errorMessage) {}
+
+        bool fail(int line, const char *what)
+        {
+            snprintf(errorMessage, 100, "line %d: %s", line, what);
+            return false;
+        }
+
+        // replace each $variable with its #define'd value, the longest name first where several match
+        std::string substitute(const char *begin, const char *end) const
+        {
+            std::string text(begin, end);
+            if (file.variables.empty() || text.find('$') == std::string::npos) return text;
+            std::string result;
+            for (size_t i = 0; i < text.size(); )
+            {
+                const std::pair<std::string, std::string> *match = 0;
+                if (text[i] == '$')
+                    for (const auto &variable : file.variables)
+                        if (text.compare(i, variable.first.size(), variable.first) == 0 &&
+                            (match == 0 || variable.first.size() > match->first.size())) match = &variable;
+                if (match)
+                {
+                    result += match->second;
+                    i += match->first.size();
+                }
+                else result += text[i++];
+            }
+            return result;
+        }
+
+        void finishRegion()
+        {
+            if (!inRegion) return;
+            inRegion = false;
+            const Opcodes &o = region;
+            if (o.sample.empty() || !o.onNoteOn || (o.hasEnd && o.end < 0)) return;
+
+            SFZRegion r;
+            std::string path = defaultPath + o.sample;
+            std::replace(path.begin(), path.end(), '\\', '/');
+            bool absolute = path[0] == '/' || (path.size() > 1 && path[1] == ':');
+            r.sample = absolute ? path : directory + path;
+
+            // played at pitch_keycenter, the sample sounds transpose semitones and tune cents higher
+            SampleDescriptor &sd = r.sampleDescriptor;
+            sd.noteNumber = o.pitchKeycenter;
+            sd.noteFrequency = 440.0f * powf(2.0f, (o.pitchKeycenter - o.transpose - o.tune / 100.0f - 69.0f) / 12.0f);
+            sd.minimumNoteNumber = o.lokey;
+            sd.maximumNoteNumber = o.hikey;
+            sd.minimumVelocity = o.lovel;
+            sd.maximumVelocity = o.hivel;
+            sd.startPoint = (float)o.offset;
+            sd.endPoint = o.hasEnd ? (float)(o.end + 1) : 0.0f;
+
+            r.loopMode = o.loopMode;
+            r.loopStart = (unsigned)std::max(0L, o.loopStart);
+            r.loopEnd = o.hasLoopEnd ? (unsigned)std::max(0L, o.loopEnd + 1) : 0;
+            r.lineNumber = regionLine;
+            file.regions.push_back(r);
+        }
+
+        // each level starts from the one above as it stands now, so the opcodes which follow its header count
+        void beginHeader(const std::string &name, int line)
+        {
+            finishRegion();
+            inControl = name == "control";
+            current = 0;
+            if (name == "global")
+            {
+                global = Opcodes();
+                inMaster = inGroup = false;
+                current = &global;
+            }
+            else if (name == "master")
+            {
+                master = global;
+                inMaster = true;
+                inGroup = false;
+                current = &master;
+            }
+            else if (name == "group")
+            {
+                group = inMaster ? master : global;
+                inGroup = true;
+                current = &group;
+            }
+            else if (name == "region")
+            {
+                region = inGroup ? group : inMaster ? master : global;
+                current = &region;
+                inRegion = true;
+                regionLine = line;
+            }
+        }
+
+        void setOpcode(const std::string &name, const std::string &value)
+        {
+            if (inControl)
+            {
+                if (name == "default_path") defaultPath = value;
+                return;
+            }
+            if (current == 0) return;
+            Opcodes &o = *current;
+            int key;
+            if (name == "sample") o.sample = value;
+            else if (name == "key" && parseKey(value, key)) o.lokey = o.hikey = o.pitchKeycenter = key;
+            else if (name == "lokey") parseKey(value, o.lokey);
+            else if (name == "hikey") parseKey(value, o.hikey);
+            else if (name == "pitch_keycenter") parseKey(value, o.pitchKeycenter);
+            else if (name == "lovel") parseInt(value, o.lovel);
+            else if (name == "hivel") parseInt(value, o.hivel);
+            else if (name == "transpose") parseInt(value, o.transpose);
+            else if (name == "tune") o.tune = (float)atof(value.c_str());
+            else if (name == "offset") parseLong(value, o.offset);
+            else if (name == "end") o.hasEnd = parseLong(value, o.end) || o.hasEnd;
+            else if (name == "loop_mode" || name == "loopmode")
+            {
+                if (value == "no_loop") o.loopMode = SFZNoLoop;
+                else if (value == "one_shot") o.loopMode = SFZOneShot;
+                else if (value == "loop_continuous") o.loopMode = SFZLoopContinuous;
+                else if (value == "loop_sustain") o.loopMode = SFZLoopSustain;
+            }
+            else if (name == "loop_start" || name == "loopstart") parseLong(value, o.loopStart);
+            else if (name == "loop_end" || name == "loopend") o.hasLoopEnd = parseLong(value, o.loopEnd) || o.hasLoopEnd;
+            else if (name == "trigger") o.onNoteOn = value == "attack" || value == "first" || value == "legato";
+        }
+
+        // #define $name value, or #include "path"; anything else is skipped to the end of the line
+        bool directive(const char *&p, const char *end, int line)
+        {
+            const char *q = p + 1, *word = q;
+            while (q < end && isNameChar(*q)) q++;
+            std::string name(word, q);
+            while (q < end && isBlank(*q)) q++;
+
+            if (name == "define")
+            {
+                const char *variable = q;
+                while (q < end && !isspace((unsigned char)*q)) q++;
+                std::string variableName(variable, q);
+                while (q < end && isBlank(*q)) q++;
+                const char *value = q, *valueEnd = q;
+                while (q < end && *q != '\n' && *q != '\r' && !isComment(q, end))
+                    if (!isBlank(*q++)) valueEnd = q;
+                if (variableName.size() < 2 || variableName[0] != '$') return fail(line, "bad #define");
+                std::string text = substitute(value, valueEnd);
+                auto it = std::find_if(file.variables.begin(), file.variables.end(),
+                                       [&](const std::pair<std::string, std::string> &v) { return v.first == variableName; });
+                if (it != file.variables.end()) it->second = text;
+                else file.variables.push_back(std::make_pair(variableName, text));
+            }
+            else if (name == "include")
+            {
+                const char *path = q + 1, *close = path;
+                while (close < end && *close != '"' && *close != '\n') close++;
+                if (q == end || *q != '"' || close == end || *close != '"') return fail(line, "bad #include");
+                if (file.includeDepth >= SFZFILE_MAX_INCLUDE_DEPTH) return fail(line, "#include nested too deeply");
+                std::string includePath = substitute(path, close);
+                std::replace(includePath.begin(), includePath.end(), '\\', '/');
+                std::string text;
+                if (!file.loadText(file.includeDirectory + includePath, text, errorMessage)) return false;
+                file.includeDepth++;
+                bool ok = run(text.data(), text.data() + text.size());
+                file.includeDepth--;
+                if (!ok) return false;
+                q = close + 1;
+            }
+            while (q < end && *q != '\n') q++;
+            p = q;
+            return true;
+        }
+
+        bool run(const char *p, const char *end)
+        {
+            int line = 1;
+            while (p < end)
+            {
+                if (*p == '\n')
+                {
+                    line++;
+                    p++;
+                }
+                else if (isspace((unsigned char)*p)) p++;
+                else if (isComment(p, end) && p[1] == '/')
+                {
+                    while (p < end && *p != '\n') p++;
+                }
+                else if (isComment(p, end))
+                {
+                    const char *q = p + 2;
+                    while (q + 1 < end && !(q[0] == '*' && q[1] == '/')) q++;
+                    if (q + 1 >= end) return fail(line, "unterminated comment");
+                    line += (int)std::count(p, q, '\n');
+                    p = q + 2;
+                }
+                else if (*p == '<')
+                {
+                    const char *close = p + 1;
+                    while (close < end && *close != '>' && *close != '\n') close++;
+                    if (close == end || *close != '>') return fail(line, "unterminated header");
+                    beginHeader(std::string(p + 1, close), line);
+                    p = close + 1;
+                }
+                else if (*p == '#')
+                {
+                    if (!directive(p, end, line)) return false;
+                }
+                else if (startsOpcode(p, end))
+                {
+                    // the value runs to the end of the line, or to the next opcode, header or comment,
+                    // so sample paths may contain spaces
+                    const char *equals = std::find(p, end, '=');
+                    const char *value = equals + 1, *valueEnd = value;
+                    for (const char *q = value; q < end && *q != '\n' && *q != '\r' && *q != '<' && !isComment(q, end); )
+                    {
+                        if (isBlank(*q))
+                        {
+                            while (q < end && isBlank(*q)) q++;
+                            if (startsOpcode(q, end)) break;
+                        }
+                        else valueEnd = ++q;
+                    }
+                    setOpcode(substitute(p, equals), substitute(value, valueEnd));
+                    p = valueEnd;
+                }
+                else
+                {
+                    // a stray word; skip it
+                    while (p < end && !isspace((unsigned char)*p)) p++;
+                }
+            }
+            return true;
+        }
+    };
+
+    bool SFZFile::loadText(const std::string &path, std::string &text, char *errorMessage)
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == 0)
+        {
+            snprintf(errorMessage, 100, "can't open %s", path.c_str());
+            return false;
+        }
+        char buffer[65536];
+        text.clear();
+        for (size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) > 0; ) text.append(buffer, n);
+        bool ok = !ferror(file);
+        fclose(file);
+        if (!ok) snprintf(errorMessage, 100, "can't read %s", path.c_str());
+        return ok;
+    }
+
+    bool SFZFile::load(const char *path, char *errorMessage)
+    {
+        std::string text;
+        regions.clear();
+        if (!loadText(path, text, errorMessage)) return false;
+        std::string name = path;
+        size_t slash = name.find_last_of("/\\");
+        std::string directory = slash == std::string::npos ? std::string() : name.substr(0, slash + 1);
+        return parse(text.data(), text.size(), directory, errorMessage);
+    }
+
+    bool SFZFile::parse(const char *text, size_t length, const std::string &directory, char *errorMessage)
+    {
+        regions.clear();
+        variables.clear();
+        includeDirectory = directory;
+        includeDepth = 0;
+        Parser parser(*this, directory, errorMessage);
+        if (!parser.run(text, text + length)) return false;
+        parser.finishRegion();
+        return true;
+    }
+}
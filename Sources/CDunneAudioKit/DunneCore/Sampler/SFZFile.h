@@ -0,0 +1,63 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#pragma once
+#include "Sampler_Typedefs.h"
+#include <string>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+
+namespace DunneCore
+{
+    // what a region does after its sample has played up to loop_end (SFZ loop_mode)
+    enum SFZLoopMode
+    {
+        SFZNoLoop,
+        SFZOneShot,
+        SFZLoopContinuous,
+        SFZLoopSustain
+    };
+
+    // one <region> of an SFZ file, with the opcodes of the <global>, <master> and <group> headers
+    // above it applied underneath its own
+    struct SFZRegion
+    {
+        SampleDescriptor sampleDescriptor;  // key and velocity ranges, tuning, offset and end
+        std::string sample;                 // path, with the file's directory and default_path applied
+        SFZLoopMode loopMode;
+        unsigned loopStart, loopEnd;        // frames; loopEnd is exclusive, 0 for the end of the sample
+        int lineNumber;                     // of its <region> header
+
+        bool isLooping() const { return loopMode == SFZLoopContinuous || loopMode == SFZLoopSustain; }
+    };
+
+    // SFZFile reads the regions of an SFZ file in one pass over its text, for the opcodes the
+    // sampler can play: sample, key, lokey, hikey, pitch_keycenter, lovel, hivel, tune, transpose,
+    // offset, end, loop_mode, loop_start and loop_end (and their SFZ 1 spellings), under <control>
+    // (default_path), <global>, <master>, <group> and <region> headers, with #define and #include.
+    // Keys may be numbers or note names (c4 is 60). Other opcodes and headers are ignored, as are
+    // regions with no sample or which don't sound on note-on, e.g. trigger=release.
+    class SFZFile
+    {
+    public:
+        /// read the file at path; false, with errorMessage (100 chars) filled in, if it or a file
+        /// it includes can't be read, or its text is malformed
+        bool load(const char *path, char *errorMessage);
+
+        /// read SFZ text, with sample paths relative to directory (which ends in a separator, or is empty)
+        bool parse(const char *text, size_t length, const std::string &directory, char *errorMessage);
+
+        std::vector<SFZRegion> regions;
+
+    private:
+        struct Opcodes;
+        struct Parser;
+
+        // #define'd variables, for $name substitution, and the directory #include paths are relative to
+        std::vector<std::pair<std::string, std::string>> variables;
+        std::string includeDirectory;
+        int includeDepth = 0;
+
+        bool loadText(const std::string &path, std::string &text, char *errorMessage);
+    };
+}
@@ -1,7 +1,14 @@
 // Copyright AudioKit. All Rights Reserved.
 
 #include "SampleBuffer.h"
-#include <Accelerate/Accelerate.h>
+#include "SampleInterpolator.h"
+#include "SampleMixCache.h"
+#include "SampleStream.h"
+#include "SampleStore.h"
+#include "SampleStretchCache.h"
+#include "VectorOps.h"
+#include <string.h>
+#include <stdint.h>
 
 namespace DunneCore
 {
@@ -12,6 +19,15 @@ namespace DunneCore
     , startPoint(0.0f)
     , endPoint(0.0f)
     , isInterleaved(false)
+    , residentCount(0)
+    , channelStride(0)
+    , stream(0)
+    , storeEntry(0)
+    , storageFormat(SampleStorageFloat32)
+    , packedSamples(0)
+    , packedScale(1.0f)
+    , octaveDown(0)
+    , ownedSamples(0)
     {
     }
     
@@ -26,12 +42,91 @@ namespace DunneCore
         this->sampleCount = sampleCount;
         this->channelCount = channelCount;
         this->isInterleaved = isInterleaved;
+        residentCount = sampleCount;
+        channelStride = sampleCount;
         startPoint = 0.0f;
     }
     
     void SampleBuffer::deinit()
     {
+        if (storeEntry) SampleStore::shared().release(storeEntry);
+        storeEntry = 0;
         samples = 0;
+        packedSamples = 0;
+        storageFormat = SampleStorageFloat32;
+        delete stream;
+        stream = 0;
+        delete octaveDown;
+        octaveDown = 0;
+        delete[] ownedSamples;
+        ownedSamples = 0;
+    }
+
+    size_t SampleBuffer::bytesPerFrame() const
+    {
+        return channelCount * sampleStorageBytes(storageFormat);
+    }
+
+    void SampleBuffer::addFrames(int channel, size_t frame, size_t count, float *output, bool reversed) const
+    {
+        size_t first = (channelCount == 1 ? 0 : channel * channelStride) + frame;
+        if (storageFormat == SampleStorageFloat32) {
+            if (reversed) vectorAddReversed(output, &samples[first], count);
+            else vectorAdd(output, &samples[first], count);
+            return;
+        }
+
+        // widen a block at a time, then add it as if it had been stored as floats
+        float block[SAMPLEBUFFER_CONVERT_BLOCKSIZE];
+        for (size_t done = 0; done < count; ) {
+            size_t n = std::min<size_t>(count - done, SAMPLEBUFFER_CONVERT_BLOCKSIZE);
+            size_t source = first + (reversed ? count - done - n : done);
+            if (storageFormat == SampleStorageInt16)
+                vectorConvertInt16(block, (const int16_t *)packedSamples + source, packedScale, n);
+            else
+                vectorConvertInt24(block, packedSamples + 3 * source, packedScale, n);
+
+            if (reversed) vectorAddReversed(output + done, block, n);
+            else vectorAdd(output + done, block, n);
+            done += n;
+        }
+    }
+
+    size_t SampleBuffer::buildOctaves(size_t maxBytes)
+    {
+        // interleaved samples can't be read a channel at a time, and streamed ones aren't all here
+        const int minimumCount = 64;
+        size_t count = (sampleCount + 1) / 2;
+        size_t bytes = channelCount * count * sizeof(float);
+        if (octaveDown || isStreamed() || (isInterleaved && channelCount > 1) || (samples == 0 && packedSamples == 0) ||
+            count < minimumCount || bytes > maxBytes) return 0;
+
+        // each channel widened to float with the filter's guard frames of silence either side,
+        // then filtered and decimated into the copy
+        const size_t guard = SAMPLEINTERPOLATION_HALFBAND_TAPS / 2;
+        std::vector<float> channel(sampleCount + 2 * guard);
+        octaveDown = new SampleBuffer();
+        octaveDown->init(sampleRate / 2, channelCount, (int)count, false);
+        octaveDown->ownedSamples = new float[channelCount * count];
+        octaveDown->samples = octaveDown->ownedSamples;
+        for (int c = 0; c < channelCount; c++)
+        {
+            vectorClear(channel.data(), channel.size());
+            addFrames(c, 0, sampleCount, channel.data() + guard, false);
+            decimateByTwo(channel.data() + guard, sampleCount, octaveDown->samples + c * count);
+        }
+        octaveDown->noteFrequency = noteFrequency;
+        octaveDown->startPoint = startPoint / 2;
+        octaveDown->endPoint = endPoint / 2;
+        return bytes + octaveDown->buildOctaves(maxBytes - bytes);
+    }
+
+    size_t SampleBuffer::getOctaveBytes() const
+    {
+        size_t bytes = 0;
+        for (const SampleBuffer *buffer = octaveDown; buffer; buffer = buffer->octaveDown)
+            bytes += buffer->channelCount * buffer->sampleCount * sizeof(float);
+        return bytes;
     }
 
     std::tuple<float, float> SampleBufferGroup::convert(float speed, float pitch, float varispeed) {
@@ -45,63 +140,253 @@ namespace DunneCore
         auto converted = convert(speed, pitch, varispeed);
         auto newSpeed = std::get<0>(converted);
         auto newPitch = std::get<1>(converted);
-        
+
+        // a baked loop only plays at the stretch it was baked at
+        if (bakedStretch && (bakedStretch->timeRatio != newSpeed || bakedStretch->pitchScale != newPitch)) {
+            resumeStretcher();
+        }
+
+        bool changed = false;
         if (stretcher->getTimeRatio() != newSpeed) {
             stretcher->setTimeRatio(newSpeed);
+            changed = true;
         }
 
         if (stretcher->getPitchScale() != newPitch) {
             stretcher->setPitchScale(newPitch);
+            changed = true;
         }
+
+        if (changed) {
+            settledUpdates = 0;
+            if (stretchCache) stretchCache->release(pendingStretch);
+            pendingStretch = 0;
+        } else if (settledUpdates < SAMPLESTRETCHCACHE_SETTLE_UPDATES && ++settledUpdates == SAMPLESTRETCHCACHE_SETTLE_UPDATES) {
+            if (!pendingStretch && !bakedStretch) requestStretch(true);
+        }
+    }
+
+    void SampleBufferGroup::requestStretch(bool bake) {
+        if (stretchCache == 0 || isStreaming || sampleCount == 0) return;
+        pendingStretch = stretchCache->acquire(sampleBuffers, loop.startPoint, sampleCount, loop.reversed,
+                                               (float)stretcher->getTimeRatio(), (float)stretcher->getPitchScale(), bake);
+        if (pendingStretch) settledUpdates = SAMPLESTRETCHCACHE_SETTLE_UPDATES;
+    }
+
+    void SampleBufferGroup::playBakedStretch() {
+        if (!pendingStretch->isReady()) return;
+        stretchCache->release(bakedStretch);
+        bakedStretch = pendingStretch;
+        pendingStretch = 0;
+        bakedSamples[0] = bakedStretch->samples[0];
+        bakedSamples[1] = bakedStretch->samples[1];
+        bakedCount = bakedStretch->stretchedCount;
+        stretchCache->countPlay();
+    }
+
+    void SampleBufferGroup::resumeStretcher() {
+        // the loop's frame which stretched to where the baked output had got to
+        processPosition = std::min<size_t>(size_t(bakedPosition / bakedStretch->timeRatio), sampleCount - 1);
+        stretchCache->release(bakedStretch);
+        bakedStretch = 0;
+        stretcher->reset();
+        settledUpdates = 0;
     }
 
-    void SampleBufferGroup::init(std::list<SampleBuffer*> buffers, LoopDescriptor loop) {
-        if (buffers.size() == 0) return;
-        
-        this->sampleBuffers = buffers;
-        auto buffer = buffers.front();
-        auto sampleRate = buffer->sampleRate;
-        
-        auto converted = convert(loop.speed, loop.pitch, loop.varispeed);
-        auto ratio = std::get<0>(converted);
-        auto pitch = std::get<1>(converted);
-
-        RubberBand::RubberBandStretcher::Options options = 0;
-        options |= RubberBand::RubberBandStretcher::OptionProcessRealTime;
-        options |= RubberBand::RubberBandStretcher::OptionChannelsTogether;
-        options |= RubberBand::RubberBandStretcher::OptionStretchPrecise;
-        
-        stretcher = new RubberBand::RubberBandStretcher(sampleRate, 2, options, ratio, pitch);
-
-        auto count = *sampleCount = loop.endPoint - loop.startPoint;
-
-        scaledSamples[0] = new float [1] {0};
-        scaledSamples[1] = new float [1] {0};
-        
-        float **samples = new float *[2];
-        samples[0] = new float[count];
-        samples[1] = new float[count];
-        memset(samples[0], 0, count * sizeof(float));
-        memset(samples[1], 0, count * sizeof(float));
-
-        auto stride = vDSP_Stride(1);
-        auto length = vDSP_Length(*sampleCount);
-
-        for (auto buffer : buffers) {
-            vDSP_vadd(samples[0], stride, &buffer->samples[loop.startPoint], stride, samples[0], stride, length);
-            
-            if (buffer->channelCount == 1) {
-                vDSP_vadd(samples[1], stride, samples[0], stride, samples[1], stride, length);
-            } else {
-                vDSP_vadd(samples[1], stride, &buffer->samples[buffer->sampleCount + loop.startPoint], stride, samples[1], stride, length);
+    void SampleBufferGroup::releaseStretches() {
+        if (stretchCache) {
+            stretchCache->release(pendingStretch);
+            stretchCache->release(bakedStretch);
+        }
+        pendingStretch = bakedStretch = 0;
+        settledUpdates = 0;
+    }
+
+    void SampleBufferGroup::allocate(size_t maxBuffers)
+    {
+        sampleBuffers.reserve(maxBuffers);
+        streamRings.reserve(maxBuffers);
+        enabledTracks.reserve(std::max<size_t>(maxBuffers, SAMPLEBUFFER_RESERVED_LOOP_ENTRIES));
+        mutedStartPoints.reserve(SAMPLEBUFFER_RESERVED_LOOP_ENTRIES);
+        mutedEndPoints.reserve(SAMPLEBUFFER_RESERVED_LOOP_ENTRIES);
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (mixSamples[i] == 0) mixSamples[i] = new float[SAMPLEBUFFER_FEED_BLOCKSIZE];
+            if (scaledSamples[i] == 0)
+            {
+                float *guarded = new float[SAMPLEBUFFER_RETRIEVE_BLOCKSIZE + 2 * SAMPLEINTERPOLATION_MAX_TAPS]();
+                scaledSamples[i] = guarded + SAMPLEINTERPOLATION_MAX_TAPS;
             }
         }
-     
-        if (loop.reversed) {
-            vDSP_vrvrs(samples[0], stride, length);
-            vDSP_vrvrs(samples[1], stride, length);
+    }
+
+    void SampleBufferGroup::deallocate()
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            delete[] mixSamples[i];
+            mixSamples[i] = 0;
+            if (scaledSamples[i]) delete[] (scaledSamples[i] - SAMPLEINTERPOLATION_MAX_TAPS);
+            scaledSamples[i] = 0;
         }
+    }
+
+    void SampleBufferGroup::release()
+    {
+        if (mixCache) mixCache->release(cachedMix);
+        mixCache = 0;
+        cachedMix = 0;
+        releaseStreams();
+        releaseStretches();
+        channelSamples[0] = channelSamples[1] = 0;
+        sampleBuffers.clear();
+        sampleCount = 0;
+    }
+
+    bool SampleBufferGroup::init(LoopDescriptor newLoop, SampleMixCache *cache, SampleStreamRingPool *pool, int octaves) {
+        if (mixCache) mixCache->release(cachedMix);
+        mixCache = cache;
+        cachedMix = 0;
+        releaseStreams();
+        releaseStretches();
+        streamPool = pool;
+
+        sampleCount = 0;
+        if (sampleBuffers.size() == 0 || stretcher == 0 || mixSamples[0] == 0) return false;
+
+        // keep our own copies of the loop's arrays, so the caller's may go away
+        enabledTracks.assign(newLoop.enabledTracks, newLoop.enabledTracks + newLoop.enabledTracksCount);
+        mutedStartPoints.assign(newLoop.mutedStartPoints, newLoop.mutedStartPoints + newLoop.mutedCount);
+        mutedEndPoints.assign(newLoop.mutedEndPoints, newLoop.mutedEndPoints + newLoop.mutedCount);
+        loop = newLoop;
+        loop.enabledTracks = enabledTracks.data();
+        loop.mutedStartPoints = mutedStartPoints.data();
+        loop.mutedEndPoints = mutedEndPoints.data();
+
+        // further down the pyramid every frame counts for 2^octaves
+        if (octaves > 0) {
+            for (auto &buffer : sampleBuffers)
+                if ((buffer = buffer->getOctave(octaves)) == 0) return false;
+            loop.startPoint >>= octaves;
+            loop.endPoint >>= octaves;
+            for (auto &point : mutedStartPoints) point >>= octaves;
+            for (auto &point : mutedEndPoints) point >>= octaves;
+        }
+
+        // an end point at or before the start point means "play to the end of the sample"
+        size_t count = loop.endPoint > loop.startPoint ? loop.endPoint - loop.startPoint : SIZE_MAX;
+        for (auto buffer : sampleBuffers) {
+            if (buffer->sampleCount <= (int)loop.startPoint) return false;
+            count = std::min<size_t>(count, buffer->sampleCount - loop.startPoint);
+        }
+        sampleCount = count;
+
+        // tracks whose loop runs on past their resident frames are streamed, through a ring each
+        for (auto buffer : sampleBuffers) {
+            SampleStreamRing *ring = 0;
+            if (buffer->isStreamed() && loop.startPoint + sampleCount > (size_t)buffer->residentCount) {
+                if (pool == 0 || (ring = pool->acquire()) == 0) {
+                    releaseStreams();
+                    sampleCount = 0;
+                    return false;
+                }
+                isStreaming = true;
+            }
+            streamRings.push_back(ring);
+        }
+
+        processPosition = 0;
+        if (isStreaming) {
+            channelSamples[0] = channelSamples[1] = 0;
+            restartStreams();
+            return true;
+        }
+
+        // a single track played forwards needs no mixing, so is fed to the stretcher in place;
+        // anything else is mixed as it is fed until the mix cache has it ready
+        auto buffer = sampleBuffers.front();
+        channelSamples[0] = channelSamples[1] = 0;
+        if (sampleBuffers.size() == 1 && !loop.reversed && buffer->samples) {
+            channelSamples[0] = &buffer->samples[loop.startPoint];
+            channelSamples[1] = buffer->channelCount == 1 ? channelSamples[0] : &buffer->samples[buffer->channelStride + loop.startPoint];
+        } else if (mixCache) {
+            cachedMix = mixCache->acquire(sampleBuffers, loop.startPoint, sampleCount, loop.reversed);
+            useCachedMix();
+        }
+
+        // a loop already baked at the stretcher's current speed and pitch plays from the start
+        requestStretch(false);
+        return true;
+    }
+
+    void SampleBufferGroup::useCachedMix() {
+        if (cachedMix && cachedMix->isReady()) {
+            channelSamples[0] = cachedMix->samples[0];
+            channelSamples[1] = cachedMix->samples[1];
+        }
+    }
+
+    void SampleBufferGroup::restartStreams() {
+        for (size_t i = 0; i < streamRings.size(); i++) {
+            if (streamRings[i] == 0) continue;
+
+            // played forwards, the loop starts with whatever of it is resident; the ring takes over after that
+            auto buffer = sampleBuffers[i];
+            size_t resident = 0;
+            if (!loop.reversed && buffer->residentCount > (int)loop.startPoint)
+                resident = std::min<size_t>(sampleCount, buffer->residentCount - loop.startPoint);
+            streamRings[i]->begin(buffer, loop.startPoint, sampleCount, loop.reversed, resident);
+        }
+        streamPosition = 0;
+    }
+
+    void SampleBufferGroup::releaseStreams() {
+        for (auto ring : streamRings)
+            if (ring) streamPool->release(ring);
+        streamRings.clear();
+        isStreaming = false;
+        streamPosition = 0;
+    }
+
+    void SampleBufferGroup::mix(size_t position, size_t count) {
+        if (!isStreaming) {
+            mixSampleBuffers(sampleBuffers, loop.startPoint, sampleCount, loop.reversed, position, count, mixSamples);
+            return;
+        }
+
+        vectorClear(mixSamples[0], count);
+        vectorClear(mixSamples[1], count);
+        for (size_t i = 0; i < sampleBuffers.size(); i++) {
+            SampleStreamRing *ring = streamRings[i];
+            if (ring == 0) {
+                addSampleBuffer(sampleBuffers[i], loop.startPoint, sampleCount, loop.reversed, position, count, mixSamples);
+                continue;
+            }
+
+            size_t head = 0;
+            if (streamPosition < ring->firstPosition)
+                head = (size_t)std::min<uint64_t>(count, ring->firstPosition - streamPosition);
+            if (head > 0)
+                addSampleBuffer(sampleBuffers[i], loop.startPoint, sampleCount, false, position, head, mixSamples);
+            if (head < count)
+                ring->addTo(streamPosition + head, count - head, mixSamples[0] + head, mixSamples[1] + head);
+        }
+        streamPosition += count;
+    }
+
+    void addSampleBuffer(const SampleBuffer *buffer, size_t startPoint, size_t rangeCount,
+                         bool reversed, size_t position, size_t count, float *const output[2]) {
+        auto offset = startPoint + (reversed ? rangeCount - position - count : position);
+        buffer->addFrames(0, offset, count, output[0], reversed);
+        buffer->addFrames(1, offset, count, output[1], reversed);
+    }
 
-        channelSamples = samples;
+    void mixSampleBuffers(const std::vector<SampleBuffer*> &buffers, size_t startPoint, size_t rangeCount,
+                          bool reversed, size_t position, size_t count, float *const output[2]) {
+        vectorClear(output[0], count);
+        vectorClear(output[1], count);
+        for (auto buffer : buffers)
+            addSampleBuffer(buffer, startPoint, rangeCount, reversed, position, count, output);
     }
 }
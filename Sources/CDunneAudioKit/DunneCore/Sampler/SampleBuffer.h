@@ -1,19 +1,47 @@
 // Copyright AudioKit. All Rights Reserved.
 
 #pragma once
-#include <list>
+#include <vector>
+#include <algorithm>
 #include <math.h>       /* isnan, sqrt */
+#include <stdint.h>
+#include <string.h>
 
 #include "Sampler_Typedefs.h"
+#include "SampleInterpolator.h"
 #include "../RubberBand/rubberband/RubberBandStretcher.h"
 
+// stretched audio is retrieved from the RubberBand stretcher in blocks of this many frames
+#define SAMPLEBUFFER_RETRIEVE_BLOCKSIZE 16
+
+// voices which interpolate resample the stretched audio this many frames at a time (a render chunk)
+#define SAMPLEBUFFER_RESAMPLE_BLOCKSIZE 16
+
+// multi-track and reversed groups are mixed into a scratch buffer of this many frames as they are fed
+#define SAMPLEBUFFER_FEED_BLOCKSIZE 1024
+
+// space reserved in each group for LoopDescriptor track and mute lists
+#define SAMPLEBUFFER_RESERVED_LOOP_ENTRIES 64
+
+// compactly stored samples are converted to float through a stack buffer of this many frames
+#define SAMPLEBUFFER_CONVERT_BLOCKSIZE 256
+
 namespace DunneCore
 {
+    class SampleMixCache;
+    struct SampleMix;
+    class SampleStream;
+    class SampleStreamRing;
+    class SampleStreamRingPool;
+    class SampleStretchCache;
+    struct SampleStretch;
+    struct SampleStoreEntry;
+
     // SampleBuffer represents an array of sample data, which can be addressed with a real-valued
     // "index" via linear interpolation.
     struct SampleBuffer
     {
-        float *samples;
+        float *samples;             // 0 if stored compactly
         float sampleRate;
         int channelCount;
         int sampleCount;
@@ -21,6 +49,48 @@ namespace DunneCore
         bool isInterleaved;
         float noteFrequency;
 
+        // A streamed buffer holds only its first residentCount frames in samples[]; the rest are read
+        // from stream as they are needed. Otherwise residentCount == sampleCount and stream is 0.
+        // Planar buffers' right channel starts at samples[channelStride], which is residentCount
+        // unless the channels were padded to start aligned.
+        int residentCount;
+        int channelStride;
+        SampleStream *stream;       // owned
+        const SampleStoreEntry *storeEntry;     // where samples[] came from, if the SampleStore
+
+        // Compactly stored buffers keep 16-bit or packed 24-bit integers in packedSamples (planar
+        // like samples[]), which are converted to float as they are played, times packedScale.
+        SampleStorageFormat storageFormat;
+        const uint8_t *packedSamples;
+        float packedScale;
+
+        // Optionally, a copy at half the rate, half-band filtered, with one of its own and so on: an
+        // octave pyramid. Voices resampling their notes more than an octave up play a copy instead,
+        // at an increment of at most 1, so they alias less and read less memory. Each copy owns its
+        // samples[] (ownedSamples), and each buffer its octaveDown.
+        SampleBuffer *octaveDown;
+        float *ownedSamples;
+
+        bool isStreamed() { return stream != 0; }
+        size_t bytesPerFrame() const;
+
+        /// not realtime-safe: build the pyramid below this buffer, for as many octaves as fit in
+        /// maxBytes, down to a few frames; resident buffers only. Returns the bytes it took.
+        size_t buildOctaves(size_t maxBytes);
+
+        /// the buffer octaves below this one, or 0 if the pyramid doesn't go that deep
+        SampleBuffer *getOctave(int octaves)
+        {
+            SampleBuffer *buffer = this;
+            for (int o = 0; o < octaves && buffer; o++) buffer = buffer->octaveDown;
+            return buffer;
+        }
+        size_t getOctaveBytes() const;
+
+        /// add count resident frames of one channel (0 or 1; mono buffers play channel 0 for both),
+        /// from frame on, into output, read backwards if reversed
+        void addFrames(int channel, size_t frame, size_t count, float *output, bool reversed) const;
+
         SampleBuffer();
         ~SampleBuffer();
         
@@ -28,22 +98,87 @@ namespace DunneCore
         void deinit();
     };
     
+    // Sum count frames of the given tracks into output[0..1] (mono tracks feed both channels), starting
+    // position frames into the range [startPoint, startPoint + rangeCount), read backwards if reversed.
+    // The frames must be resident.
+    void mixSampleBuffers(const std::vector<SampleBuffer*> &buffers, size_t startPoint, size_t rangeCount,
+                          bool reversed, size_t position, size_t count, float *const output[2]);
+
+    // the same for one track, adding to output[0..1] rather than replacing it
+    void addSampleBuffer(const SampleBuffer *buffer, size_t startPoint, size_t rangeCount,
+                         bool reversed, size_t position, size_t count, float *const output[2]);
+
+    // SampleBufferGroup is everything a voice needs to play one or more sample buffers (tracks)
+    // through the time-stretcher. Each voice owns a pair of preallocated groups, so init() can run
+    // at note-on without allocating and without copying sample data: single-track groups feed the
+    // stretcher straight from the sample buffer, others are mixed block by block as they are fed.
     class SampleBufferGroup {
     public:
-        std::list<SampleBuffer*> sampleBuffers;
-        RubberBand::RubberBandStretcher* stretcher;
-        float **channelSamples = 0;
-        float **processSamples = new float *[2];
-        size_t *processPosition = new size_t(0);
-        float **scaledSamples = new float *[2];
-        size_t *sampleCount = new size_t;
-        
+        std::vector<SampleBuffer*> sampleBuffers;
+        RubberBand::RubberBandStretcher *stretcher = 0;     // owned by the voice
+
+        // copy of the loop passed to init(); its arrays point into the vectors below
+        LoopDescriptor loop = {};
+        std::vector<unsigned int> enabledTracks, mutedStartPoints, mutedEndPoints;
+
+        float *channelSamples[2] = { 0, 0 };    // single track or cached mix, or 0 if mixing is required
+        float *mixSamples[2] = { 0, 0 };        // SAMPLEBUFFER_FEED_BLOCKSIZE frames of scratch
+        float *processSamples[2] = { 0, 0 };
+        size_t processPosition = 0;
+        size_t sampleCount = 0;
+
+        // up to SAMPLEBUFFER_RETRIEVE_BLOCKSIZE frames of stretched output, drained by a SampleBufferView;
+        // each has SAMPLEINTERPOLATION_MAX_TAPS guard frames allocated either side of it, so the view
+        // can keep the end of the previous block ahead of the next for interpolation to read
+        float *scaledSamples[2] = { 0, 0 };
+
+        // how the view reads scaledSamples; set by the sampler along with the tracks
+        SampleInterpolation interpolation = SampleInterpolationNone;
+
+        // prepared mix shared through the sampler's cache, if any; fed from once it is ready
+        SampleMixCache *mixCache = 0;
+        const SampleMix *cachedMix = 0;
+
+        // one ring per track (0 for tracks which are resident), and frames of the loop consumed
+        // since the note started, which is where the rings are read from
+        SampleStreamRingPool *streamPool = 0;
+        std::vector<SampleStreamRing*> streamRings;
+        uint64_t streamPosition = 0;
+        bool isStreaming = false;
+
+        // With a stretch cache (set by the sampler along with the tracks), once the speed and pitch
+        // have held for SAMPLESTRETCHCACHE_SETTLE_UPDATES updates the group asks for its loop baked
+        // at them (pendingStretch). From the next loop restart it plays that (bakedSamples) instead
+        // of running the stretcher, until the speed or pitch changes.
+        SampleStretchCache *stretchCache = 0;
+        SampleStretch *pendingStretch = 0, *bakedStretch = 0;
+        float *bakedSamples[2] = { 0, 0 };
+        size_t bakedCount = 0, bakedPosition = 0;
+        int settledUpdates = 0;
+
+        SampleBufferGroup() {}
+        ~SampleBufferGroup() { deallocate(); }
+        SampleBufferGroup(const SampleBufferGroup&) = delete;
+        SampleBufferGroup& operator=(const SampleBufferGroup&) = delete;
+
+        /// not realtime-safe: reserve room for up to maxBuffers tracks, and allocate scratch buffers
+        void allocate(size_t maxBuffers);
+        void deallocate();
+
+        /// drop the tracks and any cached mix, e.g. before samples are unloaded
+        void release();
+
+        /// realtime-safe as long as sampleBuffers fits the reserved space; returns false if
+        /// unplayable, including when a track needs streaming and the pool has no ring left for it. With octaves > 0, plays every
+        /// track's copy that many octaves down its pyramid instead, with the loop in its frames.
+        bool init(LoopDescriptor loop, SampleMixCache *cache = 0, SampleStreamRingPool *pool = 0, int octaves = 0);
+
         double fadeTime = 100.0;
         double sampleTime = 1.0 / 48000.0;
         double power = exp(log(10) * sampleTime / fadeTime);
 
-        void init(std::list<SampleBuffer*> buffers, LoopDescriptor loop);
         void update(float speed, float pitch, float varispeed);
+        void mix(size_t position, size_t count);
         std::tuple<float, float> convert(float speed, float pitch, float varispeed);
         
         inline float convertSpeed(float value) {
@@ -54,82 +189,200 @@ namespace DunneCore
             return std::min<float>(std::max<float>(((value + 24) / 24), 1.0f / 24.0f), 48);
         }
         
-        inline void indices(double index, int *a, int *b, double *diff) {
-            int pIndex = int(index);
-            *diff = index - pIndex;
-            *a = pIndex;
-            *b = *a + 1;
+        // discard all stretcher state, e.g. at note start; a baked loop takes over here if one is ready
+        inline void reset() {
+            if (pendingStretch) playBakedStretch();
+            bakedPosition = 0;
+            stretcher->reset();
+            processPosition = 0;
+            if (streamPosition != 0) restartStreams();
         }
-        
-        // Use double for the real-valued index, because oscillators will need the extra precision.
-        inline float interp(float *samples, size_t count, double index)
-        {
-            int a, b;
-            double diff;
-            indices(index, &a, &b, &diff);
-            
-            float si = samples[a % count];
-            float sj = samples[b % count];
-            return (float)((1.0 - diff) * si + diff * sj);
+
+        // feed from the cached mix if it is ready; it holds the same frames mix() would make
+        void useCachedMix();
+
+        // stream every streamed track from the start of the loop again
+        void restartStreams();
+        void releaseStreams();
+
+        // hold the cache's entry for the loop at the stretcher's current speed and pitch, having it
+        // baked if need be; play it once ready; go back to the stretcher from where it had got to
+        void requestStretch(bool bake);
+        void playBakedStretch();
+        void resumeStretcher();
+        void releaseStretches();
+
+        // feed the stretcher until it has output ready, then retrieve up to one block of it
+        // into scaledSamples; returns the number of frames retrieved
+        inline size_t retrieveBlock() {
+            if (bakedStretch) {
+                size_t count = std::min<size_t>(SAMPLEBUFFER_RETRIEVE_BLOCKSIZE, bakedCount - bakedPosition);
+                memcpy(scaledSamples[0], bakedSamples[0] + bakedPosition, count * sizeof(float));
+                memcpy(scaledSamples[1], bakedSamples[1] + bakedPosition, count * sizeof(float));
+                bakedPosition = bakedPosition + count < bakedCount ? bakedPosition + count : 0;
+                return count;
+            }
+
+            while (stretcher->available() < 1) {
+                if (cachedMix && !channelSamples[0]) useCachedMix();
+                auto minSize = stretcher->getSamplesRequired();
+                auto samplesLeft = sampleCount - processPosition;
+                auto size = std::min(minSize, samplesLeft);
+
+                if (channelSamples[0]) {
+                    processSamples[0] = &channelSamples[0][processPosition];
+                    processSamples[1] = &channelSamples[1][processPosition];
+                } else {
+                    size = std::min<size_t>(size, SAMPLEBUFFER_FEED_BLOCKSIZE);
+                    mix(processPosition, size);
+                    processSamples[0] = mixSamples[0];
+                    processSamples[1] = mixSamples[1];
+                }
+
+                stretcher->process(processSamples, size, false);
+                processPosition = (processPosition + size) % sampleCount;
+            }
+
+            size_t count = std::min<size_t>(stretcher->available(), SAMPLEBUFFER_RETRIEVE_BLOCKSIZE);
+            return stretcher->retrieve(scaledSamples, count);
         }
-        
-        inline void interp(float **samples, size_t count, double fIndex, float *leftOutput, float *rightOutput)
+    };
+
+    // SampleBufferView is the lightweight, non-owning view of a playing group used by the per-frame
+    // oscillator loop: the stretched output and its read position, plus the few constants it needs,
+    // so the hot path never chases the group's vectors or the first track's descriptor.
+    struct SampleBufferView
+    {
+        SampleBufferGroup *group = 0;       // refills samples[] from its stretcher; 0 if nothing to play
+        float *samples[2] = { 0, 0 };       // the group's stretched output
+        size_t position = 0, count = 0;     // read position and number of frames in samples[]
+        int lastIndex = -1;
+
+        size_t sampleCount = 0;             // frames in the group's loop
+        double length = 0;                  // past this index the note has run out of samples
+        int fadeSize = 0;                   // fade in/out of muted regions, in frames
+        double fadeTime = 100.0;
+        double power = 1.0;
+
+        // With interpolation, the stretched output is instead resampled a block at a time into
+        // resampled[], reading samples[] from readPoint (in frames from the start of the current
+        // block) at the oscillator's increment, so the note's pitch, bend and vibrato apply.
+        SampleInterpolation interpolation = SampleInterpolationNone;
+        int halfTaps = 0;
+        double readPoint = 0;
+        float resampled[2][SAMPLEBUFFER_RESAMPLE_BLOCKSIZE];
+        size_t resampledPosition = 0, resampledCount = 0;
+
+        // point at group (which may be 0) and discard its stretcher state, e.g. at note start
+        void init(SampleBufferGroup *group)
         {
-            if (samples == 0)
-            {
-                *leftOutput = *rightOutput = 0.0f;
+            this->group = group;
+            if (group == 0 || group->sampleBuffers.empty()) {
+                this->group = 0;
                 return;
             }
-    
-            *leftOutput = interp(samples[0], count, fIndex);
-            *rightOutput = interp(samples[1], count, fIndex);
+
+            auto sampleBuffer = group->sampleBuffers.front();
+            samples[0] = group->scaledSamples[0];
+            samples[1] = group->scaledSamples[1];
+            sampleCount = group->sampleCount;
+            length = sampleBuffer->endPoint - sampleBuffer->startPoint;
+            fadeSize = (int)sampleBuffer->sampleRate / 100;
+            fadeTime = group->fadeTime;
+            power = group->power;
+            interpolation = group->interpolation;
+            halfTaps = sampleInterpolationTaps(interpolation) / 2;
+            reset();
         }
-        
-        inline double fade(int index) {
-            size_t fadeOutIndex = *sampleCount - fadeTime - 1;
+
+        inline void reset() {
+            group->reset();
+            position = count = 0;
+            lastIndex = -1;
+            readPoint = 0;
+            resampledPosition = resampledCount = 0;
+
+            // what interpolation reads before the first frame is silence
+            if (interpolation != SampleInterpolationNone)
+                for (int c = 0; c < 2; c++) std::fill(samples[c] - SAMPLEINTERPOLATION_MAX_TAPS, samples[c], 0.0f);
+        }
+
+        // move the last guard frames of the block (reaching back into the guard before it, if the
+        // block is short) ahead of samples[], and retrieve the next block after them
+        inline void refill() {
+            for (int c = 0; c < 2; c++)
+                memmove(samples[c] - SAMPLEINTERPOLATION_MAX_TAPS, samples[c] + count - SAMPLEINTERPOLATION_MAX_TAPS,
+                        SAMPLEINTERPOLATION_MAX_TAPS * sizeof(float));
+            readPoint -= count;
+            count = group->retrieveBlock();
+        }
+
+        // fill resampled[] with the next block, reading rate frames of stretched output per frame
+        void resample(double rate) {
+            size_t done = 0;
+            while (done < SAMPLEBUFFER_RESAMPLE_BLOCKSIZE) {
+                // the kernel may read up to halfTaps frames past each position, so stop short of the end
+                double limit = double(count) - halfTaps;
+                if (readPoint >= limit) {
+                    refill();
+                    if (count == 0) break;
+                    continue;
+                }
+                size_t n = std::min<size_t>(SAMPLEBUFFER_RESAMPLE_BLOCKSIZE - done, (size_t)ceil((limit - readPoint) / rate));
+                float *output[2] = { resampled[0] + done, resampled[1] + done };
+                interpolateSamples(interpolation, samples, readPoint, rate, output, n);
+                readPoint += n * rate;
+                done += n;
+            }
+            for (int c = 0; c < 2; c++) std::fill(resampled[c] + done, resampled[c] + SAMPLEBUFFER_RESAMPLE_BLOCKSIZE, 0.0f);
+            resampledPosition = 0;
+            resampledCount = SAMPLEBUFFER_RESAMPLE_BLOCKSIZE;
+        }
+
+        inline double fade(size_t index) {
             double gain = 0.01;
             
             if (index < fadeTime) {
                 return gain * pow(index + 1, power);
-            } else if (index > fadeOutIndex) {
-                return gain * pow(fadeTime - (index - fadeOutIndex), power);
-            } else {
-                return 1;
             }
+            // a loop no longer than the fade only fades in
+            if (sampleCount > fadeTime + 1) {
+                size_t fadeOutIndex = size_t(double(sampleCount) - fadeTime - 1);
+                if (index > fadeOutIndex) {
+                    return gain * pow(fadeTime - double(index - fadeOutIndex), power);
+                }
+            }
+            return 1;
         }
 
-        inline void process(int index) {
-            if (index == 0) {
-                stretcher->reset();
-                *processPosition = 0;
+        inline void process(int index, double rate) {
+            if (index == 0 && lastIndex != 0) {
+                reset();
             }
+            lastIndex = index;
 
-            while (stretcher->available() < 1) {
-                auto minSize = stretcher->getSamplesRequired();
-                auto samplesLeft = *sampleCount - *processPosition;
-                auto size = std::min(std::min(minSize, samplesLeft), *sampleCount);
-
-                processSamples[0] = &channelSamples[0][*processPosition];
-                processSamples[1] = &channelSamples[1][*processPosition];
-
-                stretcher->process(processSamples, size, false);
-                *processPosition = (*processPosition + size) % *sampleCount;
+            if (interpolation != SampleInterpolationNone) {
+                if (resampledPosition >= resampledCount) resample(rate);
+            } else if (position >= count) {
+                count = group->retrieveBlock();
+                position = 0;
             }
-            
-            stretcher->retrieve(scaledSamples, 1);
         }
 
-        inline void interp(float *leftSample, float *rightSample, double *indexPoint, double increment, double multiplier, LoopDescriptor loop) {
-            auto sampleBuffer = sampleBuffers.front();
-            auto index = int(*indexPoint);
-            process(index);
+        inline void interp(float *leftSample, float *rightSample, double *indexPoint, double increment, double multiplier, const LoopDescriptor &loop) {
+            auto index = size_t(*indexPoint);
+            process(int(index), increment * multiplier);
 
-//            float left = 0, right = 0;
-//            interp(scaledSamples, *scaledCount, index, &left, &right);
-            float left = scaledSamples[0][0];
-            float right = scaledSamples[1][0];
-//            float left = channelSamples[0][int(*indexPoint)];
-//            float right = channelSamples[1][int(*indexPoint)];
+            float left, right;
+            if (interpolation != SampleInterpolationNone) {
+                left = resampled[0][resampledPosition];
+                right = resampled[1][resampledPosition];
+                resampledPosition++;
+            } else {
+                left = samples[0][position];
+                right = samples[1][position];
+                position++;
+            }
 
             if (isnan(left)) {
                 left = 0;
@@ -145,7 +398,7 @@ namespace DunneCore
             
             *indexPoint += increment * multiplier;
 
-            if (loop.isLooping && *indexPoint >= *sampleCount) {
+            if (loop.isLooping && *indexPoint >= sampleCount) {
                 *indexPoint = 0;
             }
         }
@@ -158,6 +411,11 @@ namespace DunneCore
         int noteNumber;     // closest MIDI note-number to this sample's frequency (noteFrequency)
         int minimumNoteNumber, maximumNoteNumber;     // bounding note numbers for mapping
         int minimumVelocity, maximumVelocity;       // min/max MIDI velocities for mapping
+
+        // the loop its instrument file defines (an SFZ region's loop_start and loop_end), if isLooping;
+        // loopEndPoint is exclusive, 0 for the end of the sample
+        bool isLooping = false;
+        unsigned loopStartPoint = 0, loopEndPoint = 0;
     };
 
 }
@@ -0,0 +1,319 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#include "SampleInterpolator.h"
+#include "VectorOps.h"
+#include <math.h>
+#include <algorithm>
+
+// vDSP has nothing for multi-tap fractional reads, so on Apple platforms the kernels use the
+// intrinsics the CPU has, as they do elsewhere
+#if defined DUNNECORE_VECTOROPS_AVX2 || defined DUNNECORE_VECTOROPS_SSE || (defined DUNNECORE_VECTOROPS_VDSP && defined __SSE2__)
+#define SAMPLEINTERPOLATOR_SSE 1
+#include <emmintrin.h>
+#elif defined DUNNECORE_VECTOROPS_NEON || (defined DUNNECORE_VECTOROPS_VDSP && (defined __ARM_NEON || defined __ARM_NEON__))
+#define SAMPLEINTERPOLATOR_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace DunneCore
+{
+    int sampleInterpolationTaps(SampleInterpolation interpolation)
+    {
+        switch (interpolation)
+        {
+            case SampleInterpolationLinear: return 2;
+            case SampleInterpolationCubic: return 4;
+            case SampleInterpolationSinc4: return 4;
+            case SampleInterpolationSinc8: return 8;
+            default: return 1;
+        }
+    }
+
+    const char *sampleInterpolationName(SampleInterpolation interpolation)
+    {
+        switch (interpolation)
+        {
+            case SampleInterpolationLinear: return "linear";
+            case SampleInterpolationCubic: return "cubic";
+            case SampleInterpolationSinc4: return "sinc4";
+            case SampleInterpolationSinc8: return "sinc8";
+            default: return "none";
+        }
+    }
+
+    // modified Bessel function of the first kind, order 0, for Kaiser windows
+    static double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; k++)
+        {
+            term *= (x / (2 * k)) * (x / (2 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // Kaiser window of the given shape, for -1 <= u <= 1
+    static double kaiser(double u, double beta)
+    {
+        return besselI0(beta * sqrt(std::max(0.0, 1.0 - u * u))) / besselI0(beta);
+    }
+
+    // Kaiser-windowed sinc, one row of taps per phase; each row is followed by the difference to the
+    // next phase's row, so a kernel interpolates between phases with one multiply-add per tap
+    template <int taps>
+    struct SincTable
+    {
+        alignas(16) float rows[SAMPLEINTERPOLATION_PHASES][2 * taps];
+
+        explicit SincTable(double beta)
+        {
+            float phase[SAMPLEINTERPOLATION_PHASES + 1][taps];
+            for (int j = 0; j <= SAMPLEINTERPOLATION_PHASES; j++)
+            {
+                // tap k reads the frame k - taps/2 + 1 after the one at or before the position
+                double fraction = double(j) / SAMPLEINTERPOLATION_PHASES, sum = 0.0;
+                double coefficients[taps];
+                for (int k = 0; k < taps; k++)
+                {
+                    double x = k - taps / 2 + 1 - fraction;
+                    double u = x / (taps / 2);
+                    double window = kaiser(u, beta);
+                    // exactly 1 and 0 at whole frames, so phase 0 passes the input through unchanged
+                    double sinc = x == 0.0 ? 1.0 : x == floor(x) ? 0.0 : sin(M_PI * x) / (M_PI * x);
+                    coefficients[k] = sinc * window;
+                    sum += coefficients[k];
+                }
+                for (int k = 0; k < taps; k++) phase[j][k] = float(coefficients[k] / sum);
+            }
+            for (int j = 0; j < SAMPLEINTERPOLATION_PHASES; j++)
+                for (int k = 0; k < taps; k++)
+                {
+                    rows[j][k] = phase[j][k];
+                    rows[j][taps + k] = phase[j + 1][k] - phase[j][k];
+                }
+        }
+
+    };
+
+    // window shapes chosen for the best worst-case error over the benchmark's test tones
+    static const SincTable<4> &sinc4Table()
+    {
+        static const SincTable<4> table(2.5);
+        return table;
+    }
+
+    static const SincTable<8> &sinc8Table()
+    {
+        static const SincTable<8> table(4.8);
+        return table;
+    }
+
+    static void interpolateNearest(const float *const input[2], double position, double rate, float *const output[2], size_t count)
+    {
+        for (size_t k = 0; k < count; k++)
+        {
+            long i = (long)floor(position + k * rate);
+            output[0][k] = input[0][i];
+            output[1][k] = input[1][i];
+        }
+    }
+
+    // two taps leave nothing to vectorize but the loads, so this is left to the compiler
+    static void interpolateLinear(const float *const input[2], double position, double rate, float *const output[2], size_t count)
+    {
+        const float *left = input[0], *right = input[1];
+        for (size_t k = 0; k < count; k++)
+        {
+            double p = position + k * rate;
+            long i = (long)floor(p);
+            float f = float(p - i);
+            output[0][k] = left[i] + f * (left[i + 1] - left[i]);
+            output[1][k] = right[i] + f * (right[i + 1] - right[i]);
+        }
+    }
+
+    // Catmull-Rom Hermite cubic, four output frames at a time: the taps are gathered, then the
+    // polynomial is evaluated across the four frames in one vector, in the same order as here
+    static inline float hermite(float xm1, float x0, float x1, float x2, float f)
+    {
+        float c1 = 0.5f * (x1 - xm1);
+        float c2 = (xm1 + 2.0f * x1) - (2.5f * x0 + 0.5f * x2);
+        float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+        return ((c3 * f + c2) * f + c1) * f + x0;
+    }
+
+    static void interpolateCubic(const float *const input[2], double position, double rate, float *const output[2], size_t count)
+    {
+        size_t k = 0;
+#if defined SAMPLEINTERPOLATOR_SSE || defined SAMPLEINTERPOLATOR_NEON
+        for (; k + 4 <= count; k += 4)
+        {
+            alignas(16) float f[4], taps[2][4][4];
+            for (int n = 0; n < 4; n++)
+            {
+                double p = position + (k + n) * rate;
+                long i = (long)floor(p);
+                f[n] = float(p - i);
+                for (int c = 0; c < 2; c++)
+                    for (int t = 0; t < 4; t++) taps[c][t][n] = input[c][i - 1 + t];
+            }
+            for (int c = 0; c < 2; c++)
+            {
+#if defined SAMPLEINTERPOLATOR_SSE
+                __m128 vf = _mm_load_ps(f);
+                __m128 xm1 = _mm_load_ps(taps[c][0]), x0 = _mm_load_ps(taps[c][1]);
+                __m128 x1 = _mm_load_ps(taps[c][2]), x2 = _mm_load_ps(taps[c][3]);
+                __m128 c1 = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(x1, xm1));
+                __m128 c2 = _mm_sub_ps(_mm_add_ps(xm1, _mm_mul_ps(_mm_set1_ps(2.0f), x1)),
+                                       _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.5f), x0), _mm_mul_ps(_mm_set1_ps(0.5f), x2)));
+                __m128 c3 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(x2, xm1)),
+                                       _mm_mul_ps(_mm_set1_ps(1.5f), _mm_sub_ps(x0, x1)));
+                __m128 y = _mm_add_ps(_mm_mul_ps(c3, vf), c2);
+                y = _mm_add_ps(_mm_mul_ps(y, vf), c1);
+                y = _mm_add_ps(_mm_mul_ps(y, vf), x0);
+                _mm_storeu_ps(output[c] + k, y);
+#else
+                float32x4_t vf = vld1q_f32(f);
+                float32x4_t xm1 = vld1q_f32(taps[c][0]), x0 = vld1q_f32(taps[c][1]);
+                float32x4_t x1 = vld1q_f32(taps[c][2]), x2 = vld1q_f32(taps[c][3]);
+                float32x4_t c1 = vmulq_n_f32(vsubq_f32(x1, xm1), 0.5f);
+                float32x4_t c2 = vsubq_f32(vaddq_f32(xm1, vmulq_n_f32(x1, 2.0f)),
+                                           vaddq_f32(vmulq_n_f32(x0, 2.5f), vmulq_n_f32(x2, 0.5f)));
+                float32x4_t c3 = vaddq_f32(vmulq_n_f32(vsubq_f32(x2, xm1), 0.5f), vmulq_n_f32(vsubq_f32(x0, x1), 1.5f));
+                float32x4_t y = vaddq_f32(vmulq_f32(c3, vf), c2);
+                y = vaddq_f32(vmulq_f32(y, vf), c1);
+                y = vaddq_f32(vmulq_f32(y, vf), x0);
+                vst1q_f32(output[c] + k, y);
+#endif
+            }
+        }
+#endif
+        for (; k < count; k++)
+        {
+            double p = position + k * rate;
+            long i = (long)floor(p);
+            float f = float(p - i);
+            for (int c = 0; c < 2; c++)
+            {
+                const float *x = input[c] + i;
+                output[c][k] = hermite(x[-1], x[0], x[1], x[2], f);
+            }
+        }
+    }
+
+#if defined SAMPLEINTERPOLATOR_SSE
+    // the sums of a's lanes and of b's lanes
+    static inline void sumLanes(__m128 a, __m128 b, float *sumA, float *sumB)
+    {
+        __m128 s = _mm_add_ps(_mm_unpacklo_ps(a, b), _mm_unpackhi_ps(a, b));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        _mm_store_ss(sumA, s);
+        _mm_store_ss(sumB, _mm_shuffle_ps(s, s, 1));
+    }
+#elif defined SAMPLEINTERPOLATOR_NEON
+    static inline void sumLanes(float32x4_t a, float32x4_t b, float *sumA, float *sumB)
+    {
+        float32x2_t s = vpadd_f32(vadd_f32(vget_low_f32(a), vget_high_f32(a)), vadd_f32(vget_low_f32(b), vget_high_f32(b)));
+        *sumA = vget_lane_f32(s, 0);
+        *sumB = vget_lane_f32(s, 1);
+    }
+#endif
+
+    // windowed sinc: each output frame is a dot product of its taps with the table's coefficients for
+    // its phase, four taps to a vector
+    template <int taps>
+    static void interpolateSinc(const SincTable<taps> &table, const float *const input[2], double position,
+                                double rate, float *const output[2], size_t count)
+    {
+        for (size_t k = 0; k < count; k++)
+        {
+            double p = position + k * rate;
+            long i = (long)floor(p);
+            double phase = (p - i) * SAMPLEINTERPOLATION_PHASES;
+            int j = (int)phase;
+            float g = float(phase - j);
+            const float *row = table.rows[j];
+            const float *left = input[0] + i - taps / 2 + 1, *right = input[1] + i - taps / 2 + 1;
+#if defined SAMPLEINTERPOLATOR_SSE
+            __m128 vg = _mm_set1_ps(g), sumLeft = _mm_setzero_ps(), sumRight = _mm_setzero_ps();
+            for (int t = 0; t < taps; t += 4)
+            {
+                __m128 c = _mm_add_ps(_mm_load_ps(row + t), _mm_mul_ps(vg, _mm_load_ps(row + taps + t)));
+                sumLeft = _mm_add_ps(sumLeft, _mm_mul_ps(c, _mm_loadu_ps(left + t)));
+                sumRight = _mm_add_ps(sumRight, _mm_mul_ps(c, _mm_loadu_ps(right + t)));
+            }
+            sumLanes(sumLeft, sumRight, &output[0][k], &output[1][k]);
+#elif defined SAMPLEINTERPOLATOR_NEON
+            float32x4_t sumLeft = vdupq_n_f32(0.0f), sumRight = vdupq_n_f32(0.0f);
+            for (int t = 0; t < taps; t += 4)
+            {
+                float32x4_t c = vmlaq_n_f32(vld1q_f32(row + t), vld1q_f32(row + taps + t), g);
+                sumLeft = vmlaq_f32(sumLeft, c, vld1q_f32(left + t));
+                sumRight = vmlaq_f32(sumRight, c, vld1q_f32(right + t));
+            }
+            sumLanes(sumLeft, sumRight, &output[0][k], &output[1][k]);
+#else
+            float sumLeft = 0.0f, sumRight = 0.0f;
+            for (int t = 0; t < taps; t++)
+            {
+                float c = row[t] + g * row[taps + t];
+                sumLeft += c * left[t];
+                sumRight += c * right[t];
+            }
+            output[0][k] = sumLeft;
+            output[1][k] = sumRight;
+#endif
+        }
+    }
+
+    void interpolateSamples(SampleInterpolation interpolation, const float *const input[2], double position,
+                            double rate, float *const output[2], size_t count)
+    {
+        switch (interpolation)
+        {
+            case SampleInterpolationLinear: interpolateLinear(input, position, rate, output, count); break;
+            case SampleInterpolationCubic: interpolateCubic(input, position, rate, output, count); break;
+            case SampleInterpolationSinc4: interpolateSinc(sinc4Table(), input, position, rate, output, count); break;
+            case SampleInterpolationSinc8: interpolateSinc(sinc8Table(), input, position, rate, output, count); break;
+            default: interpolateNearest(input, position, rate, output, count); break;
+        }
+    }
+
+    // Kaiser-windowed half-band lowpass: every other tap but the middle one is zero, so only those
+    // around it are kept, as pairs either side, from the middle outwards
+    struct HalfBandFilter
+    {
+        float middle;
+        float pairs[SAMPLEINTERPOLATION_HALFBAND_TAPS / 4 + 1];
+
+        HalfBandFilter()
+        {
+            const int half = SAMPLEINTERPOLATION_HALFBAND_TAPS / 2;
+            double sum = 0.5;
+            for (int k = 0; k <= half / 2; k++)
+            {
+                double x = 2 * k + 1;
+                pairs[k] = float(sin(M_PI * x / 2) / (M_PI * x) * kaiser(x / (half + 1), 8.0));
+                sum += 2.0 * pairs[k];
+            }
+            for (float &pair : pairs) pair = float(pair / sum);
+            middle = float(0.5 / sum);
+        }
+    };
+
+    size_t decimateByTwo(const float *input, size_t count, float *output)
+    {
+        static const HalfBandFilter filter;
+        size_t outputCount = (count + 1) / 2;
+        for (size_t n = 0; n < outputCount; n++)
+        {
+            const float *x = input + 2 * n;
+            float sum = filter.middle * x[0];
+            for (int k = 0; k <= SAMPLEINTERPOLATION_HALFBAND_TAPS / 4; k++)
+                sum += filter.pairs[k] * (x[-2 * k - 1] + x[2 * k + 1]);
+            output[n] = sum;
+        }
+        return outputCount;
+    }
+}
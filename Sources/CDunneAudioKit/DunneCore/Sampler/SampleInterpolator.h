@@ -0,0 +1,39 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#pragma once
+#include "Sampler_Typedefs.h"
+#include <stddef.h>
+
+// the most taps any kernel reads (8-point sinc), and so the number of guard frames kept before a
+// block of input for interpolation to read, in place of wrapping indices around
+#define SAMPLEINTERPOLATION_MAX_TAPS 8
+
+// sinc kernels keep this many fractional positions (phases) per tap, and interpolate between them
+#define SAMPLEINTERPOLATION_PHASES 256
+
+// taps of the half-band filter which decimateByTwo() applies (4n + 3, so both end taps are nonzero)
+#define SAMPLEINTERPOLATION_HALFBAND_TAPS 47
+
+namespace DunneCore
+{
+    /// taps each output frame reads: 1 for SampleInterpolationNone, 2 for linear, and so on
+    int sampleInterpolationTaps(SampleInterpolation interpolation);
+
+    /// the kernel's name, for benchmarks and diagnostics
+    const char *sampleInterpolationName(SampleInterpolation interpolation);
+
+    // interpolateSamples() resamples a block of stereo input: output frame k is the input read at
+    // position + k * rate, by the chosen kernel. Every frame any output frame reads must be readable,
+    // i.e. input[c][i] for floor(position) - taps/2 + 1 <= i <= floor(position + (count - 1) * rate) + taps/2,
+    // so callers keep guard frames either side of a block rather than the kernels checking bounds.
+    // Both channels share input positions, and kernels vectorize with the VectorOps backend: across
+    // taps for sinc, across output frames for cubic. SampleInterpolationNone reads the nearest frame
+    // at or before each position.
+    void interpolateSamples(SampleInterpolation interpolation, const float *const input[2], double position,
+                            double rate, float *const output[2], size_t count);
+
+    /// lowpass filter count frames of input at half its Nyquist frequency and keep every other
+    /// frame, from the first, into output; returns the number kept, (count + 1) / 2. Like the
+    /// kernels, reads SAMPLEINTERPOLATION_HALFBAND_TAPS / 2 frames either side of the input.
+    size_t decimateByTwo(const float *input, size_t count, float *output);
+}
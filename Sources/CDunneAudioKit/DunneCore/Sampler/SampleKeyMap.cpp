@@ -0,0 +1,64 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#include "SampleKeyMap.h"
+#include "SampleBuffer.h"
+#include <string.h>
+#include <algorithm>
+
+namespace DunneCore
+{
+    static bool playsAtVelocity(const KeyMappedSampleBuffer *buffer, int velocity)
+    {
+        if (buffer->minimumVelocity < 0 || buffer->maximumVelocity < 0) return true;
+        return velocity >= buffer->minimumVelocity && velocity <= buffer->maximumVelocity;
+    }
+
+    SampleKeyMap::SampleKeyMap()
+    {
+        clear();
+    }
+
+    void SampleKeyMap::clear()
+    {
+        for (std::vector<Entry> &entries : pending) entries.clear();
+        velocityEntries.clear();
+        maxBufferCount = 0;
+        memset(velocityStart, 0, sizeof(velocityStart));
+        memset(velocityCount, 0, sizeof(velocityCount));
+    }
+
+    void SampleKeyMap::add(unsigned noteNumber, KeyMappedSampleBuffer *buffer)
+    {
+        if (noteNumber >= SAMPLEKEYMAP_NOTES) return;
+        pending[noteNumber].push_back(Entry { buffer, (unsigned)pending[noteNumber].size() });
+    }
+
+    void SampleKeyMap::build()
+    {
+        velocityEntries.clear();
+        maxBufferCount = 0;
+        for (int nn = 0; nn < SAMPLEKEYMAP_NOTES; nn++)
+        {
+            const std::vector<Entry> &entries = pending[nn];
+            maxBufferCount = std::max(maxBufferCount, entries.size());
+            uint32_t runStart = 0, runCount = 0;
+            for (int v = 0; v < SAMPLEKEYMAP_VELOCITIES; v++)
+            {
+                // the set of buffers only changes where some buffer's range starts or has just ended
+                bool changed = v == 0;
+                for (size_t i = 0; i < entries.size() && !changed; i++)
+                    changed = entries[i].buffer->minimumVelocity == v || entries[i].buffer->maximumVelocity == v - 1;
+                if (changed)
+                {
+                    runStart = (uint32_t)velocityEntries.size();
+                    for (const Entry &entry : entries)
+                        if (entries.size() == 1 || playsAtVelocity(entry.buffer, v)) velocityEntries.push_back(entry);
+                    runCount = (uint32_t)velocityEntries.size() - runStart;
+                }
+                velocityStart[nn][v] = runStart;
+                velocityCount[nn][v] = runCount;
+            }
+        }
+        for (std::vector<Entry> &entries : pending) entries.clear();
+    }
+}
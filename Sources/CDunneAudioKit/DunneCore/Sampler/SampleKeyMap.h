@@ -0,0 +1,68 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#pragma once
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// MIDI note numbers and velocities both run 0-127
+#define SAMPLEKEYMAP_NOTES 128
+#define SAMPLEKEYMAP_VELOCITIES 128
+
+namespace DunneCore
+{
+    struct KeyMappedSampleBuffer;
+
+    // SampleKeyMap maps each MIDI note number and velocity to the sample buffers which play them,
+    // out of those mapped to the note (its tracks). It keeps them in one flat array, built once
+    // along with the key map, so a note-on looks up a contiguous span of entries in constant time,
+    // with no list walking and nothing allocated.
+    class SampleKeyMap
+    {
+    public:
+        struct Entry
+        {
+            KeyMappedSampleBuffer *buffer;
+            unsigned track;         // its index among the note's buffers, as LoopDescriptor counts tracks
+        };
+
+        struct Span
+        {
+            const Entry *first, *last;
+
+            const Entry *begin() const { return first; }
+            const Entry *end() const { return last; }
+            size_t size() const { return last - first; }
+        };
+
+        SampleKeyMap();
+
+        /// forget every mapping; then add() each note's buffers, in track order, and build()
+        void clear();
+        void add(unsigned noteNumber, KeyMappedSampleBuffer *buffer);
+        void build();
+
+        /// the most buffers mapped to any one note
+        size_t getMaxBufferCount() const { return maxBufferCount; }
+
+        /// the buffers which play the note at velocity: those whose velocity range holds it, or which
+        /// have none (a negative bound), or the note's only buffer whatever its range. Velocities
+        /// over 127 look up 127.
+        Span lookup(unsigned noteNumber, unsigned velocity) const
+        {
+            if (noteNumber >= SAMPLEKEYMAP_NOTES) return Span { 0, 0 };
+            if (velocity >= SAMPLEKEYMAP_VELOCITIES) velocity = SAMPLEKEYMAP_VELOCITIES - 1;
+            const Entry *first = velocityEntries.data() + velocityStart[noteNumber][velocity];
+            return Span { first, first + velocityCount[noteNumber][velocity] };
+        }
+
+    private:
+        std::vector<Entry> pending[SAMPLEKEYMAP_NOTES];     // add()ed since clear()
+        size_t maxBufferCount;
+
+        // for each note, velocities with the same buffers share one run of entries
+        std::vector<Entry> velocityEntries;
+        uint32_t velocityStart[SAMPLEKEYMAP_NOTES][SAMPLEKEYMAP_VELOCITIES];
+        uint32_t velocityCount[SAMPLEKEYMAP_NOTES][SAMPLEKEYMAP_VELOCITIES];
+    };
+}
@@ -0,0 +1,264 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SampleBuffer.h"
+
+// most tracks a cached loop can be made of; groups with more are never cached
+#define SAMPLELOOPCACHE_MAX_TRACKS 16
+
+namespace DunneCore
+{
+    // what a SampleLoopCache keeps for one loop: the tracks, range and direction it was made from,
+    // and the stereo samples the cache made of them
+    struct SampleLoopEntry
+    {
+        enum State { kFree, kClaimed, kEvicting, kRequested, kMaking, kReady, kFailed };
+
+        // the loop; written only while kClaimed
+        SampleBuffer *sampleBuffers[SAMPLELOOPCACHE_MAX_TRACKS];
+        size_t bufferCount, startPoint, sampleCount;
+        bool reversed;
+
+        // once kReady: what was made of the loop, and the memory it takes
+        float *samples[2] = { 0, 0 };
+        size_t byteCount = 0;
+
+        std::atomic<int> state { kFree };
+        std::atomic<int> useCount { 0 };
+        std::atomic<uint64_t> lastUsed { 0 };
+
+        bool isReady() const { return state.load(std::memory_order_acquire) == kReady; }
+
+        bool isLoop(const std::vector<SampleBuffer*> &buffers, size_t startPoint, size_t sampleCount, bool reversed) const
+        {
+            return this->startPoint == startPoint && this->sampleCount == sampleCount && this->reversed == reversed &&
+                bufferCount == buffers.size() && std::equal(buffers.begin(), buffers.end(), sampleBuffers);
+        }
+
+        // the cache's thread only, as this allocates
+        std::vector<SampleBuffer*> getBuffers() const
+        {
+            return std::vector<SampleBuffer*>(sampleBuffers, sampleBuffers + bufferCount);
+        }
+    };
+
+    // SampleLoopCache holds what its own thread makes of loops, in a fixed table of Entry (a
+    // SampleLoopEntry) shared by all voices. Entries are evicted least-recently-used first to keep
+    // the total within the memory budget; entries a voice holds are never evicted.
+    //
+    // find(), request() and release() are lock-free and never allocate, so any render thread may
+    // call them: a request only claims an entry, which the thread then makes, through the
+    // subclass's make(). The thread does all allocation; a use count taken before looking at an
+    // entry's state keeps it from evicting the entry in the meantime. The budget and statistics
+    // may be set and read from any thread. Subclasses must stop() before they are destroyed.
+    template <class Entry, unsigned entryCount>
+    class SampleLoopCache
+    {
+    public:
+        SampleLoopCache() {}
+        virtual ~SampleLoopCache() {}
+        SampleLoopCache(const SampleLoopCache&) = delete;
+        SampleLoopCache& operator=(const SampleLoopCache&) = delete;
+
+        void release(const Entry *entry)
+        {
+            if (entry) const_cast<Entry*>(entry)->useCount.fetch_sub(1);
+        }
+
+        /// free every entry; call only when no voice holds any, e.g. when samples are unloaded
+        void clear()
+        {
+            bool running = thread.joinable();
+            stop();
+            for (Entry &entry : entries)
+            {
+                freeSamples(entry);
+                entry.useCount.store(0);
+                entry.state.store(Entry::kFree);
+            }
+            bytesUsed.store(0);
+            if (running) start();
+        }
+
+        /// 0 turns caching off. Not realtime-safe: starts or stops the thread.
+        void setBudget(size_t bytes)
+        {
+            budget.store(bytes);
+            if (bytes > 0) start();
+            else stop();
+        }
+
+        size_t getBudget() { return budget.load(std::memory_order_relaxed); }
+        size_t getBytesUsed() { return bytesUsed.load(std::memory_order_relaxed); }
+
+        unsigned getEntryCount()
+        {
+            unsigned count = 0;
+            for (Entry &entry : entries) count += entry.state.load(std::memory_order_relaxed) == Entry::kReady;
+            return count;
+        }
+
+        uint64_t getEvictions() { return evictions.load(std::memory_order_relaxed); }
+
+    protected:
+        Entry entries[entryCount];
+        std::atomic<size_t> budget { 0 }, bytesUsed { 0 };
+        std::atomic<uint64_t> useClock { 0 }, evictions { 0 };
+        std::thread thread;
+        std::atomic<bool> quit { false };
+
+        // the entry, being made or ready, which matches(entry) accepts, held until released; else 0
+        template <class Matches>
+        Entry *find(Matches matches)
+        {
+            uint64_t now = ++useClock;
+            for (Entry &entry : entries)
+            {
+                // hold it first: then if it isn't being evicted now, it won't be while we look at it
+                entry.useCount.fetch_add(1);
+                if (entry.state.load() >= Entry::kRequested && matches(entry))
+                {
+                    entry.lastUsed.store(now, std::memory_order_relaxed);
+                    return &entry;
+                }
+                entry.useCount.fetch_sub(1);
+            }
+            return 0;
+        }
+
+        // a free entry claimed for the loop, which setKey(entry) may add to, held and handed to the
+        // thread to make; 0 if caching is off, the loop has too many tracks, or no entry is free
+        template <class SetKey>
+        Entry *request(const std::vector<SampleBuffer*> &buffers, size_t startPoint, size_t sampleCount, bool reversed,
+                       SetKey setKey)
+        {
+            if (getBudget() == 0 || buffers.size() > SAMPLELOOPCACHE_MAX_TRACKS) return 0;
+            for (Entry &entry : entries)
+            {
+                int expected = Entry::kFree;
+                if (!entry.state.compare_exchange_strong(expected, Entry::kClaimed)) continue;
+
+                std::copy(buffers.begin(), buffers.end(), entry.sampleBuffers);
+                entry.bufferCount = buffers.size();
+                entry.startPoint = startPoint;
+                entry.sampleCount = sampleCount;
+                entry.reversed = reversed;
+                setKey(entry);
+                entry.useCount.fetch_add(1);
+                entry.lastUsed.store(++useClock, std::memory_order_relaxed);
+                entry.state.store(Entry::kRequested);
+                return &entry;
+            }
+            return 0;
+        }
+
+        // cache thread: make the entry's samples and set its byteCount, having taken that much room
+        // with makeRoom(); false if they can't be made, e.g. for want of room
+        virtual bool make(Entry &entry) = 0;
+
+        void start()
+        {
+            if (thread.joinable()) return;
+            quit.store(false);
+            thread = std::thread(&SampleLoopCache::run, this);
+        }
+
+        void stop()
+        {
+            if (!thread.joinable()) return;
+            quit.store(true);
+            thread.join();
+        }
+
+        // make whatever has been asked for, and let go of what no longer fits or failed unwanted;
+        // nap when there was nothing to do
+        void run()
+        {
+            while (!quit.load(std::memory_order_relaxed))
+            {
+                bool busy = false, anyFree = false;
+                for (Entry &entry : entries)
+                {
+                    int expected = Entry::kRequested;
+                    if (entry.state.compare_exchange_strong(expected, Entry::kMaking))
+                    {
+                        entry.state.store(make(entry) ? Entry::kReady : Entry::kFailed, std::memory_order_release);
+                        busy = true;
+                    }
+                    erase(entry, Entry::kFailed);
+                    anyFree = anyFree || entry.state.load(std::memory_order_relaxed) == Entry::kFree;
+                }
+
+                // keep an entry free for the next request, and keep within a budget which may have shrunk
+                if (!anyFree) evictOldest();
+                makeRoom(0);
+                if (!busy) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+
+        // cache thread: evict unused ready entries, oldest first, until bytes more will fit
+        bool makeRoom(size_t bytes)
+        {
+            if (bytes > getBudget()) return false;
+            while (getBytesUsed() + bytes > getBudget())
+                if (!evictOldest()) return false;
+            bytesUsed.fetch_add(bytes);
+            return true;
+        }
+
+        bool evictOldest()
+        {
+            for (;;)
+            {
+                Entry *oldest = 0;
+                for (Entry &entry : entries)
+                {
+                    if (entry.state.load() != Entry::kReady || entry.useCount.load() > 0) continue;
+                    if (oldest == 0 || entry.lastUsed.load() < oldest->lastUsed.load()) oldest = &entry;
+                }
+                if (oldest == 0) return false;
+                if (erase(*oldest, Entry::kReady))
+                {
+                    evictions.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+
+        // free the entry if it is still in the given state and nobody holds it
+        bool erase(Entry &entry, int state)
+        {
+            int expected = state;
+            if (!entry.state.compare_exchange_strong(expected, Entry::kEvicting)) return false;
+            if (entry.useCount.load() > 0)
+            {
+                entry.state.store(state);
+                return false;
+            }
+
+            bytesUsed.fetch_sub(entry.byteCount);
+            freeSamples(entry);
+            entry.state.store(Entry::kFree);
+            return true;
+        }
+
+        static void freeSamples(Entry &entry)
+        {
+            for (int c = 0; c < 2; c++)
+            {
+                delete[] entry.samples[c];
+                entry.samples[c] = 0;
+            }
+            entry.byteCount = 0;
+        }
+    };
+
+}
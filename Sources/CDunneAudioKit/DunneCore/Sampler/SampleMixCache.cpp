@@ -0,0 +1,36 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#include "SampleMixCache.h"
+
+namespace DunneCore
+{
+    const SampleMix *SampleMixCache::acquire(const std::vector<SampleBuffer*> &buffers,
+                                             size_t startPoint, size_t sampleCount, bool reversed)
+    {
+        const SampleMix *entry = find([&](const SampleMix &mix) {
+            return mix.isLoop(buffers, startPoint, sampleCount, reversed);
+        });
+        if (entry)
+        {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return entry;
+        }
+
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return request(buffers, startPoint, sampleCount, reversed, [](SampleMix &) {});
+    }
+
+    bool SampleMixCache::make(SampleMix &entry)
+    {
+        size_t byteCount = 2 * entry.sampleCount * sizeof(float);
+        if (!makeRoom(byteCount)) return false;
+
+        float *samples[2] = { new float[entry.sampleCount], new float[entry.sampleCount] };
+        mixSampleBuffers(entry.getBuffers(), entry.startPoint, entry.sampleCount, entry.reversed, 0, entry.sampleCount, samples);
+        entry.samples[0] = samples[0];
+        entry.samples[1] = samples[1];
+        entry.byteCount = byteCount;
+        return true;
+    }
+
+}
@@ -0,0 +1,45 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#pragma once
+#include "SampleLoopCache.h"
+
+// default memory budget for mixed-down groups, in bytes
+#define SAMPLEMIXCACHE_DEFAULT_BUDGET (64 * 1024 * 1024)
+
+// loops (each a set of tracks, range and direction) the cache can hold or be mixing at once
+#define SAMPLEMIXCACHE_ENTRIES 64
+
+namespace DunneCore
+{
+    // one prepared mix: the loop's tracks summed, in playing order
+    struct SampleMix : SampleLoopEntry
+    {
+    };
+
+    // SampleMixCache holds prepared stereo mixes of multi-track and/or reversed sample groups,
+    // so repeated triggers of the same loop feed the stretcher from one contiguous buffer instead
+    // of re-summing every track. Entries are keyed by the exact tracks, start point, frame count and
+    // reverse flag. A miss only claims an entry for the cache's thread to mix; meanwhile the group
+    // mixes as it feeds. See SampleLoopCache for the rest.
+    class SampleMixCache : public SampleLoopCache<SampleMix, SAMPLEMIXCACHE_ENTRIES>
+    {
+    public:
+        SampleMixCache() { setBudget(SAMPLEMIXCACHE_DEFAULT_BUDGET); }
+        ~SampleMixCache() { stop(); clear(); }
+
+        /// the entry for this group, being mixed or ready, held until released; one is requested
+        /// if there is none and the budget allows, else returns 0
+        const SampleMix *acquire(const std::vector<SampleBuffer*> &buffers, size_t startPoint, size_t sampleCount, bool reversed);
+
+        // statistics
+        uint64_t getHits() { return hits.load(std::memory_order_relaxed); }
+        uint64_t getMisses() { return misses.load(std::memory_order_relaxed); }
+        void resetStatistics() { hits.store(0); misses.store(0); evictions.store(0); }
+
+    protected:
+        std::atomic<uint64_t> hits { 0 }, misses { 0 };
+
+        bool make(SampleMix &entry) override;
+    };
+
+}
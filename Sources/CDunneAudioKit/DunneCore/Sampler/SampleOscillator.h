@@ -2,7 +2,6 @@
 
 #pragma once
 #include <math.h>
-#include <list>
 
 #include "Sampler_Typedefs.h"
 #include "SampleBuffer.h"
@@ -22,15 +21,14 @@ namespace DunneCore
         void setPitchOffsetSemitones(double semitones) { multiplier = pow(2.0, semitones/12.0); }
         
         // return true if we run out of samples
-        inline bool getSamplePair(SampleBufferGroup sampleBuffers, LoopDescriptor loop, int sampleCount, float *leftOutput, float *rightOutput, float gain)
+        inline bool getSamplePair(SampleBufferView &view, const LoopDescriptor &loop, int sampleCount, float *leftOutput, float *rightOutput, float gain)
         {
-            auto sampleBuffer = sampleBuffers.sampleBuffers.front();
-            if (sampleBuffer == NULL || indexPoint > (sampleBuffer->endPoint - sampleBuffer->startPoint)) {
+            if (view.group == 0 || indexPoint > view.length) {
                 muteIndex = 0;
                 return true;
             }
 
-            auto fadeSize = (int)sampleBuffer->sampleRate / 100;
+            auto fadeSize = view.fadeSize;
             if (muteIndex < loop.mutedCount) {
                 auto start = loop.mutedStartPoints[muteIndex];
                 auto end = loop.mutedEndPoints[muteIndex];
@@ -51,7 +49,7 @@ namespace DunneCore
             auto finalGain = gain * (loop.phaseInvert ? -1 : 1) * muteVolume;
             
             float left = 0, right = 0;
-            sampleBuffers.interp(&left, &right, &indexPoint, increment, multiplier, loop);
+            view.interp(&left, &right, &indexPoint, increment, multiplier, loop);
 
             *leftOutput = left * finalGain;
             *rightOutput = right * finalGain;
@@ -0,0 +1,193 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#include "SampleStore.h"
+#include "WavPackDecoder.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+// decoded channels start on multiples of this many bytes, and so of 8 frames, whatever the format
+#define SAMPLESTORE_ALIGNMENT 32
+
+// long files are decoded in parallel, a range of blocks per thread, on at most this many threads
+#define SAMPLESTORE_MAX_DECODE_THREADS 8
+
+namespace DunneCore
+{
+    SampleStore &SampleStore::shared()
+    {
+        // never destroyed, so samplers which outlive static destruction can still release into it
+        static SampleStore *store = new SampleStore();
+        return *store;
+    }
+
+    bool SampleStore::serves(const SampleStoreEntry *entry, const std::string &name, size_t headFrames, SampleStorageFormat format)
+    {
+        if (entry->name != name || entry->requestedFormat != format) return false;
+        if (entry->headFrames == 0 || (entry->ready && entry->residentCount == entry->sampleCount)) return true;
+        return headFrames != 0 && entry->headFrames >= headFrames;
+    }
+
+    const SampleStoreEntry *SampleStore::acquire(const WavPackSource &source, size_t headFrames, SampleStorageFormat format, char *errorMessage)
+    {
+        std::string name = source.getName();
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            SampleStoreEntry *found = 0;
+            for (SampleStoreEntry *entry : entries)
+                if (serves(entry, name, headFrames, format)) found = entry;
+            if (found == 0) break;
+            if (found->ready)
+            {
+                found->useCount++;
+                return found;
+            }
+            // someone else is decoding it; look again once they are done (it may have failed)
+            loaded.wait(lock);
+        }
+
+        SampleStoreEntry *entry = new SampleStoreEntry();
+        entry->source = source;
+        entry->name = name;
+        entry->headFrames = headFrames;
+        entry->requestedFormat = format;
+        entry->samples = 0;
+        entry->packedSamples = 0;
+        entry->allocation = 0;
+        entry->useCount = 1;
+        entry->ready = false;
+        entries.push_back(entry);
+
+        lock.unlock();
+        bool ok = decode(entry, errorMessage);
+        lock.lock();
+
+        if (ok)
+        {
+            entry->ready = true;
+            bytesUsed += entry->byteCount;
+        }
+        else
+        {
+            entries.erase(std::find(entries.begin(), entries.end(), entry));
+            delete entry;
+            entry = 0;
+        }
+        loaded.notify_all();
+        return entry;
+    }
+
+    void SampleStore::release(const SampleStoreEntry *entry)
+    {
+        if (entry == 0) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find(entries.begin(), entries.end(), entry);
+        if (it == entries.end() || --(*it)->useCount > 0) return;
+
+        bytesUsed -= entry->byteCount;
+        delete[] entry->allocation;
+        delete entry;
+        entries.erase(it);
+    }
+
+    int SampleStore::getUseCount(const SampleStoreEntry *entry)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entry->useCount;
+    }
+
+    size_t SampleStore::getBytesUsed()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return bytesUsed;
+    }
+
+    size_t SampleStore::getEntryCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    // runs without the lock: nobody else touches an entry until it is ready
+    bool SampleStore::decode(SampleStoreEntry *entry, char *errorMessage)
+    {
+        WavPackDecoder decoder;
+        if (!decoder.open(entry->source, errorMessage)) return false;
+
+        entry->sampleRate = decoder.getSampleRate();
+        entry->channelCount = decoder.getChannelCount();
+        entry->sampleCount = (int)decoder.getFrameCount();
+        entry->residentCount = entry->sampleCount;
+        if (entry->headFrames > 0) entry->residentCount = (int)std::min<size_t>(entry->sampleCount, entry->headFrames);
+
+        entry->format = entry->requestedFormat;
+        if (entry->format == SampleStorageInt24 && !decoder.isFloat() && decoder.getBitsPerSample() <= 16)
+            entry->format = SampleStorageInt16;
+
+        // pad the left channel out to a whole number of 8-frame blocks, so the right one is aligned too
+        size_t frames = entry->residentCount;
+        size_t stride = entry->channelCount == 1 ? frames : (frames + 7) & ~size_t(7);
+        entry->channelStride = (int)stride;
+        entry->byteCount = entry->channelCount * stride * sampleStorageBytes(entry->format);
+        entry->allocation = new uint8_t[entry->byteCount + SAMPLESTORE_ALIGNMENT - 1];
+        uint8_t *aligned = entry->allocation + (-(uintptr_t)entry->allocation & (SAMPLESTORE_ALIGNMENT - 1));
+        int threadCount = std::min((int)std::max(1u, std::thread::hardware_concurrency()), SAMPLESTORE_MAX_DECODE_THREADS);
+        if (entry->format == SampleStorageFloat32)
+        {
+            entry->samples = (float *)aligned;
+            float *right = entry->samples + (entry->channelCount - 1) * stride;
+            if (decoder.decodeParallel(0, frames, entry->samples, right, threadCount)) return true;
+        }
+        else
+        {
+            // decode to float a block at a time, and pack each block; exact for integer files of up
+            // to the format's width, whose floats are integers times a power of two
+            int bits = entry->format == SampleStorageInt16 ? 16 : 24;
+            float range = float(1 << (bits - 1));
+            entry->packedScale = 1.0f / range;
+            entry->packedSamples = aligned;
+
+            // each thread decodes its range of blocks sequentially, a float block at a time
+            bool ok = decoder.forEachRange(0, frames, threadCount, WAVPACK_MIN_PARALLEL_FRAMES, [&](size_t start, size_t count) {
+                const size_t blockFrames = 16384;
+                std::vector<float> block(2 * blockFrames);
+                WavPackBlockReader reader;
+                if (!reader.seek(decoder, start)) return false;
+                for (size_t done = start; done < start + count; done += blockFrames)
+                {
+                    size_t n = std::min(blockFrames, start + count - done);
+                    if (!reader.read(n, block.data(), block.data() + blockFrames)) return false;
+                    for (int c = 0; c < entry->channelCount; c++)
+                    {
+                        size_t first = c * stride + done;
+                        const float *in = block.data() + c * blockFrames;
+                        for (size_t i = 0; i < n; i++)
+                        {
+                            int32_t value = (int32_t)lrintf(std::max(-range, std::min(in[i] * range, range - 1.0f)));
+                            if (bits == 16)
+                                ((int16_t *)entry->packedSamples)[first + i] = (int16_t)value;
+                            else
+                            {
+                                uint8_t *p = entry->packedSamples + 3 * (first + i);
+                                p[0] = uint8_t(value);
+                                p[1] = uint8_t(value >> 8);
+                                p[2] = uint8_t(value >> 16);
+                            }
+                        }
+                    }
+                }
+                return true;
+            });
+            if (ok) return true;
+        }
+
+        strcpy(errorMessage, "can't decode file");
+        delete[] entry->allocation;
+        entry->allocation = 0;
+        entry->samples = 0;
+        entry->packedSamples = 0;
+        return false;
+    }
+}
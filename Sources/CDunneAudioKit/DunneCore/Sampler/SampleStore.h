@@ -0,0 +1,71 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Sampler_Typedefs.h"
+#include "WavPackDecoder.h"
+
+namespace DunneCore
+{
+    // one decoded sample file, shared by every sampler which loads it
+    struct SampleStoreEntry
+    {
+        WavPackSource source;
+        std::string name;           // the source's name, which identifies it
+        size_t headFrames;          // what was asked for: frames to decode, or 0 for all of them
+        SampleStorageFormat requestedFormat;
+
+        // planar, each channel starting 32-byte aligned, channelStride samples after the last. Float
+        // samples are in samples, compact ones (see SampleBuffer) in packedSamples; either way
+        // they point into allocation.
+        SampleStorageFormat format;
+        float *samples;
+        uint8_t *packedSamples;
+        float packedScale;
+        uint8_t *allocation;
+        float sampleRate;
+        int channelCount, sampleCount, residentCount, channelStride;
+        size_t byteCount;
+        int useCount;
+        bool ready;                 // false while it is being decoded
+    };
+
+    // SampleStore is the process-wide set of decoded sample files. Samplers which load the same file
+    // share one immutable copy, which is freed when the last of them releases it. acquire() decodes
+    // outside the store's lock, so different files can load in parallel, while a second request for
+    // a file which is still loading waits for it rather than decoding it again.
+    //
+    // Thread-safe, but not realtime-safe.
+    class SampleStore
+    {
+    public:
+        static SampleStore &shared();
+
+        /// find or decode a WavPack file, either all of it or just its first headFrames frames (a fully
+        /// decoded entry serves both), stored as format asks; returns 0 and fills errorMessage
+        /// (100 chars) on failure. Int24 stores 16-bit files as Int16, which is smaller and as exact.
+        /// Files in memory are known by their address and size, so whatever is there must not change
+        /// while it is loaded.
+        const SampleStoreEntry *acquire(const WavPackSource &source, size_t headFrames, SampleStorageFormat format, char *errorMessage);
+        void release(const SampleStoreEntry *entry);
+
+        int getUseCount(const SampleStoreEntry *entry);
+        size_t getBytesUsed();
+        size_t getEntryCount();
+
+    protected:
+        std::mutex mutex;
+        std::condition_variable loaded;
+        std::vector<SampleStoreEntry*> entries;
+        size_t bytesUsed = 0;
+
+        bool decode(SampleStoreEntry *entry, char *errorMessage);
+        bool serves(const SampleStoreEntry *entry, const std::string &name, size_t headFrames, SampleStorageFormat format);
+    };
+}
@@ -0,0 +1,237 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#include "SampleStream.h"
+#include "SampleBuffer.h"
+#include "VectorOps.h"
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+namespace DunneCore
+{
+    bool WavPackSampleStream::open(const WavPackSource &source, char *errorMessage)
+    {
+        close();
+        return decoder.open(source, errorMessage);
+    }
+
+    void WavPackSampleStream::close()
+    {
+        reader.close();
+    }
+
+    bool WavPackSampleStream::read(size_t startFrame, size_t count, float *left, float *right)
+    {
+        if (startFrame != reader.getPosition() && !reader.seek(decoder, startFrame)) return false;
+        return reader.read(count, left, right);
+    }
+
+    void SampleStreamRing::allocate(size_t frameCount)
+    {
+        deallocate();
+        frames[0] = new float[frameCount];
+        frames[1] = new float[frameCount];
+        capacity = frameCount;
+    }
+
+    void SampleStreamRing::deallocate()
+    {
+        delete[] frames[0];
+        delete[] frames[1];
+        frames[0] = frames[1] = 0;
+        capacity = 0;
+    }
+
+    void SampleStreamRing::begin(SampleBuffer *newBuffer, size_t newStartPoint, size_t newSampleCount,
+                                 bool newReversed, uint64_t newFirstPosition)
+    {
+        // go idle under a new generation first, so nothing the streaming thread is reading now gets published
+        uint64_t generation = ((state.load(std::memory_order_relaxed) & ~kIdle) >> 40) + 1;
+        state.store(kIdle | (generation << 40), std::memory_order_seq_cst);
+
+        // released, so a fill() which sees any of these also sees the idle state above
+        buffer.store(newBuffer, std::memory_order_release);
+        startPoint.store(newStartPoint, std::memory_order_release);
+        sampleCount.store(newSampleCount, std::memory_order_release);
+        reversed.store(newReversed, std::memory_order_release);
+        firstPosition = newFirstPosition;
+        readPosition.store(newFirstPosition, std::memory_order_relaxed);
+
+        state.store(((generation << 40) & ~kIdle) | newFirstPosition, std::memory_order_release);
+    }
+
+    void SampleStreamRing::end()
+    {
+        uint64_t generation = ((state.load(std::memory_order_relaxed) & ~kIdle) >> 40) + 1;
+        state.store(kIdle | (generation << 40), std::memory_order_release);
+    }
+
+    size_t SampleStreamRing::addTo(uint64_t position, size_t count, float *left, float *right)
+    {
+        uint64_t s = state.load(std::memory_order_acquire);
+        uint64_t written = (s & kIdle) ? 0 : s & kPositionMask;
+        size_t available = written > position ? (size_t)std::min<uint64_t>(count, written - position) : 0;
+
+        // at most two runs, if the frames wrap around the end of the ring
+        size_t done = 0;
+        while (done < available)
+        {
+            size_t slot = (position + done) % capacity;
+            size_t n = std::min(available - done, capacity - slot);
+            vectorAdd(left + done, frames[0] + slot, n);
+            vectorAdd(right + done, frames[1] + slot, n);
+            done += n;
+        }
+
+        readPosition.store(position + count, std::memory_order_release);
+
+        size_t missed = count - available;
+        if (missed > 0)
+        {
+            underruns.fetch_add(1, std::memory_order_relaxed);
+            underrunFrames.fetch_add(missed, std::memory_order_relaxed);
+        }
+        return missed;
+    }
+
+    bool SampleStreamRing::fill(size_t maxFrames)
+    {
+        uint64_t s = state.load(std::memory_order_acquire);
+        if (s & kIdle) return false;
+
+        SampleBuffer *source = buffer.load(std::memory_order_acquire);
+        size_t start = startPoint.load(std::memory_order_acquire);
+        size_t count = sampleCount.load(std::memory_order_acquire);
+        bool backwards = reversed.load(std::memory_order_acquire);
+        uint64_t r = readPosition.load(std::memory_order_acquire);
+        if (state.load(std::memory_order_acquire) != s) return false;   // begin() got in first
+
+        // if the render thread has overtaken us, skip ahead to where it is reading now
+        uint64_t w = std::max(s & kPositionMask, r);
+        size_t space = capacity - (size_t)(w - r);
+        if (space == 0 || count == 0) return false;
+
+        // one contiguous run: within the ring, and within one pass of the loop
+        size_t loopPosition = (size_t)(w % count);
+        size_t slot = (size_t)(w % capacity);
+        size_t n = std::min(std::min(space, maxFrames), std::min(capacity - slot, count - loopPosition));
+
+        size_t sourceFrame = start + (backwards ? count - loopPosition - n : loopPosition);
+        read(source, sourceFrame, n, frames[0] + slot, frames[1] + slot);
+        if (backwards)
+        {
+            vectorReverse(frames[0] + slot, n);
+            vectorReverse(frames[1] + slot, n);
+        }
+        framesRead.fetch_add(n, std::memory_order_relaxed);
+
+        uint64_t published = (s & ~kPositionMask) | (w + n);
+        state.compare_exchange_strong(s, published, std::memory_order_release, std::memory_order_relaxed);
+        return true;
+    }
+
+    // frames still in memory are copied; the rest come from the stream
+    void SampleStreamRing::read(SampleBuffer *source, size_t startFrame, size_t count, float *left, float *right)
+    {
+        size_t resident = startFrame < (size_t)source->residentCount ? std::min(count, source->residentCount - startFrame) : 0;
+        if (resident > 0)
+        {
+            vectorClear(left, resident);
+            vectorClear(right, resident);
+            source->addFrames(0, startFrame, resident, left, false);
+            source->addFrames(1, startFrame, resident, right, false);
+        }
+
+        if (count > resident && (source->stream == 0 ||
+            !source->stream->read(startFrame + resident, count - resident, left + resident, right + resident)))
+        {
+            vectorClear(left + resident, count - resident);
+            vectorClear(right + resident, count - resident);
+        }
+    }
+
+    void SampleStreamRingPool::allocate(size_t ringCount, size_t frameCount)
+    {
+        deallocate();
+        for (size_t i = 0; i < ringCount; i++)
+        {
+            SampleStreamRing *ring = new SampleStreamRing();
+            ring->allocate(frameCount);
+            rings.push_back(ring);
+        }
+        freeRings = rings;
+        ringFrames = frameCount;
+        start();
+    }
+
+    void SampleStreamRingPool::deallocate()
+    {
+        stop();
+        for (SampleStreamRing *ring : rings) delete ring;
+        rings.clear();
+        freeRings.clear();
+        ringFrames = 0;
+    }
+
+    SampleStreamRing *SampleStreamRingPool::acquire()
+    {
+        if (freeRings.empty()) return 0;
+        SampleStreamRing *ring = freeRings.back();
+        freeRings.pop_back();
+        return ring;
+    }
+
+    void SampleStreamRingPool::release(SampleStreamRing *ring)
+    {
+        if (ring == 0) return;
+        ring->end();
+        freeRings.push_back(ring);     // never grows past its initial capacity
+    }
+
+    void SampleStreamRingPool::start()
+    {
+        if (thread.joinable() || rings.empty()) return;
+        quit.store(false);
+        thread = std::thread(&SampleStreamRingPool::run, this);
+    }
+
+    void SampleStreamRingPool::stop()
+    {
+        if (!thread.joinable()) return;
+        quit.store(true);
+        thread.join();
+    }
+
+    // visit every ring in turn, topping each up a little, and nap when none needed anything
+    void SampleStreamRingPool::run()
+    {
+        while (!quit.load(std::memory_order_relaxed))
+        {
+            bool busy = false;
+            for (SampleStreamRing *ring : rings)
+                busy |= ring->fill(SAMPLESTREAM_READ_FRAMES);
+            if (!busy) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    uint64_t SampleStreamRingPool::getUnderruns()
+    {
+        uint64_t total = 0;
+        for (SampleStreamRing *ring : rings) total += ring->underruns.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    uint64_t SampleStreamRingPool::getUnderrunFrames()
+    {
+        uint64_t total = 0;
+        for (SampleStreamRing *ring : rings) total += ring->underrunFrames.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    uint64_t SampleStreamRingPool::getFramesRead()
+    {
+        uint64_t total = 0;
+        for (SampleStreamRing *ring : rings) total += ring->framesRead.load(std::memory_order_relaxed);
+        return total;
+    }
+}
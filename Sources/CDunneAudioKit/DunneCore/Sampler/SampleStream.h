@@ -0,0 +1,156 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "WavPackDecoder.h"
+
+// frames of each streamed sample kept in memory by default, so notes can start without waiting for the disk
+#define SAMPLESTREAM_DEFAULT_HEAD_FRAMES 65536
+
+// frames of read-ahead in each ring; about a third of a second at 48 kHz
+#define SAMPLESTREAM_RING_FRAMES 16384
+
+// the streaming thread tops up each ring by at most this many frames before moving on to the next
+#define SAMPLESTREAM_READ_FRAMES 4096
+
+namespace DunneCore
+{
+    struct SampleBuffer;
+
+    // SampleStream is the source of the frames of a SampleBuffer which are not held in memory.
+    // Only the sampler's streaming thread reads it.
+    class SampleStream
+    {
+    public:
+        virtual ~SampleStream() {}
+
+        /// read count planar frames from startFrame on (right == left for mono); false on failure
+        virtual bool read(size_t startFrame, size_t count, float *left, float *right) = 0;
+    };
+
+    // WavPackSampleStream keeps a WavPack file open, and decodes it sequentially where it can.
+    // When asked for frames out of order (e.g. at a loop point) it goes straight to the block
+    // holding them, using the file's block index.
+    class WavPackSampleStream : public SampleStream
+    {
+    public:
+        /// returns false and fills errorMessage (100 chars) if the file can't be opened
+        bool open(const WavPackSource &source, char *errorMessage);
+        void close();
+
+        const WavPackDecoder &getDecoder() { return decoder; }
+        float getSampleRate() { return decoder.getSampleRate(); }
+        int getChannelCount() { return decoder.getChannelCount(); }
+        size_t getFrameCount() { return decoder.getFrameCount(); }
+        int getBitsPerSample() { return decoder.getBitsPerSample(); }
+        bool isFloat() { return decoder.isFloat(); }
+
+        bool read(size_t startFrame, size_t count, float *left, float *right) override;
+
+    protected:
+        WavPackDecoder decoder;
+        WavPackBlockReader reader;
+    };
+
+    // SampleStreamRing is the read-ahead of one streamed track for one voice's sample group. Frames
+    // are stored in the order the group consumes them, with loop wrapping and reversal already
+    // applied, so the render thread just copies them out. The streaming thread writes ahead of the
+    // group's read position; neither thread ever waits for the other. If the render thread gets
+    // ahead it plays silence and counts an underrun, and the streaming thread skips ahead to catch up.
+    //
+    // Positions count frames of the loop consumed since the note started (or the loop restarted),
+    // so they keep increasing through loop wraps.
+    class SampleStreamRing
+    {
+    public:
+        SampleStreamRing() {}
+        ~SampleStreamRing() { deallocate(); }
+        SampleStreamRing(const SampleStreamRing&) = delete;
+        SampleStreamRing& operator=(const SampleStreamRing&) = delete;
+
+        /// not realtime-safe
+        void allocate(size_t frameCount);
+        void deallocate();
+
+        /// render thread: discard what has been read ahead, and stream the range [startPoint,
+        /// startPoint + sampleCount) of buffer (backwards if reversed) from position firstPosition on
+        void begin(SampleBuffer *buffer, size_t startPoint, size_t sampleCount, bool reversed, uint64_t firstPosition);
+
+        /// render thread: stop reading ahead
+        void end();
+
+        /// render thread: add count frames from position on into left and right; frames not read
+        /// ahead yet are counted as an underrun. Returns the number of frames missed.
+        size_t addTo(uint64_t position, size_t count, float *left, float *right);
+
+        /// streaming thread: read up to maxFrames more ahead; returns false if there was nothing to do
+        bool fill(size_t maxFrames);
+
+        // statistics
+        std::atomic<uint64_t> underruns { 0 }, underrunFrames { 0 }, framesRead { 0 };
+
+        // the frame addTo() starts reading the ring from; earlier ones come from the buffer in memory
+        uint64_t firstPosition = 0;
+
+    protected:
+        float *frames[2] = { 0, 0 };
+        size_t capacity = 0;
+
+        // what to stream; written by begin() while state is idle
+        std::atomic<SampleBuffer*> buffer { 0 };
+        std::atomic<size_t> startPoint { 0 }, sampleCount { 0 };
+        std::atomic<bool> reversed { false };
+
+        // generation << 40 | position written up to, or kIdle. Only begin() and end() change the
+        // generation; fill() publishes frames with a compare-and-swap, so a fill which raced a
+        // begin() is simply discarded.
+        static const uint64_t kIdle = 1ull << 63;
+        static const uint64_t kPositionMask = (1ull << 40) - 1;
+        std::atomic<uint64_t> state { kIdle };
+        char padding[64];
+        std::atomic<uint64_t> readPosition { 0 };     // written only by the render thread
+
+        void read(SampleBuffer *buffer, size_t startFrame, size_t count, float *left, float *right);
+    };
+
+    // SampleStreamRingPool is the fixed set of rings shared by a sampler's voices, and the thread
+    // that keeps them filled. acquire() and release() never allocate, and belong on the thread
+    // which prepares notes (the render thread).
+    class SampleStreamRingPool
+    {
+    public:
+        ~SampleStreamRingPool() { deallocate(); }
+
+        /// not realtime-safe; stops and restarts the streaming thread
+        void allocate(size_t ringCount, size_t frameCount);
+        void deallocate();
+        bool isAllocated() { return !rings.empty(); }
+        size_t getByteCount() { return rings.size() * ringFrames * 2 * sizeof(float); }
+
+        /// returns 0 if every ring is in use
+        SampleStreamRing *acquire();
+        void release(SampleStreamRing *ring);
+
+        void start();
+        void stop();
+
+        /// totals over all rings
+        uint64_t getUnderruns();
+        uint64_t getUnderrunFrames();
+        uint64_t getFramesRead();
+
+    protected:
+        std::vector<SampleStreamRing*> rings;
+        std::vector<SampleStreamRing*> freeRings;
+        size_t ringFrames = 0;
+        std::thread thread;
+        std::atomic<bool> quit { false };
+
+        void run();
+    };
+}
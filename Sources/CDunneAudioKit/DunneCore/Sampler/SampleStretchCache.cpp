@@ -0,0 +1,102 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#include "SampleStretchCache.h"
+#include "VectorOps.h"
+
+#include <math.h>
+
+namespace DunneCore
+{
+    SampleStretch *SampleStretchCache::acquire(const std::vector<SampleBuffer*> &buffers, size_t startPoint,
+                                               size_t sampleCount, bool reversed, float timeRatio, float pitchScale, bool bake)
+    {
+        SampleStretch *entry = find([&](const SampleStretch &stretch) {
+            return stretch.matches(buffers, startPoint, sampleCount, reversed, timeRatio, pitchScale);
+        });
+        if (entry || !bake) return entry;
+
+        return request(buffers, startPoint, sampleCount, reversed, [&](SampleStretch &stretch) {
+            stretch.timeRatio = timeRatio;
+            stretch.pitchScale = pitchScale;
+        });
+    }
+
+    bool SampleStretchCache::make(SampleStretch &entry)
+    {
+        bool baked = bake(entry);
+        (baked ? bakes : failures).fetch_add(1, std::memory_order_relaxed);
+        return baked;
+    }
+
+    bool SampleStretchCache::bake(SampleStretch &entry)
+    {
+        // the middle of three passes round the loop has the loop's own end before it and start after
+        const size_t loopCount = entry.sampleCount;
+        const size_t totalCount = 3 * loopCount;
+        const size_t first = size_t(llround(double(loopCount) * entry.timeRatio));
+        const size_t last = size_t(llround(2.0 * loopCount * entry.timeRatio));
+        const size_t byteCount = 2 * (last - first) * sizeof(float);
+        if (last <= first || !makeRoom(byteCount)) return false;
+
+        RubberBand::RubberBandStretcher::Options options = 0;
+        options |= RubberBand::RubberBandStretcher::OptionProcessOffline;
+        options |= RubberBand::RubberBandStretcher::OptionChannelsTogether;
+        options |= RubberBand::RubberBandStretcher::OptionStretchPrecise;
+        options |= RubberBand::RubberBandStretcher::OptionThreadingNever;
+        RubberBand::RubberBandStretcher stretcher(size_t(sampleRate.load()), 2, options, entry.timeRatio, entry.pitchScale);
+        stretcher.setExpectedInputDuration(totalCount);
+        stretcher.setMaxProcessSize(SAMPLESTRETCHCACHE_BAKE_BLOCKSIZE);
+
+        std::vector<SampleBuffer*> buffers = entry.getBuffers();
+        std::vector<float> scratch(2 * SAMPLESTRETCHCACHE_BAKE_BLOCKSIZE);
+        float *block[2] = { scratch.data(), scratch.data() + SAMPLESTRETCHCACHE_BAKE_BLOCKSIZE };
+        float *samples[2] = { new float[last - first](), new float[last - first]() };
+
+        // keep the part of each block retrieved which falls in [first, last)
+        size_t retrieved = 0;
+        auto drain = [&] {
+            int available;
+            while ((available = stretcher.available()) > 0 && retrieved < last)
+            {
+                size_t count = stretcher.retrieve(block, std::min<size_t>(available, SAMPLESTRETCHCACHE_BAKE_BLOCKSIZE));
+                size_t from = std::max(retrieved, first), to = std::min(retrieved + count, last);
+                for (int c = 0; c < 2 && from < to; c++)
+                    std::copy(block[c] + (from - retrieved), block[c] + (to - retrieved), samples[c] + (from - first));
+                retrieved += count;
+            }
+        };
+
+        // study the whole input, then stretch it, mixing it a block (within one pass) at a time
+        for (int pass = 0; pass < 2 && !quit.load(std::memory_order_relaxed); pass++)
+        {
+            for (size_t position = 0, count; position < totalCount && retrieved < last; position += count)
+            {
+                size_t offset = position % loopCount;
+                count = std::min<size_t>(SAMPLESTRETCHCACHE_BAKE_BLOCKSIZE, loopCount - offset);
+                mixSampleBuffers(buffers, entry.startPoint, loopCount, entry.reversed, offset, count, block);
+                bool final = position + count == totalCount;
+                if (pass == 0) stretcher.study(block, count, final);
+                else
+                {
+                    stretcher.process(block, count, final);
+                    drain();
+                }
+            }
+        }
+        drain();
+
+        if (quit.load(std::memory_order_relaxed))
+        {
+            delete[] samples[0];
+            delete[] samples[1];
+            bytesUsed.fetch_sub(byteCount);
+            return false;
+        }
+        entry.samples[0] = samples[0];
+        entry.samples[1] = samples[1];
+        entry.stretchedCount = last - first;
+        entry.byteCount = byteCount;
+        return true;
+    }
+
+}
@@ -0,0 +1,68 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#pragma once
+#include "SampleLoopCache.h"
+
+// loops (each a set of tracks, range, direction and stretch) the cache can hold or be baking at once
+#define SAMPLESTRETCHCACHE_ENTRIES 64
+
+// updates (one per render chunk, so about a third of a second at 48 kHz) a group's speed and pitch
+// must hold before it asks for its loop to be baked
+#define SAMPLESTRETCHCACHE_SETTLE_UPDATES 1024
+
+// frames the baking thread mixes, studies and stretches at a time
+#define SAMPLESTRETCHCACHE_BAKE_BLOCKSIZE 4096
+
+namespace DunneCore
+{
+    // one loop rendered through an offline stretcher at a fixed speed and pitch
+    struct SampleStretch : SampleLoopEntry
+    {
+        // the stretch; written only while kClaimed
+        float timeRatio, pitchScale;
+
+        // once kReady: the loop once round at that stretch, from the middle of three passes
+        // through the stretcher, so it plays round and round without a seam
+        size_t stretchedCount = 0;
+
+        bool matches(const std::vector<SampleBuffer*> &buffers, size_t startPoint, size_t sampleCount,
+                     bool reversed, float timeRatio, float pitchScale) const
+        {
+            return this->timeRatio == timeRatio && this->pitchScale == pitchScale &&
+                isLoop(buffers, startPoint, sampleCount, reversed);
+        }
+    };
+
+    // SampleStretchCache bakes loops whose speed and pitch have settled: its thread renders each
+    // through an offline RubberBand stretcher, which maps the whole loop's peaks before stretching
+    // it, and voices then play the result instead of running their realtime stretchers. See
+    // SampleLoopCache for how entries are shared and evicted.
+    class SampleStretchCache : public SampleLoopCache<SampleStretch, SAMPLESTRETCHCACHE_ENTRIES>
+    {
+    public:
+        SampleStretchCache() {}
+        ~SampleStretchCache() { stop(); clear(); }
+
+        /// the rate loops are stretched at, i.e. the sampler's
+        void setSampleRate(float rate) { sampleRate.store(rate); }
+
+        /// the entry for this loop at this stretch, being baked or ready, held until released; with
+        /// bake, one is requested if there is none and the budget allows, else returns 0
+        SampleStretch *acquire(const std::vector<SampleBuffer*> &buffers, size_t startPoint, size_t sampleCount,
+                               bool reversed, float timeRatio, float pitchScale, bool bake);
+
+        // statistics
+        uint64_t getBakes() { return bakes.load(std::memory_order_relaxed); }
+        uint64_t getFailures() { return failures.load(std::memory_order_relaxed); }
+        uint64_t getPlays() { return plays.load(std::memory_order_relaxed); }
+        void countPlay() { plays.fetch_add(1, std::memory_order_relaxed); }
+
+    protected:
+        std::atomic<float> sampleRate { 48000.0f };
+        std::atomic<uint64_t> bakes { 0 }, failures { 0 }, plays { 0 };
+
+        bool make(SampleStretch &entry) override;
+        bool bake(SampleStretch &entry);
+    };
+
+}
@@ -7,8 +7,40 @@
 
 namespace DunneCore
 {
+    SamplerVoice::~SamplerVoice()
+    {
+        delete stretcher;
+    }
+
     void SamplerVoice::init(double sampleRate)
     {
+        RubberBand::RubberBandStretcher::Options options = 0;
+        options |= RubberBand::RubberBandStretcher::OptionProcessRealTime;
+        options |= RubberBand::RubberBandStretcher::OptionChannelsTogether;
+        options |= RubberBand::RubberBandStretcher::OptionStretchPrecise;
+
+        // the voice's stretcher is its for good: every note resets it and sets its ratios as it
+        // plays, so one made for this rate already is only reset here, to the ratios of a new one
+        if (stretcher == 0 || stretcherRate != sampleRate)
+        {
+            delete stretcher;
+            stretcher = new RubberBand::RubberBandStretcher(size_t(sampleRate), 2, options);
+            stretcherRate = sampleRate;
+        }
+        else
+        {
+            stretcher->reset();
+            stretcher->setTimeRatio(1.0);
+            stretcher->setPitchScale(1.0);
+        }
+        for (auto &group : groups)
+        {
+            group.stretcher = stretcher;
+            group.allocate(1);
+        }
+        sampleBuffers = newSampleBuffers = 0;
+        sampleView = SampleBufferView();
+
         samplingRate = float(sampleRate);
         leftFilter.init(sampleRate);
         rightFilter.init(sampleRate);
@@ -24,38 +56,36 @@ namespace DunneCore
         current = {};
     }
 
-    void SamplerVoice::prepare(unsigned note, float sampleRate, float frequency, float volume, SampleBufferGroup buffers)
+    void SamplerVoice::reserveSampleBuffers(size_t maxBuffers)
+    {
+        for (auto &group : groups) group.allocate(maxBuffers);
+    }
+
+    void SamplerVoice::releaseSampleBuffers()
     {
-        prepare(note, sampleRate, frequency, volume, this->currentLoop, buffers);
+        for (auto &group : groups) group.release();
+        sampleView = SampleBufferView();
     }
 
-    void SamplerVoice::prepare(unsigned note, float sampleRate, float frequency, float volume, LoopDescriptor loop, SampleBufferGroup buffers)
+    void SamplerVoice::prepare(unsigned note, float sampleRate, float frequency, float volume, SampleBufferGroup *buffers)
     {
-        prepare(note, sampleRate, frequency, volume, loop, buffers, [this]() { this->start(); });
+        prepare(note, sampleRate, frequency, volume, buffers, &SamplerVoice::start);
     }
 
-    void SamplerVoice::prepare(unsigned note, float sampleRate, float frequency, float volume, LoopDescriptor loop, SampleBufferGroup buffers,
-        std::function<void()> start)
+    void SamplerVoice::prepare(unsigned note, float sampleRate, float frequency, float volume, SampleBufferGroup *buffers,
+        void (SamplerVoice::*start)())
     {
+        // the group owns copies of the loop's arrays, which stay valid while it plays
         PlayEvent event;
         event.note = note;
         event.sampleRate = sampleRate;
         event.frequency = frequency;
         event.volume = volume;
         event.buffers = buffers;
-        event.loop = loop;
-        unsigned int *mutedEnds = new unsigned int[loop.mutedCount];
-        unsigned int *mutedStarts = new unsigned int[loop.mutedCount];
-        unsigned int *enabledTracks = new unsigned int[loop.enabledTracksCount];
-        memcpy(mutedStarts, loop.mutedStartPoints, sizeof(unsigned int) * loop.mutedCount);
-        memcpy(mutedEnds, loop.mutedEndPoints, sizeof(unsigned int) * loop.mutedCount);
-        memcpy(enabledTracks, loop.enabledTracks, sizeof(unsigned int) * loop.enabledTracksCount);
-        event.loop.mutedStartPoints = mutedStarts;
-        event.loop.mutedEndPoints = mutedEnds;
-        event.loop.enabledTracks = enabledTracks;
+        event.loop = buffers->loop;
         event.start = start;
         
-        auto buffer = buffers.sampleBuffers.front();
+        auto buffer = buffers->sampleBuffers.front();
         event.increment = (buffer->sampleRate / sampleRate) * (frequency / buffer->noteFrequency);
         
         event.glideSemitones = 0.0f;
@@ -88,7 +118,7 @@ namespace DunneCore
         oscillator.multiplier = 1.0;
         oscillator.isLooping = next.loop.isLooping;
         
-        sampleBuffers.stretcher->reset();
+        sampleView.init(sampleBuffers);
         
         noteVolume = next.volume;
         ampEnvelope.start();
@@ -112,14 +142,9 @@ namespace DunneCore
         restartVoiceLFOIfNeeded();
     }
 
-    void SamplerVoice::restartNewNote(unsigned note, float sampleRate, float frequency, float volume, SampleBufferGroup buffers)
-    {
-        restartNewNote(note, sampleRate, frequency, volume, this->currentLoop, buffers);
-    }
-
-    void SamplerVoice::restartNewNote(unsigned note, float sampleRate, float frequency, float volume, LoopDescriptor loop, SampleBufferGroup buffers)
+    void SamplerVoice::restartNewNote(unsigned note, float sampleRate, float frequency, float volume, SampleBufferGroup *buffers)
     {
-        prepare(note, sampleRate, frequency, volume, loop, buffers, [this]() { this->restartNewNote(); });
+        prepare(note, sampleRate, frequency, volume, buffers, &SamplerVoice::restartNewNote);
     }
 
     void SamplerVoice::restartNewNote()
@@ -148,7 +173,7 @@ namespace DunneCore
 
     void SamplerVoice::restartNewNoteLegato(unsigned note, float sampleRate, float frequency)
     {
-        prepare(note, sampleRate, frequency, noteVolume, currentLoop, sampleBuffers, [this]() { this->restartNewNoteLegato(); });
+        prepare(note, sampleRate, frequency, noteVolume, sampleBuffers, &SamplerVoice::restartNewNoteLegato);
     }
 
     void SamplerVoice::restartNewNoteLegato()
@@ -162,9 +187,9 @@ namespace DunneCore
         noteNumber = next.note;
     }
 
-    void SamplerVoice::restartSameNote(float volume, LoopDescriptor loop, SampleBufferGroup buffers)
+    void SamplerVoice::restartSameNote(float volume, SampleBufferGroup *buffers)
     {
-        prepare(noteNumber, samplingRate, noteFrequency, volume, loop, buffers, [this]() { this->restartSameNote(); });
+        prepare(noteNumber, samplingRate, noteFrequency, volume, buffers, &SamplerVoice::restartSameNote);
     }
 
     void SamplerVoice::restartSameNote()
@@ -218,12 +243,12 @@ namespace DunneCore
                 volumeRamper.reinit(ampEnvelope.getSample(), sampleCount);
                 sampleBuffers = newSampleBuffers;
                 currentLoop = nextLoop;
-                auto sampleBuffer = sampleBuffers.sampleBuffers.front();
+                auto sampleBuffer = sampleBuffers->sampleBuffers.front();
                 oscillator.increment = (sampleBuffer->sampleRate / samplingRate) * (noteFrequency / sampleBuffer->noteFrequency);
                 oscillator.indexPoint = 0;
                 oscillator.muteIndex = 0;
                 oscillator.isLooping = nextLoop.isLooping;
-                sampleBuffers.stretcher->reset();
+                sampleView.init(sampleBuffers);
             }
         }
         else
@@ -248,7 +273,7 @@ namespace DunneCore
             }
         }
 
-        sampleBuffers.update(speed, pitch, varispeed);
+        sampleBuffers->update(speed, pitch, varispeed);
         
         float pitchCurveAmount = 1.0f; // >1 = faster curve, 0 < curve < 1 = slower curve - make this a parameter
         if (pitchCurveAmount < 0) { pitchCurveAmount = 0; }
@@ -285,7 +310,7 @@ namespace DunneCore
         {
             float gain = tempGain * volumeRamper.getNextValue();
             float leftSample, rightSample;
-            if (oscillator.getSamplePair(sampleBuffers, currentLoop, sampleCount, &leftSample, &rightSample, gain))
+            if (oscillator.getSamplePair(sampleView, currentLoop, sampleCount, &leftSample, &rightSample, gain))
                 return true;
             if (isFilterEnabled)
             {
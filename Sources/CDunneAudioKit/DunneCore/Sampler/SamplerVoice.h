@@ -2,8 +2,6 @@
 
 #pragma once
 #include <math.h>
-#include <list>
-#include <functional>
 
 #include "Sampler_Typedefs.h"
 #include "SampleBuffer.h"
@@ -19,12 +17,14 @@
 
 namespace DunneCore
 {
+    struct SamplerVoice;
+
     struct PlayEvent {
         unsigned note;
         float sampleRate, frequency, volume, glideSemitones;
         double increment;
         LoopDescriptor loop;
-        SampleBufferGroup buffers;
+        SampleBufferGroup *buffers = 0;
         int64_t sampleTime = 0;
         enum PlayState {
             INIT = 0,
@@ -32,7 +32,8 @@ namespace DunneCore
             PLAYING
         };
         PlayState state = INIT;
-        std::function<void()> start;
+        /// what the voice does when the event's time comes (plain data, so copying never allocates)
+        void (SamplerVoice::*start)() = 0;
         bool loopsAreEqual(LoopDescriptor otherLoop) {
             if (loop.isLooping != otherLoop.isLooping ||
                 loop.reversed != otherLoop.reversed ||
@@ -57,7 +58,8 @@ namespace DunneCore
                 event.sampleRate == sampleRate &&
                 event.frequency == frequency &&
                 event.volume == volume &&
-                event.buffers.sampleBuffers == buffers.sampleBuffers &&
+                event.buffers && buffers &&
+                event.buffers->sampleBuffers == buffers->sampleBuffers &&
                 loopsAreEqual(event.loop)
             );
         };
@@ -72,9 +74,19 @@ namespace DunneCore
         /// every voice has 1 oscillator
         SampleOscillator oscillator;
         
-        /// a pointer to the sample buffer for that oscillator
-        SampleBufferGroup sampleBuffers;
+        /// a pointer to the sample buffer group for that oscillator (one of groups[])
+        SampleBufferGroup *sampleBuffers;
         LoopDescriptor currentLoop;
+
+        /// what the oscillator reads from sampleBuffers each frame
+        SampleBufferView sampleView;
+
+        /// preallocated groups: one playing, one being prepared for the next note
+        SampleBufferGroup groups[2];
+
+        /// time-stretcher shared by both groups, created by init() and kept while the rate stays the same
+        RubberBand::RubberBandStretcher *stretcher;
+        double stretcherRate;
         
         /// two filters (left/right)
         ResonantLowPassFilter leftFilter, rightFilter;
@@ -114,7 +126,7 @@ namespace DunneCore
         float tempNoteVolume;
 
         /// Next sample buffer to use at restart
-        SampleBufferGroup newSampleBuffers;
+        SampleBufferGroup *newSampleBuffers;
         LoopDescriptor nextLoop;
 
         /// product of global volume, note volume
@@ -125,43 +137,52 @@ namespace DunneCore
 
         /// true if filter should be used
         bool isFilterEnabled;
+
+        /// end of the render chunk prepToGetSamples() last set the voice up for
+        int64_t preparedChunkEnd = INT64_MIN;
         
-        SamplerVoice() : noteNumber(-1), sampleBuffers(), newSampleBuffers() {}
+        SamplerVoice() : sampleBuffers(0), stretcher(0), stretcherRate(0.0), noteNumber(-1), newSampleBuffers(0) {}
+        ~SamplerVoice();
 
+        /// not realtime-safe: creates the stretcher for the given rate, or resets the one made for it before
         void init(double sampleRate);
 
+        /// not realtime-safe: ensure each group can hold up to maxBuffers tracks
+        void reserveSampleBuffers(size_t maxBuffers);
+
+        /// let go of all sample buffers and cached mixes; call only when the voice is silent
+        void releaseSampleBuffers();
+
+        /// the group not currently playing, to be filled in for the next note
+        SampleBufferGroup *freeGroup() { return sampleBuffers == &groups[0] ? &groups[1] : &groups[0]; }
+
         void updateAmpAdsrParameters() { ampEnvelope.updateParams(); }
         void updateFilterAdsrParameters() { filterEnvelope.updateParams(); }
         void updatePitchAdsrParameters() { pitchEnvelope.updateParams(); }
         
+        // sampleBuffers must be freeGroup(), already initialized for the note's loop
         void prepare(unsigned noteNumber,
                    float sampleRate,
                    float frequency,
                    float volume,
-                   SampleBufferGroup sampleBuffers);
-        void prepare(unsigned noteNumber,
-                   float sampleRate,
-                   float frequency,
-                   float volume,
-                   LoopDescriptor loop,
-                   SampleBufferGroup sampleBuffers);
+                   SampleBufferGroup *sampleBuffers);
         void prepare(unsigned noteNumber,
                    float sampleRate,
                    float frequency,
                    float volume,
-                   LoopDescriptor loop,
-                   SampleBufferGroup sampleBuffers,
-                   std::function<void()> start);
+                   SampleBufferGroup *sampleBuffers,
+                   void (SamplerVoice::*start)());
 
         void play(int64_t sampleTime);
         void start();
-        void restartNewNote(unsigned noteNumber, float sampleRate, float frequency, float volume, LoopDescriptor loop, SampleBufferGroup buffers);
-        void restartNewNote(unsigned noteNumber, float sampleRate, float frequency, float volume, SampleBufferGroup buffers);
+        /// carries out next's start function
+        void startNext() { (this->*next.start)(); }
+        void restartNewNote(unsigned noteNumber, float sampleRate, float frequency, float volume, SampleBufferGroup *buffers);
         void restartNewNote();
         void restartNewNoteLegato(unsigned noteNumber, float sampleRate, float frequency);
         void restartNewNoteLegato();
         void restartSameNote();
-        void restartSameNote(float volume, LoopDescriptor loop, SampleBufferGroup sampleBuffers);
+        void restartSameNote(float volume, SampleBufferGroup *sampleBuffers);
         void release(bool loopThruRelease);
         void stop();
         
@@ -0,0 +1,396 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#include "WavPackDecoder.h"
+#include "VectorOps.h"
+#include "wavpack.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// frames unpacked from a WavPack file at a time
+#define WAVPACK_UNPACK_FRAMES 16384
+
+namespace DunneCore
+{
+    static bool seekFile(FILE *file, uint64_t offset)
+    {
+#if defined(_WIN32)
+        return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+        return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+    }
+
+    static uint32_t littleEndian32(const uint8_t *p)
+    {
+        return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    }
+
+    // WavPack reads a block reader's file through these; it never seeks in streaming mode
+    static int32_t readBytes(void *id, void *data, int32_t count) { return (int32_t)fread(data, 1, count, (FILE *)id); }
+    static int32_t writeBytes(void *, void *, int32_t) { return 0; }
+    static int64_t getPosition(void *) { return 0; }
+    static int setPositionAbsolute(void *, int64_t) { return -1; }
+    static int setPositionRelative(void *, int64_t, int) { return -1; }
+    static int pushBackByte(void *id, int c) { return ungetc(c, (FILE *)id); }
+    static int64_t getLength(void *) { return 0; }
+    static int canSeek(void *) { return 0; }
+
+    static WavpackStreamReader64 fileReader = {
+        readBytes, writeBytes, getPosition, setPositionAbsolute, setPositionRelative,
+        pushBackByte, getLength, canSeek, 0, 0
+    };
+
+    // and a memory stream's through these; it may seek, except in streaming mode
+    static int32_t readMemory(void *id, void *data, int32_t count)
+    {
+        WavPackMemoryStream *stream = (WavPackMemoryStream *)id;
+        size_t n = std::min((size_t)std::max(count, 0), stream->byteCount - stream->position);
+        memcpy(data, stream->data + stream->position, n);
+        stream->position += n;
+        return (int32_t)n;
+    }
+
+    static int64_t getMemoryPosition(void *id) { return (int64_t)((WavPackMemoryStream *)id)->position; }
+
+    static int setMemoryPositionAbsolute(void *id, int64_t position)
+    {
+        WavPackMemoryStream *stream = (WavPackMemoryStream *)id;
+        if (position < 0 || (uint64_t)position > stream->byteCount) return -1;
+        stream->position = (size_t)position;
+        return 0;
+    }
+
+    static int setMemoryPositionRelative(void *id, int64_t delta, int mode)
+    {
+        WavPackMemoryStream *stream = (WavPackMemoryStream *)id;
+        int64_t base = mode == SEEK_SET ? 0 : mode == SEEK_CUR ? (int64_t)stream->position : (int64_t)stream->byteCount;
+        return setMemoryPositionAbsolute(id, base + delta);
+    }
+
+    static int pushBackMemoryByte(void *id, int c)
+    {
+        WavPackMemoryStream *stream = (WavPackMemoryStream *)id;
+        if (stream->position == 0) return EOF;
+        stream->position--;
+        return c;
+    }
+
+    static int64_t getMemoryLength(void *id) { return (int64_t)((WavPackMemoryStream *)id)->byteCount; }
+    static int canSeekMemory(void *) { return 1; }
+
+    static WavpackStreamReader64 memoryReader = {
+        readMemory, writeBytes, getMemoryPosition, setMemoryPositionAbsolute, setMemoryPositionRelative,
+        pushBackMemoryByte, getMemoryLength, canSeekMemory, 0, 0
+    };
+
+    WavPackSource WavPackSource::file(const char *path)
+    {
+        WavPackSource source;
+        source.path = path;
+        return source;
+    }
+
+    WavPackSource WavPackSource::memory(const void *data, size_t byteCount)
+    {
+        WavPackSource source;
+        source.data = (const uint8_t *)data;
+        source.byteCount = byteCount;
+        return source;
+    }
+
+    std::string WavPackSource::getName() const
+    {
+        if (!isMemory()) return path;
+        char name[64];
+        snprintf(name, sizeof(name), "memory:%p+%llu", (const void *)data, (unsigned long long)byteCount);
+        return name;
+    }
+
+    const void *mapFile(const char *path, size_t &byteCount)
+    {
+        byteCount = 0;
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (file == INVALID_HANDLE_VALUE) return 0;
+        LARGE_INTEGER size;
+        HANDLE mapping = 0;
+        void *data = 0;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+            (mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0)) != 0)
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (mapping) CloseHandle(mapping);      // the view keeps the mapping alive
+        CloseHandle(file);
+        if (data) byteCount = (size_t)size.QuadPart;
+        return data;
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return 0;
+        struct stat info;
+        void *data = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+            data = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);                            // the mapping outlives the descriptor
+        if (data == MAP_FAILED) return 0;
+        byteCount = (size_t)info.st_size;
+        return data;
+#endif
+    }
+
+    void unmapFile(const void *data, size_t byteCount)
+    {
+        if (data == 0) return;
+#if defined(_WIN32)
+        (void)byteCount;
+        UnmapViewOfFile(data);
+#else
+        munmap(const_cast<void *>(data), byteCount);
+#endif
+    }
+
+    WavPackDecoder::WavPackDecoder()
+    : sampleRate(0.0f)
+    , channelCount(0)
+    , frameCount(0)
+    , bitsPerSample(0)
+    , floatSamples(false)
+    {
+    }
+
+    bool WavPackDecoder::open(const WavPackSource &newSource, char *errorMessage)
+    {
+        blocks.clear();
+        WavPackMemoryStream stream = { newSource.data, newSource.byteCount, 0 };
+        WavpackContext *wpc = newSource.isMemory()
+            ? WavpackOpenFileInputEx64(&memoryReader, &stream, 0, errorMessage, OPEN_2CH_MAX, 0)
+            : WavpackOpenFileInput(newSource.path.c_str(), errorMessage, OPEN_2CH_MAX, 0);
+        if (wpc == 0) return false;
+        source = newSource;
+        sampleRate = (float)WavpackGetSampleRate(wpc);
+        channelCount = std::min(WavpackGetReducedChannels(wpc), 2);
+        frameCount = (size_t)WavpackGetNumSamples64(wpc);
+        bitsPerSample = WavpackGetBitsPerSample(wpc);
+        floatSamples = (WavpackGetMode(wpc) & MODE_FLOAT) != 0;
+        WavpackCloseFile(wpc);
+
+        bool ok;
+        if (source.isMemory())
+        {
+            ok = index([&](uint64_t offset, uint8_t *header, size_t size) {
+                if (offset > source.byteCount || source.byteCount - offset < size) return false;
+                memcpy(header, source.data + offset, size);
+                return true;
+            });
+        }
+        else
+        {
+            FILE *file = fopen(source.path.c_str(), "rb");
+            ok = file != 0 && index([&](uint64_t offset, uint8_t *header, size_t size) {
+                return seekFile(file, offset) && fread(header, 1, size, file) == size;
+            });
+            if (file) fclose(file);
+        }
+        if (!ok)
+        {
+            strcpy(errorMessage, "can't index blocks");
+            blocks.clear();
+        }
+        return ok;
+    }
+
+    // one read per block header; a file's blocks follow one another, perhaps followed by tags
+    bool WavPackDecoder::index(const std::function<bool(uint64_t, uint8_t *, size_t)> &readAt)
+    {
+        uint8_t header[32];
+        uint64_t offset = 0;
+        int64_t initialFrame = 0;
+        while (readAt(offset, header, sizeof(header)) && memcmp(header, "wvpk", 4) == 0)
+        {
+            uint32_t blockBytes = littleEndian32(header + 4);
+            int64_t blockFrame = (int64_t)littleEndian32(header + 16) + ((int64_t)header[10] << 32);
+            uint32_t blockFrames = littleEndian32(header + 20);
+            uint32_t flags = littleEndian32(header + 24);
+            if (blockBytes < sizeof(header) - 8) return false;
+
+            // later blocks of a multichannel frame belong to the first one
+            if (blockFrames > 0 && (flags & INITIAL_BLOCK))
+            {
+                if (blocks.empty()) initialFrame = blockFrame;
+                WavPackBlock block = { offset, uint64_t(blockFrame - initialFrame), blockFrames };
+                if (block.firstFrame != (blocks.empty() ? 0 : blocks.back().firstFrame + blocks.back().frameCount))
+                    return false;
+                blocks.push_back(block);
+            }
+            offset += uint64_t(blockBytes) + 8;
+        }
+        return !blocks.empty() && blocks.back().firstFrame + blocks.back().frameCount == frameCount;
+    }
+
+    size_t WavPackDecoder::findBlock(size_t frame) const
+    {
+        auto after = std::upper_bound(blocks.begin(), blocks.end(), frame,
+                                      [](size_t f, const WavPackBlock &block) { return f < block.firstFrame; });
+        return after == blocks.begin() ? 0 : size_t(after - blocks.begin()) - 1;
+    }
+
+    bool WavPackDecoder::decode(size_t startFrame, size_t count, float *left, float *right) const
+    {
+        WavPackBlockReader reader;
+        return reader.seek(*this, startFrame) && reader.read(count, left, right);
+    }
+
+    bool WavPackDecoder::forEachRange(size_t startFrame, size_t count, int threadCount, size_t minFrames,
+                                      const std::function<bool(size_t, size_t)> &decodeRange) const
+    {
+        if (count == 0) return true;
+
+        // cut at the start of the block holding each ideal cut point, so no block is decoded twice;
+        // a block longer than a range gets a range to itself
+        threadCount = std::max(threadCount, 1);
+        size_t endFrame = startFrame + count;
+        size_t rangeFrames = std::max(minFrames, (count + threadCount - 1) / threadCount);
+        std::vector<size_t> cuts(1, startFrame);
+        for (;;)
+        {
+            size_t b = findBlock(cuts.back() + rangeFrames);
+            if (blocks[b].firstFrame <= cuts.back() && ++b == blocks.size()) break;
+            size_t cut = blocks[b].firstFrame;
+            if (cut >= endFrame || endFrame - cut < minFrames) break;
+            cuts.push_back(cut);
+        }
+        cuts.push_back(endFrame);
+
+        size_t rangeCount = cuts.size() - 1;
+        std::atomic<size_t> nextRange { 0 };
+        std::atomic<bool> ok { true };
+        auto decodeRanges = [&]() {
+            for (size_t r; ok.load() && (r = nextRange.fetch_add(1)) < rangeCount; )
+                if (!decodeRange(cuts[r], cuts[r + 1] - cuts[r])) ok.store(false);
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < std::min<size_t>(threadCount, rangeCount); t++)
+            threads.emplace_back(decodeRanges);
+        decodeRanges();
+        for (std::thread &thread : threads) thread.join();
+        return ok.load();
+    }
+
+    bool WavPackDecoder::decodeParallel(size_t startFrame, size_t count, float *left, float *right,
+                                        int threadCount, size_t minFrames) const
+    {
+        return forEachRange(startFrame, count, threadCount, minFrames, [&](size_t start, size_t n) {
+            return decode(start, n, left + (start - startFrame), right + (start - startFrame));
+        });
+    }
+
+    WavPackBlockReader::WavPackBlockReader()
+    : decoder(0)
+    , file(0)
+    , memory()
+    , context(0)
+    , position(SIZE_MAX)
+    {
+    }
+
+    void WavPackBlockReader::close()
+    {
+        if (context) WavpackCloseFile((WavpackContext *)context);
+        if (file) fclose(file);
+        context = 0;
+        file = 0;
+        position = SIZE_MAX;
+    }
+
+    bool WavPackBlockReader::seek(const WavPackDecoder &newDecoder, size_t startFrame)
+    {
+        close();
+        decoder = &newDecoder;
+        const std::vector<WavPackBlock> &blocks = decoder->getBlocks();
+        if (blocks.empty() || startFrame >= decoder->getFrameCount()) return false;
+        const WavPackBlock &block = blocks[decoder->findBlock(startFrame)];
+
+        // in streaming mode WavPack decodes whatever blocks it is given, from wherever they start
+        char errorMessage[100];
+        const WavPackSource &source = decoder->getSource();
+        if (source.isMemory())
+        {
+            memory = { source.data, source.byteCount, (size_t)block.offset };
+            context = WavpackOpenFileInputEx64(&memoryReader, &memory, 0, errorMessage, OPEN_STREAMING | OPEN_2CH_MAX, 0);
+        }
+        else if ((file = fopen(source.path.c_str(), "rb")) != 0 && seekFile(file, block.offset))
+            context = WavpackOpenFileInputEx64(&fileReader, file, 0, errorMessage, OPEN_STREAMING | OPEN_2CH_MAX, 0);
+        if (context == 0 || std::min(WavpackGetReducedChannels((WavpackContext *)context), 2) != decoder->getChannelCount())
+        {
+            close();
+            return false;
+        }
+
+        // decode and discard up to the frame asked for
+        position = (size_t)block.firstFrame;
+        if (!unpack(startFrame - position, 0, 0))
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool WavPackBlockReader::read(size_t count, float *left, float *right)
+    {
+        if (context == 0 || position + count > decoder->getFrameCount() || !unpack(count, left, right))
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // left == 0 discards what is unpacked
+    bool WavPackBlockReader::unpack(size_t count, float *left, float *right)
+    {
+        WavpackContext *wpc = (WavpackContext *)context;
+        int channelCount = decoder->getChannelCount();
+        float scale = ldexpf(1.0f, 1 - decoder->getBitsPerSample());
+        unpacked.resize(WAVPACK_UNPACK_FRAMES * channelCount);
+        while (count > 0)
+        {
+            uint32_t frames = (uint32_t)std::min<size_t>(count, WAVPACK_UNPACK_FRAMES);
+            if (WavpackUnpackSamples(wpc, unpacked.data(), frames) != frames) return false;
+            count -= frames;
+            position += frames;
+            if (left == 0) continue;
+
+            // de-interleave, converting to floating-point; float files come unpacked as raw bits
+            if (decoder->isFloat())
+            {
+                for (int c = 0; c < channelCount; c++)
+                {
+                    float *out = c == 0 ? left : right;
+                    const int32_t *in = unpacked.data() + c;
+                    for (uint32_t i = 0; i < frames; i++, in += channelCount) memcpy(&out[i], in, sizeof(float));
+                }
+            }
+            else if (channelCount == 2)
+                vectorDeinterleaveInt32(left, right, unpacked.data(), scale, frames);
+            else
+                vectorConvertInt32(left, unpacked.data(), scale, frames);
+            if (channelCount == 1 && right != left) memcpy(right, left, frames * sizeof(float));
+
+            left += frames;
+            right += frames;
+        }
+        return true;
+    }
+}
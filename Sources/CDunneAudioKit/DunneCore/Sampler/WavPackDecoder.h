@@ -0,0 +1,137 @@
+// Copyright AudioKit. All Rights Reserved.
+
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// decodeParallel() gives each thread at least this many frames; about five seconds at 48 kHz
+#define WAVPACK_MIN_PARALLEL_FRAMES (1 << 18)
+
+namespace DunneCore
+{
+    // one frame's worth of WavPack blocks: a single block for mono and stereo files
+    struct WavPackBlock
+    {
+        uint64_t offset;            // of its first block's header in the file
+        uint64_t firstFrame;
+        uint32_t frameCount;
+    };
+
+    // where a WavPack file's bytes are: a file on disk, or memory, e.g. one file of a bundled archive
+    // or of a mapped pack file (see mapFile()). Memory isn't copied, so it must stay valid for as long
+    // as anything decodes from it.
+    struct WavPackSource
+    {
+        std::string path;
+        const uint8_t *data = 0;
+        size_t byteCount = 0;
+
+        static WavPackSource file(const char *path);
+        static WavPackSource memory(const void *data, size_t byteCount);
+
+        bool isMemory() const { return data != 0; }
+
+        /// the path, or for memory a name made of its address and size, so it is as unique as a path
+        std::string getName() const;
+    };
+
+    // a memory source as WavPack reads it, through a WavpackStreamReader64
+    struct WavPackMemoryStream
+    {
+        const uint8_t *data;
+        size_t byteCount;
+        size_t position;
+    };
+
+    /// map a whole file into memory, read-only, e.g. a pack of the WavPack files of a kit; 0 on failure
+    const void *mapFile(const char *path, size_t &byteCount);
+    void unmapFile(const void *data, size_t byteCount);
+
+    // WavPackDecoder indexes the blocks of a WavPack (version 4 or later) file when it opens it.
+    // Blocks decode independently of one another, so with the index any range of frames can be
+    // decoded without decoding what comes before it, and a long range can be split at block
+    // boundaries and decoded on several threads at once.
+    //
+    // After open() it is read-only, so any number of threads can decode from it; each decode reads
+    // the file through its own handle.
+    class WavPackDecoder
+    {
+    public:
+        WavPackDecoder();
+
+        /// returns false and fills errorMessage (100 chars) if the file can't be opened or indexed
+        bool open(const WavPackSource &source, char *errorMessage);
+        bool open(const char *path, char *errorMessage) { return open(WavPackSource::file(path), errorMessage); }
+
+        const WavPackSource &getSource() const { return source; }
+        float getSampleRate() const { return sampleRate; }
+        int getChannelCount() const { return channelCount; }
+        size_t getFrameCount() const { return frameCount; }
+        int getBitsPerSample() const { return bitsPerSample; }
+        bool isFloat() const { return floatSamples; }
+        const std::vector<WavPackBlock> &getBlocks() const { return blocks; }
+
+        /// index of the block holding frame (the last block, if frame is past the end)
+        size_t findBlock(size_t frame) const;
+
+        /// decode count planar frames from startFrame on (right == left for mono); false on failure
+        bool decode(size_t startFrame, size_t count, float *left, float *right) const;
+
+        /// split the count frames from startFrame on into ranges of whole blocks, at least minFrames
+        /// long (except where the file runs out), and call decodeRange(start, count) for each, on up
+        /// to threadCount threads including the calling one. False if any call returned false.
+        bool forEachRange(size_t startFrame, size_t count, int threadCount, size_t minFrames,
+                          const std::function<bool(size_t, size_t)> &decodeRange) const;
+
+        /// decode(), with the ranges decoded in parallel
+        bool decodeParallel(size_t startFrame, size_t count, float *left, float *right, int threadCount,
+                            size_t minFrames = WAVPACK_MIN_PARALLEL_FRAMES) const;
+
+    protected:
+        WavPackSource source;
+        float sampleRate;
+        int channelCount;           // 1 or 2
+        size_t frameCount;
+        int bitsPerSample;
+        bool floatSamples;
+        std::vector<WavPackBlock> blocks;
+
+        // reads the header at offset, false past the end
+        bool index(const std::function<bool(uint64_t offset, uint8_t *header, size_t size)> &readAt);
+    };
+
+    // WavPackBlockReader decodes a WavPackDecoder's file sequentially from any frame on. seek()
+    // starts at the block holding that frame, and frames are only read from disk (or memory) as
+    // they are asked for. Use from one thread at a time.
+    class WavPackBlockReader
+    {
+    public:
+        WavPackBlockReader();
+        ~WavPackBlockReader() { close(); }
+        WavPackBlockReader(const WavPackBlockReader&) = delete;
+        WavPackBlockReader& operator=(const WavPackBlockReader&) = delete;
+
+        bool seek(const WavPackDecoder &decoder, size_t startFrame);
+        void close();
+
+        /// the next count planar frames (right == left for mono); false on failure or past the end
+        bool read(size_t count, float *left, float *right);
+
+        /// frame the next read() starts at
+        size_t getPosition() const { return position; }
+
+    protected:
+        const WavPackDecoder *decoder;
+        FILE *file;
+        WavPackMemoryStream memory;
+        void *context;              // WavpackContext
+        size_t position;
+        std::vector<int32_t> unpacked;
+
+        bool unpack(size_t count, float *left, float *right);
+    };
+}
@@ -34,10 +34,22 @@
     #define DECORR_STEREO_PASS_CONT unpack_decorr_stereo_pass_cont_armv7
     #define DECORR_STEREO_PASS_CONT_AVAILABLE 1
     #define DECORR_MONO_PASS_CONT unpack_decorr_mono_pass_cont_armv7
+#elif defined(OPT_SIMD_SSE41) || defined(OPT_SIMD_NEON)
+    #define DECORR_STEREO_PASS_CONT unpack_decorr_stereo_pass_cont_simd
+    #define DECORR_STEREO_PASS_CONT_AVAILABLE (!(wpc->open_flags & OPEN_NO_SIMD) && unpack_simd_available ())
+    #define DECORR_MONO_PASS_CONT unpack_decorr_mono_pass_cont_c
+    #define DECORR_MONO_PASS_CONT_AVAILABLE (!(wpc->open_flags & OPEN_NO_SIMD))
+#endif
+
+#if defined(DECORR_MONO_PASS_CONT) && !defined(DECORR_MONO_PASS_CONT_AVAILABLE)
+    #define DECORR_MONO_PASS_CONT_AVAILABLE 1
 #endif
 
 #ifdef DECORR_STEREO_PASS_CONT
 extern void DECORR_STEREO_PASS_CONT (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count, int32_t long_math);
+#endif
+
+#ifdef DECORR_MONO_PASS_CONT
 extern void DECORR_MONO_PASS_CONT (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count, int32_t long_math);
 #endif
 
@@ -120,7 +132,7 @@ int32_t unpack_samples (WavpackContext *wpc, int32_t *buffer, uint32_t sample_co
             i = get_words_lossless (wps, buffer, sample_count);
 
 #ifdef DECORR_MONO_PASS_CONT
-        if (sample_count < 16)
+        if (sample_count < 16 || !DECORR_MONO_PASS_CONT_AVAILABLE)
             for (tcount = wps->num_terms, dpp = wps->decorr_passes; tcount--; dpp++)
                 decorr_mono_pass (dpp, buffer, sample_count);
         else
@@ -748,40 +760,37 @@ static void fixup_samples (WavpackContext *wpc, int32_t *buffer, uint32_t sample
     }
 
     if (lossy_flag) {
-        int32_t min_value, max_value, min_shifted, max_shifted;
+        int32_t min_value, max_value;
 
         switch (flags & BYTES_STORED) {
             case 0:
-                min_shifted = (min_value = -128 >> shift) << shift;
-                max_shifted = (max_value = 127 >> shift) << shift;
+                min_value = -128 >> shift;
+                max_value = 127 >> shift;
                 break;
 
             case 1:
-                min_shifted = (min_value = -32768 >> shift) << shift;
-                max_shifted = (max_value = 32767 >> shift) << shift;
+                min_value = -32768 >> shift;
+                max_value = 32767 >> shift;
                 break;
 
             case 2:
-                min_shifted = (min_value = -8388608 >> shift) << shift;
-                max_shifted = (max_value = 8388607 >> shift) << shift;
+                min_value = -8388608 >> shift;
+                max_value = 8388607 >> shift;
                 break;
 
             case 3: default:    /* "default" suppresses compiler warning */
-                min_shifted = (min_value = (int32_t) 0x80000000 >> shift) << shift;
-                max_shifted = (max_value = (int32_t) 0x7fffffff >> shift) << shift;
+                min_value = (int32_t) 0x80000000 >> shift;
+                max_value = (int32_t) 0x7fffffff >> shift;
                 break;
         }
 
         if (!(flags & MONO_DATA))
             sample_count *= 2;
 
+        // clip, then shift: no branches, so compilers vectorize it
         while (sample_count--) {
-            if (*buffer < min_value)
-                *buffer++ = min_shifted;
-            else if (*buffer > max_value)
-                *buffer++ = max_shifted;
-            else
-                *buffer++ <<= shift;
+            int32_t value = *buffer < min_value ? min_value : (*buffer > max_value ? max_value : *buffer);
+            *buffer++ = value << shift;
         }
     }
     else if (shift) {
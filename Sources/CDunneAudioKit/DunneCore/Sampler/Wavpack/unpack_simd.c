@@ -0,0 +1,287 @@
+////////////////////////////////////////////////////////////////////////////
+//                           **** WAVPACK ****                            //
+//                  Hybrid Lossless Wavefile Compressor                   //
+//              Copyright (c) 1998 - 2013 Conifer Software.               //
+//                          All Rights Reserved.                          //
+//      Distributed under the BSD Software License (see license.txt)      //
+////////////////////////////////////////////////////////////////////////////
+
+// unpack_simd.c
+
+// This module holds C replacements for the assembly decorrelation loops of
+// upstream WavPack, used by unpack.c when no assembly is built in. Like the
+// assembly, they continue a pass which decorr_stereo_pass() or
+// decorr_mono_pass() has begun on the first 2 (or "term") samples of the
+// buffer, so they can read their history straight from the buffer.
+//
+// Each channel's decorrelation is a recurrence, so the stereo loops put the
+// left and right channels side by side in one SSE4.1 or NEON vector rather
+// than working along the buffer. That serves terms 17, 18, 1-8 and -3; for
+// -1 and -2 one channel's result feeds the other's within the same sample,
+// so they stay scalar, as does the mono loop. Weights are applied with
+// 64-bit products, which give what apply_weight() does without its branch.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wavpack_local.h"
+
+#if defined(OPT_SIMD_SSE41) || defined(OPT_SIMD_NEON)
+
+#if defined(OPT_SIMD_SSE41)
+#include <smmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIMD_FUNCTION static __forceinline
+#define SIMD_TARGET
+#else
+#define SIMD_FUNCTION static inline __attribute__ ((target ("sse4.1")))
+#define SIMD_TARGET __attribute__ ((target ("sse4.1")))
+#endif
+
+// a left/right pair, each value twice: {L, L, R, R}, so that _mm_mul_epi32() sees both
+
+typedef __m128i pair_t;
+
+SIMD_FUNCTION pair_t pair_set (int32_t a, int32_t b) { return _mm_set_epi32 (b, b, a, a); }
+SIMD_FUNCTION pair_t pair_load (const int32_t *p) { return _mm_shuffle_epi32 (_mm_loadl_epi64 ((const __m128i *) p), 0x50); }
+SIMD_FUNCTION void pair_store (int32_t *p, pair_t v) { _mm_storel_epi64 ((__m128i *) p, _mm_shuffle_epi32 (v, 0x08)); }
+SIMD_FUNCTION void pair_get (pair_t v, int32_t *a, int32_t *b) { *a = _mm_cvtsi128_si32 (v); *b = _mm_extract_epi32 (v, 2); }
+SIMD_FUNCTION pair_t pair_add (pair_t a, pair_t b) { return _mm_add_epi32 (a, b); }
+SIMD_FUNCTION pair_t pair_sub (pair_t a, pair_t b) { return _mm_sub_epi32 (a, b); }
+SIMD_FUNCTION pair_t pair_shr1 (pair_t a) { return _mm_srai_epi32 (a, 1); }
+SIMD_FUNCTION pair_t pair_swap (pair_t a) { return _mm_shuffle_epi32 (a, 0x4e); }
+SIMD_FUNCTION pair_t pair_min (pair_t a, pair_t b) { return _mm_min_epi32 (a, b); }
+SIMD_FUNCTION pair_t pair_xor (pair_t a, pair_t b) { return _mm_xor_si128 (a, b); }
+SIMD_FUNCTION pair_t pair_sign (pair_t a) { return _mm_srai_epi32 (a, 31); }
+SIMD_FUNCTION pair_t pair_select (pair_t mask, pair_t a, pair_t b) { return _mm_blendv_epi8 (b, a, mask); }
+
+// all ones where both are non-zero
+SIMD_FUNCTION pair_t pair_both (pair_t a, pair_t b)
+{
+    __m128i zero = _mm_setzero_si128 ();
+    return _mm_andnot_si128 (_mm_or_si128 (_mm_cmpeq_epi32 (a, zero), _mm_cmpeq_epi32 (b, zero)), _mm_set1_epi32 (-1));
+}
+
+// (weight * sample + 512) >> 10; the low 32 bits of a logical 64-bit shift are those of an arithmetic one
+SIMD_FUNCTION pair_t pair_apply_weight (pair_t weight, pair_t sample)
+{
+    __m128i product = _mm_add_epi64 (_mm_mul_epi32 (weight, sample), _mm_set_epi32 (0, 512, 0, 512));
+    return _mm_shuffle_epi32 (_mm_srli_epi64 (product, 10), 0xa0);
+}
+
+#else
+#include <arm_neon.h>
+#define SIMD_FUNCTION static inline
+#define SIMD_TARGET
+
+typedef int32x2_t pair_t;
+
+SIMD_FUNCTION pair_t pair_set (int32_t a, int32_t b) { int32_t v [2] = { a, b }; return vld1_s32 (v); }
+SIMD_FUNCTION pair_t pair_load (const int32_t *p) { return vld1_s32 (p); }
+SIMD_FUNCTION void pair_store (int32_t *p, pair_t v) { vst1_s32 (p, v); }
+SIMD_FUNCTION void pair_get (pair_t v, int32_t *a, int32_t *b) { *a = vget_lane_s32 (v, 0); *b = vget_lane_s32 (v, 1); }
+SIMD_FUNCTION pair_t pair_add (pair_t a, pair_t b) { return vadd_s32 (a, b); }
+SIMD_FUNCTION pair_t pair_sub (pair_t a, pair_t b) { return vsub_s32 (a, b); }
+SIMD_FUNCTION pair_t pair_shr1 (pair_t a) { return vshr_n_s32 (a, 1); }
+SIMD_FUNCTION pair_t pair_swap (pair_t a) { return vrev64_s32 (a); }
+SIMD_FUNCTION pair_t pair_min (pair_t a, pair_t b) { return vmin_s32 (a, b); }
+SIMD_FUNCTION pair_t pair_xor (pair_t a, pair_t b) { return veor_s32 (a, b); }
+SIMD_FUNCTION pair_t pair_sign (pair_t a) { return vshr_n_s32 (a, 31); }
+SIMD_FUNCTION pair_t pair_select (pair_t mask, pair_t a, pair_t b) { return vbsl_s32 (vreinterpret_u32_s32 (mask), a, b); }
+SIMD_FUNCTION pair_t pair_both (pair_t a, pair_t b) { return vreinterpret_s32_u32 (vand_u32 (vtst_s32 (a, a), vtst_s32 (b, b))); }
+
+SIMD_FUNCTION pair_t pair_apply_weight (pair_t weight, pair_t sample)
+{
+    return vmovn_s64 (vshrq_n_s64 (vaddq_s64 (vmull_s32 (weight, sample), vdupq_n_s64 (512)), 10));
+}
+#endif
+
+// update_weight() and update_weight_clip() for both channels at once
+
+SIMD_FUNCTION pair_t pair_update_weight (pair_t weight, pair_t delta, pair_t source, pair_t result)
+{
+    pair_t s = pair_sign (pair_xor (source, result));
+    return pair_select (pair_both (source, result), pair_sub (pair_add (pair_xor (delta, s), weight), s), weight);
+}
+
+SIMD_FUNCTION pair_t pair_update_weight_clip (pair_t weight, pair_t delta, pair_t source, pair_t result)
+{
+    pair_t s = pair_sign (pair_xor (source, result));
+    pair_t clipped = pair_min (pair_sub (pair_add (pair_xor (weight, s), delta), s), pair_set (1024, 1024));
+    return pair_select (pair_both (source, result), pair_sub (pair_xor (clipped, s), s), weight);
+}
+
+#if defined(OPT_SIMD_SSE41) && !defined(_MSC_VER)
+int unpack_simd_available (void)
+{
+    return __builtin_cpu_supports ("sse4.1");
+}
+#elif defined(OPT_SIMD_SSE41)
+int unpack_simd_available (void)
+{
+    static int available = -1;
+    int info [4];
+
+    if (available < 0) {
+        __cpuid (info, 1);
+        available = (info [2] >> 19) & 1;
+    }
+
+    return available;
+}
+#else
+int unpack_simd_available (void)
+{
+    return 1;
+}
+#endif
+
+#define apply_weight_64(weight, sample) ((int32_t)(((int64_t) weight * sample + 512) >> 10))
+
+SIMD_TARGET void unpack_decorr_stereo_pass_cont_simd (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count, int32_t long_math)
+{
+    int32_t *bptr, *eptr = buffer + (sample_count * 2);
+    int32_t weight_A = dpp->weight_A, weight_B = dpp->weight_B, delta = dpp->delta, sam;
+    pair_t weight = pair_set (weight_A, weight_B), deltas = pair_set (delta, delta);
+    pair_t sam_AB, in_AB, out_AB, last_AB, prev_AB;
+    int k, i;
+
+    (void) long_math;   // the 64-bit products are exact either way
+
+    switch (dpp->term) {
+        case 17:
+        case 18:
+            last_AB = pair_load (buffer - 2);
+            prev_AB = pair_load (buffer - 4);
+
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                if (dpp->term == 17)
+                    sam_AB = pair_sub (pair_add (last_AB, last_AB), prev_AB);
+                else
+                    sam_AB = pair_add (last_AB, pair_shr1 (pair_sub (last_AB, prev_AB)));
+
+                in_AB = pair_load (bptr);
+                out_AB = pair_add (pair_apply_weight (weight, sam_AB), in_AB);
+                weight = pair_update_weight (weight, deltas, sam_AB, in_AB);
+                pair_store (bptr, out_AB);
+                prev_AB = last_AB;
+                last_AB = out_AB;
+            }
+
+            dpp->samples_B [0] = bptr [-1];
+            dpp->samples_A [0] = bptr [-2];
+            dpp->samples_B [1] = bptr [-3];
+            dpp->samples_A [1] = bptr [-4];
+            break;
+
+        default:
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                sam_AB = pair_load (bptr - dpp->term * 2);
+                in_AB = pair_load (bptr);
+                pair_store (bptr, pair_add (pair_apply_weight (weight, sam_AB), in_AB));
+                weight = pair_update_weight (weight, deltas, sam_AB, in_AB);
+            }
+
+            for (k = dpp->term - 1, i = MAX_TERM; i--; k--) {
+                dpp->samples_B [k & (MAX_TERM - 1)] = *--bptr;
+                dpp->samples_A [k & (MAX_TERM - 1)] = *--bptr;
+            }
+
+            break;
+
+        // each channel follows the other's last sample
+        case -3:
+            last_AB = pair_load (buffer - 2);
+
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                sam_AB = pair_swap (last_AB);
+                in_AB = pair_load (bptr);
+                last_AB = pair_add (pair_apply_weight (weight, sam_AB), in_AB);
+                weight = pair_update_weight_clip (weight, deltas, sam_AB, in_AB);
+                pair_store (bptr, last_AB);
+            }
+
+            dpp->samples_A [0] = bptr [-1];
+            dpp->samples_B [0] = bptr [-2];
+            break;
+
+        // one channel follows the other within a sample, so these stay scalar
+        case -1:
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                sam = bptr [0];
+                bptr [0] = apply_weight_64 (weight_A, bptr [-1]) + sam;
+                update_weight_clip (weight_A, delta, bptr [-1], sam);
+                sam = bptr [1];
+                bptr [1] = apply_weight_64 (weight_B, bptr [0]) + sam;
+                update_weight_clip (weight_B, delta, bptr [0], sam);
+            }
+
+            dpp->samples_A [0] = bptr [-1];
+            weight = pair_set (weight_A, weight_B);
+            break;
+
+        case -2:
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                sam = bptr [1];
+                bptr [1] = apply_weight_64 (weight_B, bptr [-2]) + sam;
+                update_weight_clip (weight_B, delta, bptr [-2], sam);
+                sam = bptr [0];
+                bptr [0] = apply_weight_64 (weight_A, bptr [1]) + sam;
+                update_weight_clip (weight_A, delta, bptr [1], sam);
+            }
+
+            dpp->samples_B [0] = bptr [-2];
+            weight = pair_set (weight_A, weight_B);
+            break;
+    }
+
+    pair_get (weight, &dpp->weight_A, &dpp->weight_B);
+}
+
+// one recurrence, so plain C; it gains from the buffer history and the branchless weights
+
+void unpack_decorr_mono_pass_cont_c (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count, int32_t long_math)
+{
+    int32_t *bptr, *eptr = buffer + sample_count;
+    int32_t weight_A = dpp->weight_A, delta = dpp->delta, sam_A, in_A;
+    int k, i;
+
+    (void) long_math;
+
+    switch (dpp->term) {
+        case 17:
+        case 18:
+            for (bptr = buffer; bptr < eptr; bptr++) {
+                if (dpp->term == 17)
+                    sam_A = 2 * bptr [-1] - bptr [-2];
+                else
+                    sam_A = (3 * bptr [-1] - bptr [-2]) >> 1;
+
+                in_A = bptr [0];
+                bptr [0] = apply_weight_64 (weight_A, sam_A) + in_A;
+                update_weight (weight_A, delta, sam_A, in_A);
+            }
+
+            dpp->samples_A [0] = bptr [-1];
+            dpp->samples_A [1] = bptr [-2];
+            break;
+
+        default:
+            for (bptr = buffer; bptr < eptr; bptr++) {
+                sam_A = bptr [-dpp->term];
+                in_A = bptr [0];
+                bptr [0] = apply_weight_64 (weight_A, sam_A) + in_A;
+                update_weight (weight_A, delta, sam_A, in_A);
+            }
+
+            for (k = dpp->term - 1, i = MAX_TERM; i--; k--)
+                dpp->samples_A [k & (MAX_TERM - 1)] = *--bptr;
+
+            break;
+    }
+
+    dpp->weight_A = weight_A;
+}
+
+#endif
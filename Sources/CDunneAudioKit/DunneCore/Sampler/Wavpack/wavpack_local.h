@@ -606,6 +606,21 @@ int unpack_cpu_has_feature_x86 (int findex), pack_cpu_has_feature_x86 (int finde
 
 #define CPU_FEATURE_MMX     23
 
+// unpack_simd.c: decorrelation loops for unpack.c, stereo in SSE4.1 (checked for at run time)
+// or NEON, where no assembly is built in; define NO_SIMD to leave them out
+
+#if !defined(NO_SIMD) && !defined(OPT_ASM_X86) && !defined(OPT_ASM_X64) && !defined(OPT_ASM_ARM)
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define OPT_SIMD_SSE41
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define OPT_SIMD_NEON
+#endif
+#endif
+
+#if defined(OPT_SIMD_SSE41) || defined(OPT_SIMD_NEON)
+int unpack_simd_available (void);
+#endif
+
 ///////////////////////////// pre-4.0 version decoding ////////////////////////////
 // modules: unpack3.c, unpack3_open.c, unpack3_seek.c
 
@@ -790,6 +805,7 @@ WavpackContext *WavpackOpenFileInput (const char *infilename, char *error, int f
 #define OPEN_ALT_TYPES  0x400   // application is aware of alternate file types & qmode
                                 // (just affects retrieving wrappers & MD5 checksums)
 #define OPEN_NO_CHECKSUM 0x800  // don't verify block checksums before decoding
+#define OPEN_NO_SIMD    0x1000  // decode with the original scalar loops only (for checking the others)
 
 int WavpackGetMode (WavpackContext *wpc);
 
@@ -1,7 +1,9 @@
 // Copyright AudioKit. All Rights Reserved.
 
 #ifdef __cplusplus
-#import <memory>
+#pragma once
+
+#include <memory>
 
 #define SYNTH_CHUNKSIZE 16            // process samples in "chunks" this size
 
@@ -1,7 +1,6 @@
 // Copyright AudioKit. All Rights Reserved.
 
 #import "SamplerDSP.h"
-#include "wavpack.h"
 #include <math.h>
 
 #import "DSPBase.h"
@@ -52,40 +51,71 @@ void akSamplerLoadData(int ident, DSPRef pDSP, SampleDataDescriptor *pSDD) {
     ((SamplerDSP*)pDSP)->loadSampleData(*pSDD);
 }
 
-void akSamplerLoadCompressedFile(DSPRef pDSP, SampleFileDescriptor *pSFD)
+bool akSamplerLoadCompressedFile(DSPRef pDSP, SampleFileDescriptor *pSFD)
 {
-    char errMsg[100];
-    WavpackContext *wpc = WavpackOpenFileInput(pSFD->path, errMsg, OPEN_2CH_MAX, 0);
-    if (wpc == 0)
-    {
-        printf("Wavpack error loading %s: %s\n", pSFD->path, errMsg);
-        return;
-    }
-    
-    SampleDataDescriptor sdd;
-    sdd.sampleDescriptor = pSFD->sampleDescriptor;
-    sdd.sampleRate = (float)WavpackGetSampleRate(wpc);
-    sdd.channelCount = WavpackGetReducedChannels(wpc);
-    sdd.sampleCount = WavpackGetNumSamples(wpc);
-    sdd.isInterleaved = sdd.channelCount > 1;
-    sdd.data = new float[sdd.channelCount * sdd.sampleCount];
-
-    int mode = WavpackGetMode(wpc);
-    WavpackUnpackSamples(wpc, (int32_t*)sdd.data, sdd.sampleCount);
-    if ((mode & MODE_FLOAT) == 0)
-    {
-        // convert samples to floating-point
-        int bps = WavpackGetBitsPerSample(wpc);
-        float scale = 1.0f / (1 << (bps - 1));
-        float *pf = sdd.data;
-        int32_t *pi = (int32_t*)pf;
-        for (int i = 0; i < (sdd.sampleCount * sdd.channelCount); i++)
-            *pf++ = scale * *pi++;
-    }
-    WavpackCloseFile(wpc);
+    return ((SamplerDSP*)pDSP)->loadCompressedSampleFile(*pSFD);
+}
+
+bool akSamplerLoadCompressedFiles(DSPRef pDSP, const SampleFileDescriptor *pSFDs, int count, int threadCount,
+                                  SampleLoadProgressCallback progress, void *progressContext)
+{
+    return ((SamplerDSP*)pDSP)->loadCompressedSampleFiles(pSFDs, count, threadCount, progress, progressContext);
+}
+
+bool akSamplerLoadCompressedMemory(DSPRef pDSP, SampleMemoryDescriptor *pSMD)
+{
+    return ((SamplerDSP*)pDSP)->loadCompressedSampleMemory(*pSMD);
+}
+
+bool akSamplerLoadCompressedMemories(DSPRef pDSP, const SampleMemoryDescriptor *pSMDs, int count, int threadCount,
+                                     SampleLoadProgressCallback progress, void *progressContext)
+{
+    return ((SamplerDSP*)pDSP)->loadCompressedSampleMemories(pSMDs, count, threadCount, progress, progressContext);
+}
 
-    ((SamplerDSP*)pDSP)->loadSampleData(sdd);
-    delete[] sdd.data;
+bool akSamplerLoadSFZ(DSPRef pDSP, const char *path, int threadCount, SFZSampleCallback loadOther, void *context)
+{
+    return ((SamplerDSP*)pDSP)->loadSFZ(path, threadCount, loadOther, context);
+}
+
+bool akSamplerGetSampleLoop(DSPRef pDSP, UInt8 noteNumber, UInt8 velocity, LoopDescriptor *loop)
+{
+    return ((SamplerDSP*)pDSP)->getSampleLoop(noteNumber, velocity, *loop);
+}
+
+const void *akSamplerMapFile(const char *path, size_t *byteCount)
+{
+    return DunneCore::mapFile(path, *byteCount);
+}
+
+void akSamplerUnmapFile(const void *data, size_t byteCount)
+{
+    DunneCore::unmapFile(data, byteCount);
+}
+
+void akSamplerSetStorageFormat(DSPRef pDSP, SampleStorageFormat format)
+{
+    ((SamplerDSP*)pDSP)->setSampleStorageFormat(format);
+}
+
+void akSamplerSetInterpolation(DSPRef pDSP, SampleInterpolation interpolation)
+{
+    ((SamplerDSP*)pDSP)->setSampleInterpolation(interpolation);
+}
+
+void akSamplerSetPyramids(DSPRef pDSP, bool enabled)
+{
+    ((SamplerDSP*)pDSP)->setSamplePyramids(enabled);
+}
+
+void akSamplerSetStreaming(DSPRef pDSP, bool enabled, size_t headFrames)
+{
+    ((SamplerDSP*)pDSP)->setSampleStreaming(enabled, headFrames);
+}
+
+SampleStreamingStatistics akSamplerGetStreamingStatistics(DSPRef pDSP)
+{
+    return ((SamplerDSP*)pDSP)->getStreamingStatistics();
 }
 
 void akSamplerUnloadAllSamples(DSPRef pDSP)
@@ -93,6 +123,31 @@ void akSamplerUnloadAllSamples(DSPRef pDSP)
     ((SamplerDSP*)pDSP)->unloadAllSamples();
 }
 
+void akSamplerSetMixCacheBudget(DSPRef pDSP, size_t bytes)
+{
+    ((SamplerDSP*)pDSP)->setMixCacheBudget(bytes);
+}
+
+SampleMixCacheStatistics akSamplerGetMixCacheStatistics(DSPRef pDSP)
+{
+    return ((SamplerDSP*)pDSP)->getMixCacheStatistics();
+}
+
+void akSamplerSetStretchCacheBudget(DSPRef pDSP, size_t bytes)
+{
+    ((SamplerDSP*)pDSP)->setStretchCacheBudget(bytes);
+}
+
+SampleStretchCacheStatistics akSamplerGetStretchCacheStatistics(DSPRef pDSP)
+{
+    return ((SamplerDSP*)pDSP)->getStretchCacheStatistics();
+}
+
+SampleMemoryStatistics akSamplerGetMemoryStatistics(DSPRef pDSP)
+{
+    return ((SamplerDSP*)pDSP)->getMemoryStatistics();
+}
+
 void akSamplerSetNoteFrequency(DSPRef pDSP, int noteNumber, float noteFrequency)
 {
     ((SamplerDSP*)pDSP)->setNoteFrequency(noteNumber, noteFrequency);
@@ -112,23 +167,38 @@ void akSamplerSetLoopThruRelease(DSPRef pDSP, bool value) {
 
 void akSamplerPlayNote(DSPRef pDSP, int64_t sampleTime)
 {
-    ((SamplerDSP*)pDSP)->play(sampleTime);
+    ((SamplerDSP*)pDSP)->postPlay(sampleTime);
 }
 
 void akSamplerPrepareNote(DSPRef pDSP, UInt8 noteNumber, UInt8 velocity, LoopDescriptor loop)
 {
     ((SamplerDSP*)pDSP)->identity = noteNumber;
-    ((SamplerDSP*)pDSP)->prepareNote(noteNumber, velocity, loop);
+    ((SamplerDSP*)pDSP)->postPrepareNote(noteNumber, velocity, loop);
 }
 
 void akSamplerStopNote(DSPRef pDSP, UInt8 noteNumber, bool immediate)
 {
-    ((SamplerDSP*)pDSP)->stopNote(noteNumber, immediate);
+    ((SamplerDSP*)pDSP)->postStopNote(noteNumber, immediate);
+}
+
+bool akSamplerStopAllVoices(DSPRef pDSP, double timeoutSeconds)
+{
+    return ((SamplerDSP*)pDSP)->stopAllVoices(timeoutSeconds);
+}
+
+uint64_t akSamplerPostStopAllVoices(DSPRef pDSP)
+{
+    return ((SamplerDSP*)pDSP)->postStopAllVoices();
+}
+
+bool akSamplerVoicesStopped(DSPRef pDSP, uint64_t ticket)
+{
+    return ((SamplerDSP*)pDSP)->voicesStopped(ticket);
 }
 
-void akSamplerStopAllVoices(DSPRef pDSP)
+bool akSamplerWaitForVoicesStopped(DSPRef pDSP, uint64_t ticket, double timeoutSeconds)
 {
-    ((SamplerDSP*)pDSP)->stopAllVoices();
+    return ((SamplerDSP*)pDSP)->waitForVoicesStopped(ticket, timeoutSeconds);
 }
 
 void akSamplerRestartVoices(DSPRef pDSP)
@@ -138,7 +208,7 @@ void akSamplerRestartVoices(DSPRef pDSP)
 
 void akSamplerSustainPedal(DSPRef pDSP, bool pedalDown)
 {
-    ((SamplerDSP*)pDSP)->sustainPedal(pedalDown);
+    ((SamplerDSP*)pDSP)->postSustainPedal(pedalDown);
 }
 
 
@@ -233,48 +303,48 @@ void SamplerDSP::setParameter(AUParameterAddress address, float value, bool imme
             break;
 
         case SamplerParameterAttackDuration:
-            setADSRAttackDurationSeconds(value);
+            postSetter(&CoreSampler::setADSRAttackDurationSeconds, value);
             break;
         case SamplerParameterHoldDuration:
-            setADSRHoldDurationSeconds(value);
+            postSetter(&CoreSampler::setADSRHoldDurationSeconds, value);
             break;
         case SamplerParameterDecayDuration:
-            setADSRDecayDurationSeconds(value);
+            postSetter(&CoreSampler::setADSRDecayDurationSeconds, value);
             break;
         case SamplerParameterSustainLevel:
-            setADSRSustainFraction(value);
+            postSetter(&CoreSampler::setADSRSustainFraction, value);
             break;
         case SamplerParameterReleaseHoldDuration:
-            setADSRReleaseHoldDurationSeconds(value);
+            postSetter(&CoreSampler::setADSRReleaseHoldDurationSeconds, value);
             break;
         case SamplerParameterReleaseDuration:
-            setADSRReleaseDurationSeconds(value);
+            postSetter(&CoreSampler::setADSRReleaseDurationSeconds, value);
             break;
 
         case SamplerParameterFilterAttackDuration:
-            setFilterAttackDurationSeconds(value);
+            postSetter(&CoreSampler::setFilterAttackDurationSeconds, value);
             break;
         case SamplerParameterFilterDecayDuration:
-            setFilterDecayDurationSeconds(value);
+            postSetter(&CoreSampler::setFilterDecayDurationSeconds, value);
             break;
         case SamplerParameterFilterSustainLevel:
-            setFilterSustainFraction(value);
+            postSetter(&CoreSampler::setFilterSustainFraction, value);
             break;
         case SamplerParameterFilterReleaseDuration:
-            setFilterReleaseDurationSeconds(value);
+            postSetter(&CoreSampler::setFilterReleaseDurationSeconds, value);
             break;
 
         case SamplerParameterPitchAttackDuration:
-            setPitchAttackDurationSeconds(value);
+            postSetter(&CoreSampler::setPitchAttackDurationSeconds, value);
             break;
         case SamplerParameterPitchDecayDuration:
-            setPitchDecayDurationSeconds(value);
+            postSetter(&CoreSampler::setPitchDecayDurationSeconds, value);
             break;
         case SamplerParameterPitchSustainLevel:
-            setPitchSustainFraction(value);
+            postSetter(&CoreSampler::setPitchSustainFraction, value);
             break;
         case SamplerParameterPitchReleaseDuration:
-            setPitchReleaseDurationSeconds(value);
+            postSetter(&CoreSampler::setPitchReleaseDurationSeconds, value);
             break;
         case SamplerParameterPitchADSRSemitones:
             pitchADSRSemitonesRamp.setTarget(value, immediate);
@@ -395,22 +465,26 @@ void SamplerDSP::handleMIDIEvent(const AUMIDIEvent &midiEvent)
     if (midiEvent.length != 3) return;
     uint8_t status = midiEvent.data[0] & 0xF0;
     //uint8_t channel = midiEvent.data[0] & 0x0F; // works in omni mode.
+    // called on the render thread at the event's frame, so these act at once; the time matters
+    // to play(), which starts the note from the beginning of its loop on that frame
+    AUEventSampleTime sampleTime = midiEvent.eventSampleTime;
     switch (status) {
         case MIDI_NOTE_OFF : {
             uint8_t note = midiEvent.data[1];
             if (note > 127) break;
-            stopNote(note, false);
+            postStopNote(note, false, sampleTime);
             break;
         }
         case MIDI_NOTE_ON : {
             uint8_t note = midiEvent.data[1];
             uint8_t veloc = midiEvent.data[2];
             if (note > 127 || veloc > 127) break;
-            prepareNote(note, veloc, {
+            postPrepareNote(note, veloc, {
                 .isLooping = true,
                 .startPoint = 0,
                 .endPoint = 0
-            });
+            }, sampleTime);
+            postPlay(sampleTime);
             break;
         }
         case MIDI_CONTINUOUS_CONTROLLER : {
@@ -418,13 +492,14 @@ void SamplerDSP::handleMIDIEvent(const AUMIDIEvent &midiEvent)
             if (num == 64) {
                 uint8_t value = midiEvent.data[2];
                 if (value <= 63) {
-                    sustainPedal(false);
+                    postSustainPedal(false, sampleTime);
                 } else {
-                    sustainPedal(true);
+                    postSustainPedal(true, sampleTime);
                 }
             }
             if (num == 123) { // all notes off
-                stopAllVoices();
+                // leaves alone any stopAllVoices() lock-out a control thread holds
+                postAllNotesOff(sampleTime);
             }
             break;
         }
@@ -54,8 +54,27 @@ typedef NS_ENUM(AUParameterAddress, SamplerParameter)
 
 AK_API DSPRef akSamplerCreateDSP(void);
 AK_API void akSamplerLoadData(int ident, DSPRef pDSP, SampleDataDescriptor *pSDD);
-AK_API void akSamplerLoadCompressedFile(DSPRef pDSP, SampleFileDescriptor *pSFD);
+AK_API bool akSamplerLoadCompressedFile(DSPRef pDSP, SampleFileDescriptor *pSFD);
+AK_API bool akSamplerLoadCompressedFiles(DSPRef pDSP, const SampleFileDescriptor *pSFDs, int count, int threadCount,
+                                         SampleLoadProgressCallback progress, void *progressContext);
+AK_API bool akSamplerLoadCompressedMemory(DSPRef pDSP, SampleMemoryDescriptor *pSMD);
+AK_API bool akSamplerLoadCompressedMemories(DSPRef pDSP, const SampleMemoryDescriptor *pSMDs, int count, int threadCount,
+                                            SampleLoadProgressCallback progress, void *progressContext);
+AK_API bool akSamplerLoadSFZ(DSPRef pDSP, const char *path, int threadCount, SFZSampleCallback loadOther, void *context);
+AK_API bool akSamplerGetSampleLoop(DSPRef pDSP, UInt8 noteNumber, UInt8 velocity, LoopDescriptor *loop);
+AK_API const void *akSamplerMapFile(const char *path, size_t *byteCount);
+AK_API void akSamplerUnmapFile(const void *data, size_t byteCount);
+AK_API void akSamplerSetStorageFormat(DSPRef pDSP, SampleStorageFormat format);
+AK_API void akSamplerSetInterpolation(DSPRef pDSP, SampleInterpolation interpolation);
+AK_API void akSamplerSetPyramids(DSPRef pDSP, bool enabled);
+AK_API void akSamplerSetStreaming(DSPRef pDSP, bool enabled, size_t headFrames);
+AK_API SampleStreamingStatistics akSamplerGetStreamingStatistics(DSPRef pDSP);
 AK_API void akSamplerUnloadAllSamples(DSPRef pDSP);
+AK_API void akSamplerSetMixCacheBudget(DSPRef pDSP, size_t bytes);
+AK_API SampleMixCacheStatistics akSamplerGetMixCacheStatistics(DSPRef pDSP);
+AK_API void akSamplerSetStretchCacheBudget(DSPRef pDSP, size_t bytes);
+AK_API SampleStretchCacheStatistics akSamplerGetStretchCacheStatistics(DSPRef pDSP);
+AK_API SampleMemoryStatistics akSamplerGetMemoryStatistics(DSPRef pDSP);
 AK_API void akSamplerSetNoteFrequency(DSPRef pDSP, int noteNumber, float noteFrequency);
 AK_API void akSamplerBuildSimpleKeyMap(DSPRef pDSP);
 AK_API void akSamplerBuildKeyMap(DSPRef pDSP);
@@ -63,7 +82,10 @@ AK_API void akSamplerSetLoopThruRelease(DSPRef pDSP, bool value);
 AK_API void akSamplerPlayNote(DSPRef pDSP, int64_t sampleTime);
 AK_API void akSamplerPrepareNote(DSPRef pDSP, UInt8 noteNumber, UInt8 velocity, LoopDescriptor loop);
 AK_API void akSamplerStopNote(DSPRef pDSP, UInt8 noteNumber, bool immediate);
-AK_API void akSamplerStopAllVoices(DSPRef pDSP);
+AK_API bool akSamplerStopAllVoices(DSPRef pDSP, double timeoutSeconds);
+AK_API uint64_t akSamplerPostStopAllVoices(DSPRef pDSP);
+AK_API bool akSamplerVoicesStopped(DSPRef pDSP, uint64_t ticket);
+AK_API bool akSamplerWaitForVoicesStopped(DSPRef pDSP, uint64_t ticket, double timeoutSeconds);
 AK_API void akSamplerRestartVoices(DSPRef pDSP);
 AK_API void akSamplerSustainPedal(DSPRef pDSP, bool pedalDown);
 
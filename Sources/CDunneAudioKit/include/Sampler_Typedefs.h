@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 typedef struct
 {
     bool isLooping, reversed, phaseInvert;
@@ -47,3 +49,90 @@ typedef struct
     const char *path;
     
 } SampleFileDescriptor;
+
+// a WavPack file in memory, e.g. one of many in an archive, which the sampler reads in place
+typedef struct
+{
+    SampleDescriptor sampleDescriptor;
+
+    const void *data;
+    size_t byteCount;
+
+} SampleMemoryDescriptor;
+
+// called as a batch of sample files loads, each time another file has been decoded
+typedef void (*SampleLoadProgressCallback)(void *context, int loadedCount, int totalCount);
+
+// called by loadSFZ() for each region whose sample isn't WavPack, for the caller to load itself,
+// e.g. with loadSampleData()
+typedef void (*SFZSampleCallback)(void *context, const SampleDescriptor *sampleDescriptor, const char *path);
+
+typedef struct
+{
+    unsigned long long hits, misses, evictions;
+    unsigned long long bytesUsed, bytesBudget;
+    unsigned int entryCount;
+
+} SampleMixCacheStatistics;
+
+typedef struct
+{
+    unsigned long long bakes, failures;     // loops rendered offline, and those which couldn't be (e.g. over budget)
+    unsigned long long plays;               // times a voice went from its stretcher to a baked loop
+    unsigned long long evictions;
+    unsigned long long bytesUsed, bytesBudget;
+    unsigned int entryCount;
+
+} SampleStretchCacheStatistics;
+
+typedef struct
+{
+    unsigned long long residentBytes;       // sample data held in memory
+    unsigned long long streamedBytes;       // sample data left on disk, read as it plays
+    unsigned long long ringBytes;           // read-ahead buffers shared by the voices
+    unsigned long long underruns;           // times a voice caught up with the read-ahead
+    unsigned long long underrunFrames;      // frames played as silence because of that
+    unsigned long long framesRead;          // frames read ahead from disk
+    unsigned int streamedSampleCount;
+
+} SampleStreamingStatistics;
+
+typedef struct
+{
+    unsigned long long sampleBytes;         // decoded sample data this sampler plays
+    unsigned long long sharedBytes;         // of which also played by other samplers
+    unsigned long long proportionalBytes;   // each decoded sample divided among the samplers playing it
+    unsigned long long externalBytes;       // loadSampleData() buffers, which belong to the caller
+    unsigned long long mixCacheBytes, streamRingBytes;
+    unsigned long long stretchCacheBytes;   // loops baked at a steady speed and pitch (see setStretchCacheBudget())
+    unsigned long long pyramidBytes;        // octave-down copies of samples (see setSamplePyramids())
+    unsigned long long storeBytes;          // decoded sample data held for all samplers in the process
+    unsigned int sampleCount;
+
+} SampleMemoryStatistics;
+
+// how loadCompressedSampleFile() keeps decoded samples in memory
+typedef enum
+{
+    SampleStorageFloat32,       // 4 bytes per sample
+    SampleStorageInt16,         // 2 bytes per sample; lossless for 16-bit files
+    SampleStorageInt24          // 3 bytes per sample, packed; lossless for files of up to 24 bits
+
+} SampleStorageFormat;
+
+static inline int sampleStorageBytes(SampleStorageFormat format)
+{
+    return format == SampleStorageInt16 ? 2 : format == SampleStorageInt24 ? 3 : 4;
+}
+
+// how voices read their (time-stretched) samples: frame by frame at the stretcher's pitch, or
+// resampled at the note's pitch, with bend, glide and vibrato, by one of the interpolation kernels
+typedef enum
+{
+    SampleInterpolationNone,        // one frame per output frame; the note's pitch doesn't apply
+    SampleInterpolationLinear,      // 2 taps
+    SampleInterpolationCubic,       // 4-tap Hermite
+    SampleInterpolationSinc4,       // 4-tap windowed sinc, from a polyphase table
+    SampleInterpolationSinc8        // 8-tap windowed sinc, from a polyphase table
+
+} SampleInterpolation;
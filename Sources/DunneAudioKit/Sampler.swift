@@ -517,9 +517,25 @@ public class Sampler: Node {
         }
     }
 
-    /// Stop all voices
-    public func stopAllVoices() {
-        akSamplerStopAllVoices(au.dsp)
+    /// Stop all voices, waiting for the audio thread to silence them
+    /// - Parameter timeout: Seconds to wait
+    /// - Returns: Whether every voice was silenced in time (false if, say, the engine isn't running)
+    @discardableResult
+    public func stopAllVoices(timeout: Double = 1.0) -> Bool {
+        akSamplerStopAllVoices(au.dsp, timeout)
+    }
+
+    /// Stop all voices without blocking the calling thread
+    /// - Parameters:
+    ///   - timeout: Seconds to wait for the audio thread to silence them
+    ///   - completion: Called on the main queue with whether every voice was silenced in time
+    public func stopAllVoices(timeout: Double = 1.0, completion: @escaping (Bool) -> Void) {
+        let au = self.au
+        let ticket = akSamplerPostStopAllVoices(au.dsp)
+        DispatchQueue.global(qos: .userInitiated).async {
+            let stopped = akSamplerWaitForVoicesStopped(au.dsp, ticket, timeout)
+            DispatchQueue.main.async { completion(stopped) }
+        }
     }
 
     /// Restart voices
@@ -536,9 +552,110 @@ public class Sampler: Node {
 
     /// Load data from compressed file
     /// - Parameter sampleFileDescriptor: Sample descriptor information
-    public func loadCompressedSampleFile(from sampleFileDescriptor: SampleFileDescriptor) {
+    /// - Returns: false if the file couldn't be read
+    @discardableResult
+    public func loadCompressedSampleFile(from sampleFileDescriptor: SampleFileDescriptor) -> Bool {
         var copy = sampleFileDescriptor
-        akSamplerLoadCompressedFile(au.dsp, &copy)
+        return akSamplerLoadCompressedFile(au.dsp, &copy)
+    }
+
+    /// Load several compressed files at once, decoding them in parallel, then build the key map
+    /// - Parameters:
+    ///   - sampleFileDescriptors: Sample descriptor information for each file
+    ///   - threadCount: Most threads to decode on; 0 picks a number to suit the machine
+    ///   - progress: Called on the calling thread with the number of files decoded so far, and the total
+    /// - Returns: false, with none of the files loaded, if any of them couldn't be read
+    @discardableResult
+    public func loadCompressedSampleFiles(from sampleFileDescriptors: [SampleFileDescriptor],
+                                          threadCount: Int = 0,
+                                          progress: ((Int, Int) -> Void)? = nil) -> Bool {
+        var progress = progress
+        return withUnsafeMutablePointer(to: &progress) { context in
+            akSamplerLoadCompressedFiles(au.dsp, sampleFileDescriptors, Int32(sampleFileDescriptors.count),
+                                         Int32(threadCount), { context, loadedCount, totalCount in
+                let progress = context?.assumingMemoryBound(to: (((Int, Int) -> Void)?).self).pointee
+                progress?(Int(loadedCount), Int(totalCount))
+            }, context)
+        }
+    }
+
+    /// Load a compressed file from memory, e.g. from inside a bundled archive, with no temporary file
+    /// - Parameter sampleMemoryDescriptor: Sample descriptor information, and where the file's bytes are
+    /// - Returns: false if the data couldn't be read
+    ///
+    /// The bytes are read in place, and must stay valid and unchanged until the samples are unloaded.
+    @discardableResult
+    public func loadCompressedSampleMemory(from sampleMemoryDescriptor: SampleMemoryDescriptor) -> Bool {
+        var copy = sampleMemoryDescriptor
+        return akSamplerLoadCompressedMemory(au.dsp, &copy)
+    }
+
+    /// Load several compressed files from memory at once, decoding them in parallel, then build the key map
+    /// - Parameters:
+    ///   - sampleMemoryDescriptors: Sample descriptor information, and where the bytes are, for each file
+    ///   - threadCount: Most threads to decode on; 0 picks a number to suit the machine
+    ///   - progress: Called on the calling thread with the number of files decoded so far, and the total
+    /// - Returns: false, with none of the files loaded, if any of them couldn't be read
+    @discardableResult
+    public func loadCompressedSampleMemories(from sampleMemoryDescriptors: [SampleMemoryDescriptor],
+                                             threadCount: Int = 0,
+                                             progress: ((Int, Int) -> Void)? = nil) -> Bool {
+        var progress = progress
+        return withUnsafeMutablePointer(to: &progress) { context in
+            akSamplerLoadCompressedMemories(au.dsp, sampleMemoryDescriptors, Int32(sampleMemoryDescriptors.count),
+                                            Int32(threadCount), { context, loadedCount, totalCount in
+                let progress = context?.assumingMemoryBound(to: (((Int, Int) -> Void)?).self).pointee
+                progress?(Int(loadedCount), Int(totalCount))
+            }, context)
+        }
+    }
+
+    /// Map a whole file into memory, read-only, e.g. a pack holding every compressed file of a kit
+    /// - Parameter path: The file's path
+    /// - Returns: Its bytes, to point SampleMemoryDescriptors into, or nil if it can't be mapped
+    public static func mapFile(atPath path: String) -> UnsafeRawBufferPointer? {
+        var byteCount = 0
+        guard let data = akSamplerMapFile(path, &byteCount) else { return nil }
+        return UnsafeRawBufferPointer(start: data, count: byteCount)
+    }
+
+    /// Unmap a file mapped with mapFile(atPath:), once no sampler has samples loaded from it
+    public static func unmapFile(_ bytes: UnsafeRawBufferPointer) {
+        akSamplerUnmapFile(bytes.baseAddress, bytes.count)
+    }
+
+    /// Keep compressed sample files loaded after this as 16-bit or packed 24-bit integers instead of floats
+    /// - Parameter format: Storage format; Int16 halves memory use, and Int24 cuts it by a quarter
+    public func setSampleStorageFormat(_ format: SampleStorageFormat) {
+        akSamplerSetStorageFormat(au.dsp, format)
+    }
+
+    /// Resample playing voices at their notes' pitch (with bend, glide and vibrato) by an interpolation kernel
+    /// - Parameter interpolation: Kernel for notes started after this; none (the default) plays the
+    ///   time-stretched samples frame by frame, at the stretcher's pitch only. Higher-order kernels alias
+    ///   less and cost more: linear, cubic, then 4- and 8-point sinc
+    public func setSampleInterpolation(_ interpolation: SampleInterpolation) {
+        akSamplerSetInterpolation(au.dsp, interpolation)
+    }
+
+    /// Give samples loaded after this octave-down copies, which interpolating voices play for notes
+    /// over an octave above the sample, so they alias less; takes up to as much memory again
+    /// - Parameter enabled: Whether to build the copies
+    public func setSamplePyramids(_ enabled: Bool) {
+        akSamplerSetPyramids(au.dsp, enabled)
+    }
+
+    /// Stream compressed sample files loaded after this from disk, keeping only their start in memory
+    /// - Parameters:
+    ///   - enabled: Whether to stream
+    ///   - headFrames: Frames of each file kept in memory, so notes can start at once
+    public func setSampleStreaming(_ enabled: Bool, headFrames: Int = 65536) {
+        akSamplerSetStreaming(au.dsp, enabled, headFrames)
+    }
+
+    /// Memory use and underrun counts of streamed samples
+    public var streamingStatistics: SampleStreamingStatistics {
+        akSamplerGetStreamingStatistics(au.dsp)
     }
 
     /// Unload all the samples from memory
@@ -546,6 +663,33 @@ public class Sampler: Node {
         akSamplerUnloadAllSamples(au.dsp)
     }
 
+    /// Limit the memory used for prepared mixes of multi-track and reversed loops
+    /// - Parameter bytes: Budget in bytes; least recently used mixes are freed first
+    public func setMixCacheBudget(bytes: Int) {
+        akSamplerSetMixCacheBudget(au.dsp, bytes)
+    }
+
+    /// Hit, miss and memory statistics of the mix cache
+    public var mixCacheStatistics: SampleMixCacheStatistics {
+        akSamplerGetMixCacheStatistics(au.dsp)
+    }
+
+    /// Bake loops whose speed and pitch hold steady, so voices play them without time-stretching
+    /// - Parameter bytes: Memory for baked loops; 0 turns baking off
+    public func setStretchCacheBudget(bytes: Int) {
+        akSamplerSetStretchCacheBudget(au.dsp, bytes)
+    }
+
+    /// Bake, play and memory statistics of the stretch cache
+    public var stretchCacheStatistics: SampleStretchCacheStatistics {
+        akSamplerGetStretchCacheStatistics(au.dsp)
+    }
+
+    /// Memory used by this sampler's samples, including how much is shared with other samplers
+    public var memoryStatistics: SampleMemoryStatistics {
+        akSamplerGetMemoryStatistics(au.dsp)
+    }
+
     /// Assign a note number to a particular frequency
     /// - Parameters:
     ///   - noteNumber: MIDI Note number
@@ -588,6 +732,17 @@ public class Sampler: Node {
         akSamplerPrepareNote(au.dsp, noteNumber, velocity, loop)
     }
 
+    /// The loop an SFZ file defines for the sample a note and velocity play, if it has one
+    /// - Parameters:
+    ///   - noteNumber: MIDI Note Number
+    ///   - velocity: Velocity of the note
+    ///   - loop: Loop to start from; its looping flag and start and end points are replaced
+    /// - Returns: The loop to pass to prepare(noteNumber:velocity:loop:), or nil if the sample doesn't loop
+    public func sampleLoop(noteNumber: UInt8, velocity: MIDIVelocity, loop: LoopDescriptor) -> LoopDescriptor? {
+        var loop = loop
+        return akSamplerGetSampleLoop(au.dsp, noteNumber, velocity, &loop) ? loop : nil
+    }
+
     /// Stop the sampler playback of a specific note
     /// - Parameter noteNumber: MIDI Note number
     public func stop(noteNumber: UInt8, channel: MIDIChannel = 0) {
@@ -35,4 +35,215 @@ class SamplerTests: XCTestCase {
         testMD5(audio)
     }
 
+    /// Sampler playing the test file as one looping track, with the loop's frame count
+    func makeLoopSampler() -> (Sampler, UInt32) {
+        let sampleURL = Bundle.module.url(forResource: "TestResources/12345", withExtension: "wav")!
+        let file = try! AVAudioFile(forReading: sampleURL)
+        let frameCount = Float(file.length)
+        let sampler = Sampler(sampleDescriptor: SampleDescriptor(noteNumber: 64, noteFrequency: 440, minimumNoteNumber: 0, maximumNoteNumber: 127, minimumVelocity: 0, maximumVelocity: 127, startPoint: 0.0, endPoint: frameCount), file: file)
+        sampler.buildSimpleKeyMap()
+        sampler.masterVolume = 0.01
+        return (sampler, UInt32(frameCount))
+    }
+
+    func makeLoop(endPoint: UInt32, enabledTracks: UnsafeMutablePointer<UInt32>?) -> LoopDescriptor {
+        LoopDescriptor(isLooping: true, reversed: false, phaseInvert: false,
+                       pitch: 0, speed: 0, varispeed: 0,
+                       startPoint: 0, endPoint: endPoint,
+                       enabledTracksCount: 1, enabledTracks: enabledTracks,
+                       mutedCount: 0, mutedStartPoints: nil, mutedEndPoints: nil)
+    }
+
+    /// Renders a dense stretched loop with many voices, to track per-voice render cost (voices per core)
+    func testPolyphonyPerformance() {
+        let engine = AudioEngine()
+        let (sampler, frameCount) = makeLoopSampler()
+        engine.output = sampler
+        _ = engine.startTest(totalDuration: 1.0)
+
+        var enabledTracks: [UInt32] = [0]
+        enabledTracks.withUnsafeMutableBufferPointer { tracks in
+            let loop = makeLoop(endPoint: frameCount, enabledTracks: tracks.baseAddress)
+
+            // voices only become busy once rendered, so start them one at a time
+            var sampleTime: Int64 = 0
+            for voice in 0 ..< 48 {
+                sampler.prepare(noteNumber: MIDINoteNumber(40 + voice), velocity: 127, loop: loop)
+                sampler.play(sampleTime: sampleTime)
+                sampleTime += Int64(engine.render(duration: 0.01).frameLength)
+            }
+        }
+
+        measure {
+            _ = engine.render(duration: 1.0)
+        }
+    }
+
+    /// Triggering and rendering notes must not touch the heap: voices reuse their preallocated
+    /// groups and stretchers, and reversed loops are mixed on the mix cache's thread
+    func testNoteOnDoesNotAllocate() {
+        let engine = AudioEngine()
+        let (sampler, frameCount) = makeLoopSampler()
+        engine.output = sampler
+        _ = engine.startTest(totalDuration: 1.0)
+
+        // render through the sampler's own render block, on this thread, into a buffer made up
+        // front; once it has rendered, this thread's calls are carried out as they're made
+        let frames: AUAudioFrameCount = 512
+        let renderBlock = sampler.au.internalRenderBlock
+        let buffer = AVAudioPCMBuffer(pcmFormat: sampler.avAudioNode.outputFormat(forBus: 0), frameCapacity: frames)!
+        buffer.frameLength = frames
+        let bufferList = buffer.mutableAudioBufferList
+        var flags = AudioUnitRenderActionFlags()
+        var timeStamp = AudioTimeStamp()
+        timeStamp.mFlags = .sampleTimeValid
+
+        var enabledTracks: [UInt32] = [0]
+        enabledTracks.withUnsafeMutableBufferPointer { tracks in
+            var loop = makeLoop(endPoint: frameCount, enabledTracks: tracks.baseAddress)
+            for reversed in [false, true] {
+                loop.reversed = reversed
+                sampler.prepare(noteNumber: 60, velocity: 127, loop: loop)
+                sampler.play(sampleTime: Int64(timeStamp.mSampleTime))
+                _ = renderBlock(&flags, &timeStamp, frames, 0, bufferList, nil, nil)
+                timeStamp.mSampleTime += Double(frames)
+
+                let allocations = countAllocations {
+                    for note in 0 ..< 100 {
+                        sampler.prepare(noteNumber: MIDINoteNumber(40 + note % 24), velocity: 127, loop: loop)
+                        sampler.play(sampleTime: Int64(timeStamp.mSampleTime))
+                        _ = renderBlock(&flags, &timeStamp, frames, 0, bufferList, nil, nil)
+                        timeStamp.mSampleTime += Double(frames)
+                    }
+                }
+                XCTAssertEqual(allocations, 0, reversed ? "reversed loop" : "forward loop")
+            }
+        }
+    }
+
+    /// Retriggering a reversed loop should mix it once, on the cache's thread, then reuse the cached mix
+    func testMixCacheReuse() {
+        let engine = AudioEngine()
+        let (sampler, frameCount) = makeLoopSampler()
+        engine.output = sampler
+        _ = engine.startTest(totalDuration: 1.0)
+
+        var enabledTracks: [UInt32] = [0]
+        enabledTracks.withUnsafeMutableBufferPointer { tracks in
+            var loop = makeLoop(endPoint: frameCount, enabledTracks: tracks.baseAddress)
+            loop.reversed = true
+            for note in 0 ..< 10 {
+                sampler.prepare(noteNumber: MIDINoteNumber(40 + note), velocity: 127, loop: loop)
+                sampler.play(sampleTime: 0)
+            }
+        }
+
+        // the notes are carried out as the sampler renders; the loop is mixed meanwhile
+        _ = engine.render(duration: 0.1)
+        let deadline = Date().addingTimeInterval(1.0)
+        while sampler.mixCacheStatistics.entryCount == 0 && Date() < deadline {
+            usleep(1000)
+        }
+
+        let stats = sampler.mixCacheStatistics
+        XCTAssertEqual(stats.misses, 1)
+        XCTAssertEqual(stats.hits, 9)
+        XCTAssertEqual(stats.entryCount, 1)
+
+        sampler.unloadAllSamples()
+        XCTAssertEqual(sampler.mixCacheStatistics.entryCount, 0)
+    }
+
+}
+
+// Allocation counting for testNoteOnDoesNotAllocate: every malloc zone's allocators are swapped
+// for ones which count the calls made on one thread, then forward them. C function pointers can't
+// capture, so the state is global.
+
+private struct CountedZone {
+    let zone: UnsafeMutablePointer<malloc_zone_t>
+    let original: malloc_zone_t
+}
+
+private var countedZones: [CountedZone] = []
+private var countingThread: pthread_t?
+private var allocationCount = 0
+
+private func countAllocation() {
+    if let thread = countingThread, pthread_equal(thread, pthread_self()) != 0 {
+        allocationCount += 1
+    }
+}
+
+private func original(_ zone: UnsafeMutablePointer<malloc_zone_t>?) -> malloc_zone_t {
+    for counted in countedZones where counted.zone == zone {
+        return counted.original
+    }
+    fatalError("allocation through a zone which wasn't counted")
+}
+
+/// Runs body, and returns how many allocations this thread made meanwhile, through any malloc zone
+private func countAllocations(_ body: () -> Void) -> Int {
+    // found once: other threads may still be in a counting allocator as this returns, looking
+    // through countedZones, so it is never replaced
+    if countedZones.isEmpty {
+        var zones = [malloc_default_zone()!]
+        var addresses: UnsafeMutablePointer<vm_address_t>?
+        var zoneCount: UInt32 = 0
+        if malloc_get_all_zones(mach_task_self_, nil, &addresses, &zoneCount) == KERN_SUCCESS, let addresses = addresses {
+            for i in 0 ..< Int(zoneCount) {
+                if let zone = UnsafeMutablePointer<malloc_zone_t>(bitPattern: addresses[i]), !zones.contains(zone) {
+                    zones.append(zone)
+                }
+            }
+        }
+        countedZones = zones.map { CountedZone(zone: $0, original: $0.pointee) }
+    }
+
+    // zones are usually read-only once set up
+    let pageMask = UInt(vm_page_size) - 1
+    for zone in countedZones.map({ $0.zone }) {
+        let start = UInt(bitPattern: zone) & ~pageMask
+        let end = UInt(bitPattern: zone) + UInt(MemoryLayout<malloc_zone_t>.size)
+        vm_protect(mach_task_self_, vm_address_t(start), vm_size_t(end - start), 0, VM_PROT_READ | VM_PROT_WRITE)
+
+        zone.pointee.malloc = { zone, size in
+            countAllocation()
+            return original(zone).malloc(zone, size)
+        }
+        zone.pointee.calloc = { zone, count, size in
+            countAllocation()
+            return original(zone).calloc(zone, count, size)
+        }
+        zone.pointee.valloc = { zone, size in
+            countAllocation()
+            return original(zone).valloc(zone, size)
+        }
+        zone.pointee.realloc = { zone, pointer, size in
+            countAllocation()
+            return original(zone).realloc(zone, pointer, size)
+        }
+        if zone.pointee.version >= 5 {
+            zone.pointee.memalign = { zone, alignment, size in
+                countAllocation()
+                return original(zone).memalign(zone, alignment, size)
+            }
+        }
+    }
+
+    allocationCount = 0
+    countingThread = pthread_self()
+    body()
+    countingThread = nil
+
+    for counted in countedZones {
+        counted.zone.pointee.malloc = counted.original.malloc
+        counted.zone.pointee.calloc = counted.original.calloc
+        counted.zone.pointee.valloc = counted.original.valloc
+        counted.zone.pointee.realloc = counted.original.realloc
+        if counted.zone.pointee.version >= 5 {
+            counted.zone.pointee.memalign = counted.original.memalign
+        }
+    }
+    return allocationCount
 }